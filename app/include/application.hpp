@@ -13,18 +13,14 @@
 #include <sqlite3.h>  // Include SQLite header
 #include <SQLiteCpp/SQLiteCpp.h>
 
+#include "metrics_store.hpp"
+#include "query_registry.hpp"
+#include "query_journal.hpp"
+#include "statement_cache.hpp"
 #include "../../ollama/include/ollama.hpp"
 #include "../../http/include/client.hpp"
 #include "../../log/include/log.hpp"
-
-struct MetricStatistic {
-    std::string metric_name;
-    double average_value;
-    double min_value;
-    double max_value;
-    double total_value;
-    int count;
-};
+#include "../../log/include/alloc_stats.hpp"
 
 /**
  * @brief A structure representing a query to the LLM.
@@ -36,11 +32,12 @@ struct Query {
     std::string id;  ///< Unique identifier for the query.
     std::string prompt;  ///< The prompt to be sent to the LLM.
     std::string response;  ///< The full response from the LLM.
-    std::vector<std::string> partial_responses;  ///< Accumulated partial responses from the LLM.
+    std::vector<std::string> partial_responses;  ///< Accumulated partial responses from the LLM; guarded by mutex.
     std::atomic<bool> completed{false};  ///< Indicates whether the query has been completed.
     std::atomic<bool> running{false};  ///< Indicates whether the query is currently running.
     std::atomic<bool> canceled{false};  ///< Indicates whether the query has been canceled.
     ollama::response last_context;
+    mutable std::mutex mutex;  ///< Held by the worker while it appends a partial response and by status reads.
 };
 
 /**
@@ -76,14 +73,42 @@ public:
     std::string add_query(const std::string& prompt, const ollama::response& context = ollama::response());
 
     /**
-     * @brief Retrieves the status of a specific query.
+     * @brief Writes the /query_status response for a query.
+     * 
+     * Writes {"query_id": ..., "status": {...}} with the object of write_query_status()
+     * as the status, or nothing if the query is unknown.
+     * 
+     * @param query_id The unique ID of the query.
+     * @param out The JSON writer (see json_writer.hpp) to write to.
+     * @return Whether the query exists.
+     */
+    template <class Writer>
+    bool write_query_status(const std::string& query_id, Writer& out);
+
+    /**
+     * @brief Writes the status of a query as a JSON object.
      * 
-     * The status includes whether the query is running, completed, canceled, and any partial responses received so far.
+     * The object has the query ID, whether the query is running, completed or
+     * canceled, and the partial responses received so far. Takes the query's mutex.
      * 
+     * @param out The JSON writer to write to.
      * @param query_id The unique ID of the query.
+     * @param query The query to serialize.
+     */
+    template <class Writer>
+    static void write_query_status(Writer& out, const std::string& query_id, const Query& query);
+
+    /**
+     * @brief Serializes the status of a query.
+     * 
+     * The string form of write_query_status(); exposed separately so the
+     * serialization cost can be measured on its own.
+     * 
+     * @param query_id The unique ID of the query.
+     * @param query The query to serialize.
      * @return A JSON string containing the status of the query.
      */
-    std::string get_query_status(const std::string& query_id);
+    static std::string query_status_json(const std::string& query_id, const Query& query);
 
     /**
      * @brief Cancels a specific query.
@@ -95,28 +120,101 @@ public:
     void cancel_query(const std::string& query_id);
 
     void fetch_and_update_json_data(); 
-    // Existing methods, if any, should be documented similarly.
-    void log_performance_metric(const std::string& metric_name, double metric_value);
+
+    /**
+     * @brief Records a performance metric on the blocking pool instead of the calling thread.
+     * 
+     * Used on I/O threads, where the SQLite INSERT would stall other connections.
+     * Samples are buffered and written in batches by one task at a time, so a
+     * request burst neither floods the pool with tasks nor grows without bound:
+     * past max_pending_metrics, samples are dropped and counted in the log.
+     * 
+     * @param metric_name The name of the metric.
+     * @param metric_value The value of the metric.
+     */
+    void post_performance_metric(std::string metric_name, double metric_value);
+
+    /**
+     * @brief Returns the executor of the pool that runs blocking request handlers.
+     * 
+     * The pool has a fixed number of threads (BLOCKING_THREADS, default 4), so slow disk
+     * or database work queues up there instead of occupying the io_context threads.
+     */
+    boost::asio::thread_pool::executor_type blocking_executor();
+
+    /**
+     * @brief Records allocation counters as two performance metrics.
+     * 
+     * Stored as "Allocations: <scope> (count)" and "Allocated bytes: <scope> (B)",
+     * so they are aggregated by /performance_statistics like any other metric.
+     * Both go through post_performance_metric, as this is called on I/O threads.
+     * 
+     * @param scope The phase or route the counters belong to.
+     * @param counters The allocations made in that scope.
+     */
+    void log_allocation_metric(const std::string& scope, const AllocCounters& counters);
     std::vector<MetricStatistic> get_performance_statistics();
-    nlohmann::json get_performance_statistics_json();
+
+    /**
+     * @brief Writes today's aggregates per metric as a JSON array.
+     * 
+     * @param out The JSON writer to write to.
+     */
+    template <class Writer>
+    void write_performance_statistics(Writer& out);
+
+    /**
+     * @brief Writes a metric as a bucketed time series (see MetricsStore::series).
+     * 
+     * Writes {"metric", "resolution", "from", "to", "step", "points": [{"t", "avg", "p99", "min", "max", "count"}]}.
+     * 
+     * @param out The JSON writer to write to.
+     * @param metric_name The metric to read.
+     * @param from Start of the range, in milliseconds since the epoch.
+     * @param to End of the range, exclusive.
+     * @param step Requested bucket width in milliseconds.
+     */
+    template <class Writer>
+    void write_performance_series(Writer& out, const std::string& metric_name, std::int64_t from, std::int64_t to, std::int64_t step);
 private:
     boost::asio::io_context& io_context_;  ///< Reference to the I/O context used for async operations.
     ssl::context& ssl_ctx_;
     Ollama ollama_;  ///< Instance of Ollama API handler.
-    boost::asio::steady_timer timer_;  ///< Timer used for scheduling tasks or timeouts.
+    boost::asio::steady_timer timer_;  ///< Schedules the metrics rollup.
     std::shared_ptr<Client> client_; ///< Client used for making http requests
     std::queue<std::shared_ptr<Query>> query_queue_;  ///< Queue holding queries to be processed.
-    std::unordered_map<std::string, std::shared_ptr<Query>> query_map_;  ///< Map from query IDs to their associated Query objects.
-    std::mutex queue_mutex_;  ///< Mutex to protect access to the query queue and map.
+    QueryRegistry queries_;  ///< Queries by ID, for status lookups and cancellation.
+    std::mutex queue_mutex_;  ///< Mutex to protect access to the query queue.
     std::condition_variable queue_cv_;  ///< Condition variable to signal when new queries are added to the queue.
-    std::unique_ptr<SQLite::Database> db_;
+    std::string db_filename_;  ///< The database file, METRICS_DB.
+    std::unique_ptr<SQLite::Database> db_;  ///< Writer connection: metric inserts and schema changes.
+    std::unique_ptr<SQLite::Database> reader_db_;  ///< Read-only connection for statistics, so reads never wait on inserts.
+    std::unique_ptr<QueryJournal> journal_;  ///< Write-ahead journal of submissions and completions; null when QUERY_JOURNAL is empty.
+    std::unique_ptr<StatementCache> writer_statements_;  ///< Per-thread prepared statements on db_.
+    std::unique_ptr<StatementCache> reader_statements_;  ///< Per-thread prepared statements on reader_db_.
+    std::unique_ptr<MetricsStore> metrics_;  ///< Partitioned raw samples and their rollups.
+    static constexpr std::size_t max_pending_metrics = 8192;  ///< Most samples buffered by post_performance_metric.
+    std::mutex pending_metrics_mutex_;  ///< Guards the four members below.
+    std::vector<MetricsStore::Sample> pending_metrics_;  ///< Samples posted but not written yet.
+    std::uint64_t dropped_metrics_ = 0;  ///< Samples dropped since the last flush because the buffer was full.
+    bool metrics_flush_posted_ = false;  ///< Whether a flush is queued or running on the blocking pool.
+    MetricsStore::clock::time_point writing_metrics_since_ = MetricsStore::clock::time_point::max();  ///< When the oldest sample of the batch being written was taken, or max.
+    boost::asio::thread_pool blocking_pool_;  ///< Runs blocking handlers, metric writes and rollups; declared after the databases, statement caches and metrics store so it is joined first.
     /**
      * @brief Initializes the SQLite database connection.
      * 
-     * Opens the SQLite database for the current date. If the database file does not exist, it is created.
+     * Opens the database file named by METRICS_DB (default database.db), creating it if needed.
      */
     void initialize_database();
 
+    /**
+     * @brief Opens the read-only connection used for statistics queries.
+     * 
+     * Called once the tables exist. In WAL mode its reads see the last committed
+     * inserts without blocking the writer connection, or being blocked by it.
+     */
+    void open_reader_database();
+
     /**
      * @brief Checks if a table exists in the database and creates it if it doesn't.
      * 
@@ -124,6 +222,33 @@ private:
      */
     void check_and_create_tables();
 
+    /**
+     * @brief Opens the query journal and restores the queries it holds.
+     * 
+     * Completed queries are restored for status lookups; queries that had not
+     * completed, including one running at the time of a crash, are queued again.
+     */
+    void recover_queries();
+
+    /**
+     * @brief Runs the metrics rollup on the blocking pool every minute.
+     */
+    void schedule_metrics_rollup();
+
+    /**
+     * @brief Writes the samples buffered by post_performance_metric, one transaction per batch.
+     * 
+     * Runs on the blocking pool until the buffer is empty; only one flush runs at a time.
+     */
+    void flush_performance_metrics();
+
+    /**
+     * @brief Returns when the oldest sample not yet committed was taken, or time_point::max().
+     * 
+     * Passed to MetricsStore::roll_up so it never rolls up a minute whose samples are still buffered.
+     */
+    MetricsStore::clock::time_point oldest_unwritten_metric();
+
     /**
      * @brief Continuously processes queries from the queue.
      * 
@@ -143,5 +268,71 @@ private:
     void run_query(const std::shared_ptr<Query>& query);
 };
 
+template <class Writer>
+bool Application::write_query_status(const std::string& query_id, Writer& out) {
+    auto query = queries_.find(query_id);
+    if (!query) {
+        return false;
+    }
+    out.begin_object().key("query_id").value(query_id).key("status");
+    write_query_status(out, query_id, *query);
+    out.end_object();
+    return true;
+}
+
+template <class Writer>
+void Application::write_query_status(Writer& out, const std::string& query_id, const Query& query) {
+    std::lock_guard<std::mutex> lock(query.mutex);  // The worker may be appending a partial response.
+    out.begin_object()
+        .key("query_id").value(query_id)
+        .key("completed").value(static_cast<bool>(query.completed))
+        .key("running").value(static_cast<bool>(query.running))
+        .key("canceled").value(static_cast<bool>(query.canceled))
+        .key("partial_responses").begin_array();
+    for (const auto& response : query.partial_responses) {
+        out.value(response);
+    }
+    out.end_array().end_object();
+}
+
+template <class Writer>
+void Application::write_performance_statistics(Writer& out) {
+    out.begin_array();
+    for (const auto& stat : get_performance_statistics()) {
+        out.begin_object()
+            .key("metric_name").value(stat.metric_name)
+            .key("average_value").value(stat.average_value)
+            .key("min_value").value(stat.min_value)
+            .key("max_value").value(stat.max_value)
+            .key("total_value").value(stat.total_value)
+            .key("count").value(stat.count)
+            .end_object();
+    }
+    out.end_array();
+}
+
+template <class Writer>
+void Application::write_performance_series(Writer& out, const std::string& metric_name, std::int64_t from, std::int64_t to, std::int64_t step) {
+    MetricSeries const series = metrics_->series(metric_name, from, to, step);
+    out.begin_object()
+        .key("metric").value(metric_name)
+        .key("resolution").value(series.resolution)
+        .key("from").value(series.from)
+        .key("to").value(series.to)
+        .key("step").value(series.step)
+        .key("points").begin_array();
+    for (const auto& point : series.points) {
+        out.begin_object()
+            .key("t").value(point.time)
+            .key("avg").value(point.average_value)
+            .key("p99").value(point.p99_value)
+            .key("min").value(point.min_value)
+            .key("max").value(point.max_value)
+            .key("count").value(point.count)
+            .end_object();
+    }
+    out.end_array().end_object();
+}
+
 #endif // APPLICATION_HPP
 
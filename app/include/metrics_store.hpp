@@ -0,0 +1,201 @@
+#ifndef METRICS_STORE_HPP
+#define METRICS_STORE_HPP
+
+#include "statement_cache.hpp"
+#include <SQLiteCpp/SQLiteCpp.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct MetricStatistic {
+    std::string metric_name;
+    double average_value;
+    double min_value;
+    double max_value;
+    double total_value;
+    int count;
+};
+
+/**
+ * @brief One bucket of a metric time series.
+ */
+struct MetricPoint {
+    std::int64_t time;  ///< Start of the bucket, in milliseconds since the epoch.
+    std::int64_t count;
+    double average_value;
+    double p99_value;  ///< Exact for raw samples; an upper bound where rollup buckets were merged.
+    double min_value;
+    double max_value;
+};
+
+/**
+ * @brief A bucketed metric series and the resolution it was read at.
+ */
+struct MetricSeries {
+    std::string resolution;  ///< "raw", "1m" or "1h": the coarsest table the series was read from.
+    std::int64_t from;  ///< Start of the first bucket, aligned down to the step.
+    std::int64_t to;
+    std::int64_t step;  ///< Bucket width after clamping, in milliseconds.
+    std::vector<MetricPoint> points;  ///< Non-empty buckets, oldest first.
+};
+
+/**
+ * @brief Time-partitioned performance metrics with 1-minute and 1-hour rollups.
+ *
+ * Raw samples go to one table per UTC day (metrics_raw_YYYYMMDD); the writer
+ * moves to the next table as soon as a sample falls on a new day, so a process
+ * running past midnight rotates live. roll_up(), run once a minute, folds
+ * completed minutes of raw samples into metrics_1m and completed hours of
+ * those into metrics_1h, then applies retention: expired raw partitions are
+ * dropped whole, which is far cheaper than deleting rows, and old rollup rows
+ * are deleted. The rollup tables are keyed by (metric_name, bucket), so a range
+ * over weeks reads a few hundred rows per metric instead of every sample.
+ * Each rollup row keeps count, sum, min, max and p99; a 1-hour p99 is the
+ * largest of its minutes' p99s, which bounds the true value from above.
+ *
+ * | Variable            | Default | Effect                              |
+ * |---------------------|---------|-------------------------------------|
+ * | METRICS_RAW_DAYS    | 2       | Days of raw samples kept (at least 1) |
+ * | METRICS_MINUTE_DAYS | 14      | Days of 1-minute rollups kept       |
+ * | METRICS_HOUR_DAYS   | 365     | Days of 1-hour rollups kept         |
+ *
+ * Rollup progress is kept in metrics_rollup, so a restart resumes where it
+ * stopped and no sample is counted twice. roll_up() runs each pass in one
+ * transaction on a connection of its own, so inserts on the writer connection
+ * never end up inside it.
+ */
+class MetricsStore {
+public:
+    using clock = std::chrono::system_clock;
+
+    /**
+     * @brief How long each resolution is kept, read from the environment.
+     */
+    struct Retention {
+        int raw_days = 2;
+        int minute_days = 14;
+        int hour_days = 365;
+
+        static Retention from_env();
+    };
+
+    /**
+     * @brief Creates the metrics tables and opens the connection roll_up() runs on.
+     *
+     * @param db_filename The database file the connections below are open on.
+     * @param writer The writer connection, for inserts and new partitions.
+     * @param writer_statements Prepared statements on the writer connection.
+     * @param reader_statements Prepared statements on the read-only connection.
+     * @param retention How long each resolution is kept.
+     */
+    MetricsStore(
+        const std::string& db_filename,
+        SQLite::Database& writer,
+        StatementCache& writer_statements,
+        StatementCache& reader_statements,
+        Retention retention = Retention::from_env());
+
+    /**
+     * @brief A sample waiting to be recorded.
+     */
+    struct Sample {
+        std::string metric_name;
+        double metric_value;
+        clock::time_point when;
+    };
+
+    /**
+     * @brief Records samples in the partitions of their days, in one transaction.
+     *
+     * One commit for the lot instead of one per sample, which is what makes
+     * recording keep up under load. This is the only way samples are written,
+     * so nothing else runs on the writer connection inside the transaction.
+     *
+     * @param samples The samples, oldest first.
+     */
+    void record(const std::vector<Sample>& samples);
+
+    /**
+     * @brief Aggregates today's raw samples per metric.
+     */
+    std::vector<MetricStatistic> statistics_today();
+
+    /**
+     * @brief Reads a metric as buckets of `step` milliseconds over [from, to).
+     *
+     * Reads the finest table that has the range and is no finer than the step:
+     * raw samples for sub-minute steps, metrics_1m for sub-hour steps, metrics_1h
+     * beyond. The part of the range not rolled up yet is read from the finer
+     * tables, so the newest buckets are complete too.
+     *
+     * @param metric_name The metric to read.
+     * @param from Start of the range, in milliseconds since the epoch.
+     * @param to End of the range, exclusive.
+     * @param step Requested bucket width; widened to keep at most max_points buckets.
+     *
+     * Ranges and steps wider than the hour rollups' retention are cut to it.
+     */
+    MetricSeries series(const std::string& metric_name, std::int64_t from, std::int64_t to, std::int64_t step);
+
+    /**
+     * @brief Folds completed minutes and hours into the rollups and applies retention.
+     *
+     * @param now The current time.
+     * @param unwritten When the oldest sample not written yet was taken, or
+     *        time_point::max() if there is none; its minute and later ones
+     *        are left for a later pass, so a delayed write is not lost.
+     */
+    void roll_up(clock::time_point now = clock::now(), clock::time_point unwritten = clock::time_point::max());
+
+    /**
+     * @brief Returns the raw partition table of a UTC day.
+     *
+     * @param day Days since the Unix epoch.
+     */
+    static std::string partition_name(std::int64_t day);
+
+    static constexpr std::int64_t ms_per_minute = 60 * 1000;
+    static constexpr std::int64_t ms_per_hour = 60 * ms_per_minute;
+    static constexpr std::int64_t ms_per_day = 24 * ms_per_hour;
+    static constexpr std::int64_t max_points = 1000;  ///< Most buckets series() returns.
+
+private:
+    /**
+     * @brief Creates the partition of a day if the writer has not moved to it yet.
+     */
+    void ensure_partition(std::int64_t day);
+
+    /**
+     * @brief Inserts a sample into the partition of its day, which must exist.
+     */
+    void insert(const Sample& sample);
+
+    /**
+     * @brief Folds raw samples of one partition in [from, to) into metrics_1m.
+     */
+    void fold_minutes(std::int64_t day, std::int64_t from, std::int64_t to);
+
+    /**
+     * @brief Returns the raw partition days that exist, oldest first.
+     *
+     * @param query The partition listing, prepared on the connection to ask.
+     */
+    static std::vector<std::int64_t> partition_days(SQLite::Statement& query);
+
+    std::int64_t watermark(const char* resolution, std::int64_t fallback);
+    void set_watermark(const char* resolution, std::int64_t value);
+
+    SQLite::Database& writer_;
+    SQLite::Database maintenance_;  ///< Only used by roll_up(), under rollup_mutex_.
+    StatementCache& writer_statements_;
+    StatementCache& reader_statements_;
+    Retention retention_;
+    std::mutex writer_mutex_;  ///< Serializes creating a new partition and writing a batch on writer_.
+    std::atomic<std::int64_t> partition_day_{-1};  ///< Latest day with a partition.
+    std::mutex rollup_mutex_;  ///< Keeps roll_up() runs from overlapping.
+};
+
+#endif // METRICS_STORE_HPP
@@ -0,0 +1,48 @@
+#ifndef QUERY_ID_HPP
+#define QUERY_ID_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Generates query IDs.
+ *
+ * An ID is 15 characters of Crockford base32, most significant first:
+ *
+ *   - 9 characters: milliseconds since the Unix epoch, so IDs sort by creation time;
+ *   - 2 characters: the generator, a slot taken by each thread on its first ID;
+ *   - 4 characters: the generating thread's sequence number, which also
+ *     selects the ID's partition (see shard()).
+ *
+ * Each thread counts on its own, so nothing is shared or locked after a
+ * thread's first ID, and two threads cannot produce the same ID unless more
+ * than 1024 threads generate IDs. A thread's sequence starts at a random
+ * value, which keeps IDs from a restarted process with a clock set back apart
+ * from the ones before it. An ID fits in std::string's inline buffer, so
+ * producing one does not allocate.
+ *
+ * IDs say nothing about the prompt, unlike the hash they replace.
+ */
+class QueryId {
+public:
+    static constexpr std::size_t length = 15;
+
+    /**
+     * @brief Returns a new ID.
+     */
+    static std::string next();
+
+    /**
+     * @brief Maps an ID to one of `shard_count` partitions.
+     *
+     * IDs of this format map by their sequence number modulo `shard_count`,
+     * so the partition is read off the ID and consecutive IDs of one thread
+     * go round all partitions when `shard_count` divides 2^20. Any other
+     * string, such as an ID recovered from an older journal, maps by its hash.
+     */
+    static std::size_t shard(std::string_view id, std::size_t shard_count);
+};
+
+#endif // QUERY_ID_HPP
@@ -0,0 +1,108 @@
+#ifndef QUERY_JOURNAL_HPP
+#define QUERY_JOURNAL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Append-only, group-committed write-ahead journal of LLM queries.
+ *
+ * Every submission and every completion is appended as a checksummed record.
+ * Callers only copy the record into a pending buffer; a writer thread writes
+ * everything pending with one write() and makes it durable with one
+ * fdatasync(), so records arriving while a sync is in flight share the next
+ * one instead of each paying for their own. A record is therefore durable a
+ * few milliseconds after the call returns, not when it returns.
+ *
+ * On startup recover() replays the journal: queries without a completion
+ * record are returned as pending, completed ones with their responses. A torn
+ * or corrupt tail from a crash is dropped. The journal is then compacted to
+ * just the surviving queries, so it does not grow across restarts.
+ */
+class QueryJournal {
+public:
+    /**
+     * @brief A query as recovered from the journal.
+     */
+    struct Entry {
+        std::string id;
+        std::string prompt;
+        std::string context;  ///< JSON of the context the query was submitted with, or empty.
+        bool completed = false;
+        bool canceled = false;
+        std::vector<std::string> partial_responses;
+    };
+
+    /**
+     * @brief Remembers the journal file; recover() opens it, creating it if needed, and starts the writer thread.
+     *
+     * @param path The journal file.
+     */
+    explicit QueryJournal(std::string path);
+
+    /**
+     * @brief Writes and syncs everything pending, then stops the writer thread.
+     */
+    ~QueryJournal();
+
+    QueryJournal(const QueryJournal&) = delete;
+    QueryJournal& operator=(const QueryJournal&) = delete;
+
+    /**
+     * @brief Replays the journal and compacts it to the queries returned.
+     *
+     * Call once, before recording anything.
+     *
+     * @param max_completed The most recent completed queries to keep; older ones are dropped.
+     * @return The recovered queries in submission order.
+     */
+    std::vector<Entry> recover(std::size_t max_completed);
+
+    /**
+     * @brief Records a submitted query.
+     *
+     * @param id The query ID.
+     * @param prompt The prompt.
+     * @param context JSON of the context, or empty.
+     */
+    void submitted(const std::string& id, const std::string& prompt, const std::string& context);
+
+    /**
+     * @brief Records a finished query with its responses.
+     *
+     * @param id The query ID.
+     * @param canceled Whether the query was canceled.
+     * @param partial_responses The responses received.
+     */
+    void completed(const std::string& id, bool canceled, const std::vector<std::string>& partial_responses);
+
+private:
+    /**
+     * @brief Appends an encoded record to the pending buffer and wakes the writer.
+     */
+    void append(const std::string& payload);
+
+    /**
+     * @brief Writer thread: writes and syncs the pending buffer until stopped.
+     */
+    void run();
+
+    /**
+     * @brief Writes a whole buffer to the journal file; returns false on error.
+     */
+    bool write_all(int fd, const std::string& data);
+
+    std::string path_;
+    int fd_ = -1;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::string pending_;  ///< Encoded records not yet written.
+    bool stopping_ = false;
+    std::thread writer_;
+};
+
+#endif // QUERY_JOURNAL_HPP
@@ -0,0 +1,62 @@
+#ifndef QUERY_REGISTRY_HPP
+#define QUERY_REGISTRY_HPP
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+struct Query;
+
+/**
+ * @brief Queries by ID, split into shards that are locked independently.
+ *
+ * The shard of an ID is QueryId::shard(), so a lookup goes straight to one
+ * shard and takes its lock shared: status polls on different I/O threads run
+ * side by side, and only an insert into the same shard makes them wait.
+ * Dispatching queries to the worker is not done here, so polls never contend
+ * with the queue either.
+ *
+ * A query found here stays alive while the caller holds the returned pointer;
+ * its mutable state is guarded by Query::mutex.
+ */
+class QueryRegistry {
+public:
+    static constexpr std::size_t shard_count = 64;
+
+    QueryRegistry() = default;
+    QueryRegistry(const QueryRegistry&) = delete;
+    QueryRegistry& operator=(const QueryRegistry&) = delete;
+
+    /**
+     * @brief Adds a query under its ID.
+     *
+     * @return False, leaving the registry unchanged, if the ID is already taken.
+     */
+    bool insert(const std::shared_ptr<Query>& query);
+
+    /**
+     * @brief Adds a query, replacing any query with the same ID.
+     */
+    void insert_or_assign(const std::shared_ptr<Query>& query);
+
+    /**
+     * @brief Returns the query with the given ID, or null.
+     */
+    std::shared_ptr<Query> find(const std::string& query_id) const;
+
+private:
+    struct alignas(64) shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<Query>> queries;
+    };
+
+    shard& shard_of(const std::string& query_id);
+    const shard& shard_of(const std::string& query_id) const;
+
+    std::array<shard, shard_count> shards_;
+};
+
+#endif // QUERY_REGISTRY_HPP
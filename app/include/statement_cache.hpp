@@ -0,0 +1,73 @@
+#ifndef STATEMENT_CACHE_HPP
+#define STATEMENT_CACHE_HPP
+
+#include <SQLiteCpp/SQLiteCpp.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Prepared statements of one SQLite connection, compiled once per thread.
+ *
+ * A statement can only be stepped by one thread at a time, so each thread gets
+ * its own copy of every statement it uses; after the first use a statement is
+ * only reset and rebound. The cache mutex is held just long enough to find the
+ * calling thread's statements, never while one runs.
+ *
+ * Statements on a table that is dropped, such as an expired metrics partition,
+ * are removed with retire(), so SQL naming per-day tables does not pile up.
+ *
+ * Destroy the cache before its connection, and only once no thread uses it.
+ */
+class StatementCache {
+public:
+    /**
+     * @brief Creates an empty cache for a connection.
+     *
+     * @param db The connection the statements are prepared on.
+     */
+    explicit StatementCache(SQLite::Database& db) : db_(db) {}
+
+    StatementCache(const StatementCache&) = delete;
+    StatementCache& operator=(const StatementCache&) = delete;
+
+    /**
+     * @brief Returns the calling thread's statement for `sql`, reset and with its bindings cleared.
+     *
+     * @param sql The SQL text; also the cache key.
+     * @return The prepared statement, valid until the cache is destroyed.
+     */
+    SQLite::Statement& get(const std::string& sql);
+
+    /**
+     * @brief Removes every thread's statements whose SQL mentions `name`.
+     *
+     * A statement may be in use by its thread, so each thread removes its own
+     * at the start of its next get(). A statement on `name` must therefore not
+     * be held across a get() call once `name` may be retired.
+     *
+     * @param name A table name, such as that of a dropped table.
+     */
+    void retire(const std::string& name);
+
+private:
+    using thread_statements = std::unordered_map<std::string, std::unique_ptr<SQLite::Statement>>;
+
+    struct thread_state {
+        thread_statements statements;
+        std::uint64_t retired_seen = 0;  ///< Number of retire() calls this thread has applied.
+    };
+
+    SQLite::Database& db_;
+    std::mutex mutex_;
+    std::unordered_map<std::thread::id, thread_state> threads_;  ///< Nodes are stable, so a thread's map outlives the lock.
+    std::vector<std::pair<std::uint64_t, std::string>> retired_;  ///< Names not yet applied by every thread, by sequence number.
+    std::uint64_t retired_count_ = 0;  ///< Number of retire() calls.
+};
+
+#endif // STATEMENT_CACHE_HPP
@@ -1,12 +1,74 @@
 #include "../include/application.hpp"
+#include "../include/query_id.hpp"
 #include "../../log/include/log.hpp"
+#include "../../http/include/json_writer.hpp"
 #include <vector>
 #include <numeric>
 #include <sqlite3.h>
 #include <chrono>
-#include <iomanip>
-#include <sstream>
 #include <filesystem>  // C++17 feature for file system operations
+#include <cstdlib>
+
+namespace {
+
+/**
+ * @brief Returns the Ollama server URL, overridable through the OLLAMA_URL environment variable.
+ *
+ * Load tests use this to point the application at the mock backend (bin/mock_ollama).
+ */
+std::string ollama_url() {
+    const char* url = std::getenv("OLLAMA_URL");
+    return url && *url ? std::string(url) : std::string("http://localhost:11434");
+}
+
+/**
+ * @brief Returns the number of blocking-pool threads, overridable through BLOCKING_THREADS.
+ */
+std::size_t blocking_threads() {
+    const char* threads = std::getenv("BLOCKING_THREADS");
+    int const n = threads ? std::atoi(threads) : 0;
+    return n > 0 ? static_cast<std::size_t>(n) : 4;
+}
+
+/**
+ * @brief Reads a non-negative size from the environment, or returns `fallback`.
+ */
+long long env_size(const char* name, long long fallback) {
+    const char* value = std::getenv(name);
+    long long const n = value && *value ? std::atoll(value) : -1;
+    return n >= 0 ? n : fallback;
+}
+
+/**
+ * @brief Applies the pragmas shared by the writer and reader connections.
+ *
+ * SQLITE_MMAP_SIZE (bytes, default 256 MiB) maps the database file so reads skip
+ * the page cache copy; SQLITE_CACHE_KB (default 16 MiB) sizes the page cache.
+ */
+void apply_connection_pragmas(SQLite::Database& db) {
+    db.setBusyTimeout(5000);
+    db.exec("PRAGMA mmap_size=" + std::to_string(env_size("SQLITE_MMAP_SIZE", 256LL * 1024 * 1024)) + ";");
+    db.exec("PRAGMA cache_size=-" + std::to_string(env_size("SQLITE_CACHE_KB", 16 * 1024)) + ";");
+    db.exec("PRAGMA temp_store=MEMORY;");
+}
+
+/**
+ * @brief Returns the query journal file, overridable through QUERY_JOURNAL; empty disables the journal.
+ */
+std::string query_journal_path() {
+    const char* path = std::getenv("QUERY_JOURNAL");
+    return path ? std::string(path) : std::string("query_journal.log");
+}
+
+/**
+ * @brief Returns how many completed queries survive a restart, overridable through QUERY_JOURNAL_KEEP.
+ */
+std::size_t query_journal_keep() {
+    const char* keep = std::getenv("QUERY_JOURNAL_KEEP");
+    return keep && *keep ? static_cast<std::size_t>(std::strtoull(keep, nullptr, 10)) : 10000;
+}
+
+} // namespace
 
 /**
  * @brief Constructs an Application object and starts the query processing thread.
@@ -14,13 +76,16 @@
  * @param ioc The Boost.Asio I/O context that the application will use for asynchronous operations.
  */
 Application::Application(boost::asio::io_context& ioc, ssl::context& ssl_ctx)
-    : io_context_(ioc), ssl_ctx_(ssl_ctx), client_(std::make_shared<Client>(ioc, ssl_ctx)), ollama_("http://localhost:11434"), timer_(io_context_)
+    : io_context_(ioc), ssl_ctx_(ssl_ctx), client_(std::make_shared<Client>(ioc, ssl_ctx)), ollama_(ollama_url()), timer_(io_context_), blocking_pool_(blocking_threads())
 {
     auto logger = LoggerManager::getLogger("application_logger", LogLevel::DEBUG, LogOutput::CONSOLE);
     logger->log(LogLevel::DEBUG, "Initializing app.");
 
     initialize_database();  // Initialize the database connection
     check_and_create_tables();  // Check and create necessary tables
+    open_reader_database();  // Separate connection for statistics queries
+    recover_queries();  // Restore queries from before a restart
+    schedule_metrics_rollup();
 
     // Start a thread to process the query queue
     std::thread(&Application::process_queries, this).detach();
@@ -34,38 +99,67 @@ Application::~Application() {}
 /**
  * @brief Initializes the SQLite database connection.
  * 
- * Opens the SQLite database for the current date. If the database file does not exist, it is created.
+ * Opens the database file named by METRICS_DB (default database.db), creating it if needed.
  */
 void Application::initialize_database() {
     auto logger = LoggerManager::getLogger("application_logger", LogLevel::DEBUG, LogOutput::CONSOLE);
 
-    // Get current date and create a filename
-    auto now = std::chrono::system_clock::now();
-    auto in_time_t = std::chrono::system_clock::to_time_t(now);
-    std::stringstream ss;
-    ss << std::put_time(std::localtime(&in_time_t), "%m_%d_%Y");
-    std::string db_filename = "database_" + ss.str() + ".db";
+    // One file for all days: metrics are partitioned by day inside it, so the
+    // writer rotates without reopening and queries can span days.
+    const char* path = std::getenv("METRICS_DB");
+    db_filename_ = path && *path ? std::string(path) : std::string("database.db");
 
     // Log if using an existing or new database
-    if (std::filesystem::exists(db_filename)) {
-        logger->log(LogLevel::DEBUG, "Using existing database for today: " + db_filename);
+    if (std::filesystem::exists(db_filename_)) {
+        logger->log(LogLevel::DEBUG, "Using existing database: " + db_filename_);
     } else {
-        logger->log(LogLevel::DEBUG, "Creating new database for today: " + db_filename);
+        logger->log(LogLevel::DEBUG, "Creating new database: " + db_filename_);
     }
 
     try {
-        db_ = std::make_unique<SQLite::Database>(db_filename, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        db_ = std::make_unique<SQLite::Database>(db_filename_, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+        // WAL lets the reader connection query while metrics are inserted; with WAL,
+        // synchronous=NORMAL only syncs at checkpoints and stays safe against corruption.
+        std::string const journal_mode = db_->execAndGet("PRAGMA journal_mode=WAL;").getString();
+        if (journal_mode != "wal") {
+            logger->log(LogLevel::WARN, "Database journal mode is " + journal_mode + ", not wal; statistics reads may block inserts.");
+        }
+        db_->exec("PRAGMA synchronous=NORMAL;");
+        apply_connection_pragmas(*db_);
+        writer_statements_ = std::make_unique<StatementCache>(*db_);
     } catch (const std::exception& e) {
         logger->log(LogLevel::ERROR, "Cannot open database: " + std::string(e.what()));
         throw std::runtime_error("Failed to open database");
     }
 }
 
+/**
+ * @brief Opens the read-only connection used for statistics queries.
+ * 
+ * Called once the tables exist. In WAL mode its reads see the last committed
+ * inserts without blocking the writer connection, or being blocked by it.
+ */
+void Application::open_reader_database() {
+    auto logger = LoggerManager::getLogger("application_logger", LogLevel::DEBUG, LogOutput::CONSOLE);
+
+    try {
+        reader_db_ = std::make_unique<SQLite::Database>(db_filename_, SQLite::OPEN_READONLY);
+        apply_connection_pragmas(*reader_db_);
+        reader_statements_ = std::make_unique<StatementCache>(*reader_db_);
+        metrics_ = std::make_unique<MetricsStore>(db_filename_, *db_, *writer_statements_, *reader_statements_);
+    } catch (const std::exception& e) {
+        logger->log(LogLevel::ERROR, "Cannot open reader connection: " + std::string(e.what()));
+        throw std::runtime_error("Failed to open database");
+    }
+}
+
 
 /**
  * @brief Checks if a table exists in the database and creates it if it doesn't.
  * 
  * Checks if the "example_table" exists in the SQLite database and creates it if it doesn't.
+ * The metrics tables belong to MetricsStore.
  */
 void Application::check_and_create_tables() {
     auto logger = LoggerManager::getLogger("application_logger", LogLevel::DEBUG, LogOutput::CONSOLE);
@@ -74,18 +168,9 @@ void Application::check_and_create_tables() {
                                         "id INTEGER PRIMARY KEY AUTOINCREMENT,"
                                         "data TEXT NOT NULL);";
 
-    const std::string create_metrics_table_sql = "CREATE TABLE IF NOT EXISTS performance_metrics ("
-                                                 "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-                                                 "timestamp TEXT NOT NULL,"
-                                                 "metric_name TEXT NOT NULL,"
-                                                 "metric_value REAL NOT NULL);";
-
     try {
         db_->exec(check_table_sql);
         logger->log(LogLevel::DEBUG, "Checked/created example_table successfully.");
-        
-        db_->exec(create_metrics_table_sql);
-        logger->log(LogLevel::DEBUG, "Checked/created performance_metrics table successfully.");
     } catch (const std::exception& e) {
         logger->log(LogLevel::ERROR, "Failed to create/check tables: " + std::string(e.what()));
         throw std::runtime_error("Failed to create/check tables");
@@ -93,29 +178,151 @@ void Application::check_and_create_tables() {
 }
 
 
-void Application::log_performance_metric(const std::string& metric_name, double metric_value) {
+/**
+ * @brief Opens the query journal and restores the queries it holds.
+ * 
+ * Completed queries are restored for status lookups; queries that had not
+ * completed, including one running at the time of a crash, are queued again.
+ */
+void Application::recover_queries() {
     auto logger = LoggerManager::getLogger("application_logger", LogLevel::DEBUG, LogOutput::CONSOLE);
 
-    // Get the current timestamp
-    auto now = std::chrono::system_clock::now();
-    auto in_time_t = std::chrono::system_clock::to_time_t(now);
-    std::stringstream ss;
-    ss << std::put_time(std::localtime(&in_time_t), "%Y-%m-%d %X");
+    std::string const path = query_journal_path();
+    if (path.empty()) {
+        logger->log(LogLevel::INFO, "Query journal disabled; queries will not survive a restart.");
+        return;
+    }
 
-    const std::string sql = "INSERT INTO performance_metrics (timestamp, metric_name, metric_value) VALUES (?, ?, ?);";
+    journal_ = std::make_unique<QueryJournal>(path);
+    std::size_t pending = 0;
+    for (auto& entry : journal_->recover(query_journal_keep())) {
+        auto query = std::make_shared<Query>();
+        query->id = std::move(entry.id);
+        query->prompt = std::move(entry.prompt);
+        if (!entry.context.empty()) {
+            query->last_context = ollama::response(entry.context);
+        }
+        query->completed = entry.completed;
+        query->canceled = entry.canceled;
+        query->partial_responses = std::move(entry.partial_responses);
+
+        if (!query->completed) {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            query_queue_.push(query);
+            ++pending;
+        }
+        queries_.insert_or_assign(query);
+    }
 
-    try {
-        SQLite::Statement stmt(*db_, sql);
-        stmt.bind(1, ss.str());
-        stmt.bind(2, metric_name);
-        stmt.bind(3, metric_value);
-        stmt.exec();
-        logger->log(LogLevel::DEBUG, "Performance metric logged: " + metric_name + " = " + std::to_string(metric_value));
-    } catch (const std::exception& e) {
-        logger->log(LogLevel::ERROR, "Failed to log performance metric: " + std::string(e.what()));
+    if (pending > 0) {
+        logger->log(LogLevel::INFO, "Requeued " + std::to_string(pending) + " queries from the journal.");
     }
 }
 
+/**
+ * @brief Runs the metrics rollup on the blocking pool every minute.
+ * 
+ * The timer only posts the work, so the rollup never runs on an I/O thread.
+ */
+void Application::schedule_metrics_rollup() {
+    timer_.expires_after(std::chrono::minutes(1));
+    timer_.async_wait([this](const boost::system::error_code& ec) {
+        if (ec) {
+            return;
+        }
+        boost::asio::post(blocking_pool_, [this] {
+            // Taken before the rollup reads, so every older sample is already committed.
+            metrics_->roll_up(MetricsStore::clock::now(), oldest_unwritten_metric());
+        });
+        schedule_metrics_rollup();
+    });
+}
+
+/**
+ * @brief Records a performance metric on the blocking pool instead of the calling thread.
+ * 
+ * @param metric_name The name of the metric.
+ * @param metric_value The value of the metric.
+ */
+void Application::post_performance_metric(std::string metric_name, double metric_value) {
+    std::lock_guard<std::mutex> lock(pending_metrics_mutex_);
+    if (pending_metrics_.size() >= max_pending_metrics) {
+        ++dropped_metrics_;
+        return;
+    }
+    pending_metrics_.push_back({std::move(metric_name), metric_value, MetricsStore::clock::now()});
+    if (!metrics_flush_posted_) {
+        metrics_flush_posted_ = true;
+        boost::asio::post(blocking_pool_, [this] { flush_performance_metrics(); });
+    }
+}
+
+/**
+ * @brief Writes the samples buffered by post_performance_metric, one transaction per batch.
+ * 
+ * Samples that arrive while a batch is written make up the next batch, so the
+ * batches grow with the load and the number of commits does not.
+ */
+void Application::flush_performance_metrics() {
+    auto logger = LoggerManager::getLogger("application_logger", LogLevel::DEBUG, LogOutput::CONSOLE);
+    std::vector<MetricsStore::Sample> batch;
+    for (;;) {
+        std::uint64_t dropped = 0;
+        batch.clear();
+        {
+            std::lock_guard<std::mutex> lock(pending_metrics_mutex_);
+            if (pending_metrics_.empty()) {
+                metrics_flush_posted_ = false;
+                writing_metrics_since_ = MetricsStore::clock::time_point::max();
+                return;
+            }
+            writing_metrics_since_ = pending_metrics_.front().when;
+            batch.swap(pending_metrics_);
+            std::swap(dropped, dropped_metrics_);
+        }
+
+        if (dropped != 0) {
+            logger->log(LogLevel::WARN, "Dropped " + std::to_string(dropped) + " performance metrics: the write buffer was full.");
+        }
+        try {
+            metrics_->record(batch);
+            logger->log(LogLevel::DEBUG, "Performance metrics logged: " + std::to_string(batch.size()) + " samples.");
+        } catch (const std::exception& e) {
+            logger->log(LogLevel::ERROR, "Failed to log " + std::to_string(batch.size()) + " performance metrics: " + std::string(e.what()));
+        }
+    }
+}
+
+/**
+ * @brief Returns when the oldest sample not yet committed was taken, or time_point::max().
+ * 
+ * Samples are stamped under the buffer lock, so the first of a batch is its oldest.
+ */
+MetricsStore::clock::time_point Application::oldest_unwritten_metric() {
+    std::lock_guard<std::mutex> lock(pending_metrics_mutex_);
+    return pending_metrics_.empty()
+        ? writing_metrics_since_
+        : std::min(writing_metrics_since_, pending_metrics_.front().when);
+}
+
+/**
+ * @brief Returns the executor of the pool that runs blocking request handlers.
+ */
+boost::asio::thread_pool::executor_type Application::blocking_executor() {
+    return blocking_pool_.get_executor();
+}
+
+/**
+ * @brief Records allocation counters as two performance metrics.
+ * 
+ * @param scope The phase or route the counters belong to.
+ * @param counters The allocations made in that scope.
+ */
+void Application::log_allocation_metric(const std::string& scope, const AllocCounters& counters) {
+    post_performance_metric("Allocations: " + scope + " (count)", static_cast<double>(counters.allocs));
+    post_performance_metric("Allocated bytes: " + scope + " (B)", static_cast<double>(counters.bytes));
+}
+
 
 
 /**
@@ -128,17 +335,27 @@ void Application::log_performance_metric(const std::string& metric_name, double
  */
 std::string Application::add_query(const std::string& prompt, const ollama::response& context) {
     auto query = std::make_shared<Query>();
-    query->id = std::to_string(std::hash<std::string>{}(prompt + std::to_string(std::chrono::system_clock::now().time_since_epoch().count())));
     query->prompt = prompt;
     
     if (context.is_valid()) {
         query->last_context = context;
     }
 
+    // IDs from this process never repeat; the loop only guards against an ID recovered from the journal.
+    query->id = QueryId::next();
+    while (!queries_.insert(query)) {
+        query->id = QueryId::next();
+    }
+
+    // Durable once the journal's next group commit completes; add_query does not wait for it.
+    // Written before the query is queued, so its completion can never be journaled first.
+    if (journal_) {
+        journal_->submitted(query->id, query->prompt, context.is_valid() ? context.as_json_string() : std::string());
+    }
+
     {
         std::lock_guard<std::mutex> lock(queue_mutex_);
         query_queue_.push(query);
-        query_map_[query->id] = query;
     }
 
     queue_cv_.notify_one();
@@ -148,30 +365,17 @@ std::string Application::add_query(const std::string& prompt, const ollama::resp
 
 
 /**
- * @brief Retrieves the status of a specific query.
- * 
- * The status includes whether the query is running, completed, canceled, and any partial responses received so far.
+ * @brief Serializes the status of a query.
  * 
  * @param query_id The unique ID of the query.
+ * @param query The query to serialize.
  * @return A JSON string containing the status of the query.
  */
-std::string Application::get_query_status(const std::string& query_id) {
-    std::lock_guard<std::mutex> lock(queue_mutex_);  // Lock the mutex to protect access to the query map.
-    auto it = query_map_.find(query_id);
-    if (it != query_map_.end()) {
-        // If the query is found, construct a JSON object with its status.
-        std::shared_ptr<Query> query = it->second;
-        nlohmann::json response_json;
-        response_json["query_id"] = query_id;
-        response_json["completed"] = static_cast<bool>(query->completed);
-        response_json["running"] = static_cast<bool>(query->running);
-        response_json["canceled"] = static_cast<bool>(query->canceled);
-        response_json["partial_responses"] = query->partial_responses;
-
-        return response_json.dump();  // Return the status as a JSON string.
-    } else {
-        return R"({"error": "Query ID not found."})";  // Return an error if the query ID is not found.
-    }
+std::string Application::query_status_json(const std::string& query_id, const Query& query) {
+    std::string out;
+    json_writer<std::string> writer(out);
+    write_query_status(writer, query_id, query);
+    return out;
 }
 
 /**
@@ -182,9 +386,8 @@ std::string Application::get_query_status(const std::string& query_id) {
  * @param query_id The unique ID of the query to cancel.
  */
 void Application::cancel_query(const std::string& query_id) {
-    std::lock_guard<std::mutex> lock(queue_mutex_);  // Lock the mutex to protect access to the query map.
-    if (query_map_.find(query_id) != query_map_.end()) {
-        query_map_[query_id]->canceled = true;  // Mark the query as canceled.
+    if (auto query = queries_.find(query_id)) {
+        query->canceled = true;  // Mark the query as canceled.
     }
 }
 
@@ -214,6 +417,8 @@ void Application::process_queries() {
         if (query && !query->canceled) {
             query->running = true;
             run_query(query);  // Process the query.
+        } else if (query && journal_) {
+            journal_->completed(query->id, true, query->partial_responses);  // Not replayed after a restart
         }
     }
 }
@@ -236,20 +441,22 @@ void Application::run_query(const std::shared_ptr<Query>& query) {
         logger->log(LogLevel::DEBUG, "Inside on_receive_token callback.");
 
         // Check if the response contains a partial response and handle it.
-        if (response.as_json().contains("response")) {
-            std::string partial_response = response.as_json()["response"];
+        if (response.is_valid() && !response.has_error()) {
+            const std::string& partial_response = response.as_simple_string();
             logger->log(LogLevel::DEBUG, "Valid partial response received: " + partial_response);
+            std::lock_guard<std::mutex> lock(query->mutex);  // Status reads may be serializing the list.
             query->partial_responses.push_back(partial_response);  // Add the partial response to the query.
         } else {
             logger->log(LogLevel::ERROR, "Invalid or error response: " + response.as_json_string());
         }
 
-        // Store the latest context for future queries
-        query->last_context = response;
-
         // Mark the query as completed when the "done" flag is true.
-        if (response.as_json().contains("done") && response.as_json()["done"].get<bool>()) {
+        if (response.is_done()) {
             logger->log(LogLevel::DEBUG, "Final response received. Marking query as completed.");
+            // Only the final reply carries the context; keep that array for future queries, not the whole reply.
+            if (!response.get_context().empty()) {
+                query->last_context = response.context_only();
+            }
             query->completed = true;
             query->running = false;
         }
@@ -263,17 +470,26 @@ void Application::run_query(const std::shared_ptr<Query>& query) {
     };
 
     // Send the prompt to the LLM with or without context
-    if (query->last_context.is_valid()) {
-        // Subsequent query with context
-        ollama_.generate("llava:latest", query->prompt, query->last_context, on_receive_token);
-    } else {
-        // Initial query without context
-        ollama_.generate("llava:latest", query->prompt, on_receive_token);
+    try {
+        if (query->last_context.is_valid()) {
+            // Subsequent query with context
+            ollama_.generate("llava:latest", query->prompt, query->last_context, on_receive_token);
+        } else {
+            // Initial query without context
+            ollama_.generate("llava:latest", query->prompt, on_receive_token);
+        }
+    } catch (const std::exception& e) {
+        // A failed or dropped backend connection must not take down the worker thread.
+        logger->log(LogLevel::ERROR, "Query " + query->id + " failed: " + std::string(e.what()));
     }
 
     // Mark the query as completed after processing (even if not successful).
     query->completed = true;
     query->running = false;
+
+    if (journal_) {
+        journal_->completed(query->id, query->canceled, query->partial_responses);
+    }
 }
 
 
@@ -305,51 +521,11 @@ std::vector<MetricStatistic> Application::get_performance_statistics() {
     auto logger = LoggerManager::getLogger("application_logger", LogLevel::DEBUG, LogOutput::CONSOLE);
     std::vector<MetricStatistic> stats;
 
-    const std::string sql = "SELECT metric_name, AVG(metric_value), MIN(metric_value), MAX(metric_value), SUM(metric_value), COUNT(*) "
-                            "FROM performance_metrics "
-                            "GROUP BY metric_name;";
-
     try {
-        SQLite::Statement query(*db_, sql);
-        while (query.executeStep()) {
-            MetricStatistic stat;
-            stat.metric_name = query.getColumn(0).getString();
-            stat.average_value = query.getColumn(1).getDouble();
-            stat.min_value = query.getColumn(2).getDouble();
-            stat.max_value = query.getColumn(3).getDouble();
-            stat.total_value = query.getColumn(4).getDouble();
-            stat.count = query.getColumn(5).getInt();
-            stats.push_back(stat);
-        }
+        stats = metrics_->statistics_today();
     } catch (const std::exception& e) {
         logger->log(LogLevel::ERROR, "Failed to retrieve performance statistics: " + std::string(e.what()));
     }
 
     return stats;
 }
-
-
-nlohmann::json Application::get_performance_statistics_json() {
-    auto logger = LoggerManager::getLogger("application_logger", LogLevel::DEBUG, LogOutput::CONSOLE);
-
-    nlohmann::json stats_json = nlohmann::json::array();
-    std::vector<MetricStatistic> stats = get_performance_statistics();
-
-    if (stats.empty()) {
-        logger->log(LogLevel::INFO, "No performance metrics found.");
-        return stats_json;
-    }
-
-    for (const auto& stat : stats) {
-        nlohmann::json stat_json;
-        stat_json["metric_name"] = stat.metric_name;
-        stat_json["average_value"] = stat.average_value;
-        stat_json["min_value"] = stat.min_value;
-        stat_json["max_value"] = stat.max_value;
-        stat_json["total_value"] = stat.total_value;
-        stat_json["count"] = stat.count;
-        stats_json.push_back(stat_json);
-    }
-
-    return stats_json;
-}
@@ -0,0 +1,529 @@
+#include "../include/metrics_store.hpp"
+#include "../../log/include/log.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <ctime>
+#include <exception>
+#include <limits>
+#include <map>
+#include <utility>
+
+namespace {
+
+constexpr const char* partition_prefix = "metrics_raw_";
+constexpr const char* partitions_sql =
+    "SELECT name FROM sqlite_master WHERE type = 'table' AND name LIKE 'metrics\\_raw\\_%' ESCAPE '\\';";
+
+/**
+ * @brief Reads a day count from the environment, or returns `fallback`.
+ */
+int env_days(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    int const n = value && *value ? std::atoi(value) : 0;
+    return n > 0 ? n : fallback;
+}
+
+std::int64_t to_ms(MetricsStore::clock::time_point when) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(when.time_since_epoch()).count();
+}
+
+/**
+ * @brief Rounds a timestamp down to a multiple of `step`, also for times before the epoch.
+ */
+std::int64_t floor_to(std::int64_t ms, std::int64_t step) {
+    std::int64_t const q = ms / step;
+    return (q - (ms % step < 0 ? 1 : 0)) * step;
+}
+
+/**
+ * @brief Parses the day of a partition table name; returns -1 if it is not one.
+ */
+std::int64_t parse_partition_day(const std::string& name) {
+    std::string const prefix(partition_prefix);
+    if (name.size() != prefix.size() + 8 || name.compare(0, prefix.size(), prefix) != 0
+            || !std::all_of(name.begin() + prefix.size(), name.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        return -1;
+    }
+    int const ymd = std::atoi(name.c_str() + prefix.size());
+    std::tm tm{};
+    tm.tm_year = ymd / 10000 - 1900;
+    tm.tm_mon = ymd / 100 % 100 - 1;
+    tm.tm_mday = ymd % 100;
+    return static_cast<std::int64_t>(timegm(&tm)) / (24 * 60 * 60);
+}
+
+/**
+ * @brief Nearest-rank 99th percentile; reorders `values`, which must not be empty.
+ */
+double percentile_99(std::vector<double>& values) {
+    auto const rank = static_cast<std::size_t>(std::ceil(0.99 * static_cast<double>(values.size()))) - 1;
+    std::nth_element(values.begin(), values.begin() + rank, values.end());
+    return values[rank];
+}
+
+/**
+ * @brief Aggregate of one output bucket, merged from rollup rows and raw samples.
+ */
+struct BucketAccumulator {
+    std::int64_t count = 0;
+    double sum = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    double p99 = -std::numeric_limits<double>::infinity();  ///< Largest p99 of the merged rollup rows.
+    std::vector<double> samples;  ///< Raw samples, for their exact p99.
+
+    void add_rollup(std::int64_t n, double s, double lo, double hi, double p) {
+        count += n;
+        sum += s;
+        min = std::min(min, lo);
+        max = std::max(max, hi);
+        p99 = std::max(p99, p);
+    }
+
+    void add_sample(double v) {
+        add_rollup(1, v, v, v, -std::numeric_limits<double>::infinity());
+        samples.push_back(v);
+    }
+
+    double merged_p99() {
+        return samples.empty() ? p99 : std::max(p99, percentile_99(samples));
+    }
+};
+
+} // namespace
+
+/**
+ * @brief Reads METRICS_RAW_DAYS, METRICS_MINUTE_DAYS and METRICS_HOUR_DAYS.
+ */
+MetricsStore::Retention MetricsStore::Retention::from_env() {
+    Retention retention;
+    retention.raw_days = env_days("METRICS_RAW_DAYS", retention.raw_days);
+    retention.minute_days = env_days("METRICS_MINUTE_DAYS", retention.minute_days);
+    retention.hour_days = env_days("METRICS_HOUR_DAYS", retention.hour_days);
+    return retention;
+}
+
+/**
+ * @brief Creates the metrics tables and opens the connection roll_up() runs on.
+ *
+ * @param db_filename The database file the connections below are open on.
+ * @param writer The writer connection, for inserts and new partitions.
+ * @param writer_statements Prepared statements on the writer connection.
+ * @param reader_statements Prepared statements on the read-only connection.
+ * @param retention How long each resolution is kept.
+ */
+MetricsStore::MetricsStore(
+    const std::string& db_filename,
+    SQLite::Database& writer,
+    StatementCache& writer_statements,
+    StatementCache& reader_statements,
+    Retention retention)
+    : writer_(writer),
+      maintenance_(db_filename, SQLite::OPEN_READWRITE),
+      writer_statements_(writer_statements),
+      reader_statements_(reader_statements),
+      retention_(retention)
+{
+    // Rollup rows are looked up by metric and time range, so the key is the index
+    // and the table needs no rowid of its own.
+    for (const char* table : {"metrics_1m", "metrics_1h"}) {
+        writer_.exec(std::string("CREATE TABLE IF NOT EXISTS ") + table + " ("
+                     "metric_name TEXT NOT NULL,"
+                     "bucket INTEGER NOT NULL,"
+                     "count INTEGER NOT NULL,"
+                     "sum REAL NOT NULL,"
+                     "min REAL NOT NULL,"
+                     "max REAL NOT NULL,"
+                     "p99 REAL NOT NULL,"
+                     "PRIMARY KEY (metric_name, bucket)) WITHOUT ROWID;");
+    }
+    writer_.exec("CREATE TABLE IF NOT EXISTS metrics_rollup ("
+                 "resolution TEXT PRIMARY KEY,"
+                 "watermark INTEGER NOT NULL);");
+
+    maintenance_.setBusyTimeout(5000);
+}
+
+/**
+ * @brief Returns the raw partition table of a UTC day.
+ *
+ * @param day Days since the Unix epoch.
+ */
+std::string MetricsStore::partition_name(std::int64_t day) {
+    std::time_t const t = static_cast<std::time_t>(day * (ms_per_day / 1000));
+    std::tm tm{};
+    gmtime_r(&t, &tm);
+    char buf[16];
+    std::strftime(buf, sizeof(buf), "%Y%m%d", &tm);
+    return partition_prefix + std::string(buf);
+}
+
+/**
+ * @brief Creates the partition of a day if the writer has not moved to it yet.
+ *
+ * The common case, a sample for a day that already has its partition, is one
+ * atomic load.
+ */
+void MetricsStore::ensure_partition(std::int64_t day) {
+    if (partition_day_.load(std::memory_order_acquire) >= day) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    if (partition_day_.load(std::memory_order_relaxed) >= day) {
+        return;
+    }
+    std::string const table = partition_name(day);
+    writer_.exec("CREATE TABLE IF NOT EXISTS " + table + " ("
+                 "ts INTEGER NOT NULL,"
+                 "metric_name TEXT NOT NULL,"
+                 "metric_value REAL NOT NULL);");
+    writer_.exec("CREATE INDEX IF NOT EXISTS " + table + "_ts ON " + table + " (ts);");
+    partition_day_.store(day, std::memory_order_release);
+
+    auto logger = LoggerManager::getLogger("metrics_logger", LogLevel::INFO, LogOutput::CONSOLE);
+    logger->log(LogLevel::INFO, "Metrics now go to partition " + table + ".");
+}
+
+/**
+ * @brief Inserts a sample into the partition of its day, which must exist.
+ */
+void MetricsStore::insert(const Sample& sample) {
+    std::int64_t const ts = to_ms(sample.when);
+    std::int64_t const day = floor_to(ts, ms_per_day) / ms_per_day;
+
+    auto& stmt = writer_statements_.get("INSERT INTO " + partition_name(day) + " (ts, metric_name, metric_value) VALUES (?, ?, ?);");
+    stmt.bind(1, static_cast<long long>(ts));
+    stmt.bind(2, sample.metric_name);
+    stmt.bind(3, sample.metric_value);
+    stmt.exec();
+}
+
+/**
+ * @brief Records samples in the partitions of their days, in one transaction.
+ *
+ * Partitions are created before the transaction starts: partition_day_ moves
+ * on as soon as a table is created, so a rollback must not take one back.
+ * writer_mutex_ then keeps a partition created for statistics_today() from
+ * running its DDL inside the transaction.
+ *
+ * @param samples The samples, oldest first.
+ */
+void MetricsStore::record(const std::vector<Sample>& samples) {
+    for (const Sample& sample : samples) {
+        ensure_partition(floor_to(to_ms(sample.when), ms_per_day) / ms_per_day);
+    }
+
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    SQLite::Transaction transaction(writer_);
+    for (const Sample& sample : samples) {
+        insert(sample);
+    }
+    transaction.commit();
+}
+
+/**
+ * @brief Aggregates today's raw samples per metric.
+ */
+std::vector<MetricStatistic> MetricsStore::statistics_today() {
+    std::int64_t const day = floor_to(to_ms(clock::now()), ms_per_day) / ms_per_day;
+    ensure_partition(day);  // The reader cannot create it, and the query needs it to exist
+
+    std::vector<MetricStatistic> stats;
+    auto& query = reader_statements_.get(
+        "SELECT metric_name, AVG(metric_value), MIN(metric_value), MAX(metric_value), SUM(metric_value), COUNT(*) "
+        "FROM " + partition_name(day) + " "
+        "GROUP BY metric_name;");
+    while (query.executeStep()) {
+        MetricStatistic stat;
+        stat.metric_name = query.getColumn(0).getString();
+        stat.average_value = query.getColumn(1).getDouble();
+        stat.min_value = query.getColumn(2).getDouble();
+        stat.max_value = query.getColumn(3).getDouble();
+        stat.total_value = query.getColumn(4).getDouble();
+        stat.count = query.getColumn(5).getInt();
+        stats.push_back(stat);
+    }
+    return stats;
+}
+
+/**
+ * @brief Returns the raw partition days that exist, oldest first.
+ *
+ * @param query The partition listing, prepared on the connection to ask.
+ */
+std::vector<std::int64_t> MetricsStore::partition_days(SQLite::Statement& query) {
+    std::vector<std::int64_t> days;
+    while (query.executeStep()) {
+        std::int64_t const day = parse_partition_day(query.getColumn(0).getString());
+        if (day >= 0) {
+            days.push_back(day);
+        }
+    }
+    std::sort(days.begin(), days.end());
+    return days;
+}
+
+/**
+ * @brief Folds raw samples of one partition in [from, to) into metrics_1m.
+ *
+ * The p99 needs every sample of a minute, so samples are grouped here rather
+ * than in SQL, an hour at a time to bound memory after a long pause.
+ */
+void MetricsStore::fold_minutes(std::int64_t day, std::int64_t from, std::int64_t to) {
+    SQLite::Statement select(maintenance_, "SELECT metric_name, ts, metric_value FROM " + partition_name(day)
+                                           + " WHERE ts >= ? AND ts < ?;");
+    SQLite::Statement upsert(maintenance_,
+        "INSERT INTO metrics_1m (metric_name, bucket, count, sum, min, max, p99) VALUES (?, ?, ?, ?, ?, ?, ?) "
+        "ON CONFLICT (metric_name, bucket) DO UPDATE SET "
+        "count = count + excluded.count, sum = sum + excluded.sum, "
+        "min = MIN(min, excluded.min), max = MAX(max, excluded.max), p99 = MAX(p99, excluded.p99);");
+
+    for (std::int64_t chunk = from; chunk < to; chunk += ms_per_hour) {
+        std::map<std::pair<std::string, std::int64_t>, BucketAccumulator> minutes;
+        select.reset();
+        select.bind(1, static_cast<long long>(chunk));
+        select.bind(2, static_cast<long long>(std::min(chunk + ms_per_hour, to)));
+        while (select.executeStep()) {
+            std::int64_t const bucket = floor_to(select.getColumn(1).getInt64(), ms_per_minute);
+            minutes[{select.getColumn(0).getString(), bucket}].add_sample(select.getColumn(2).getDouble());
+        }
+
+        for (auto& [key, acc] : minutes) {
+            upsert.reset();
+            upsert.bind(1, key.first);
+            upsert.bind(2, static_cast<long long>(key.second));
+            upsert.bind(3, static_cast<long long>(acc.count));
+            upsert.bind(4, acc.sum);
+            upsert.bind(5, acc.min);
+            upsert.bind(6, acc.max);
+            upsert.bind(7, acc.merged_p99());
+            upsert.exec();
+        }
+    }
+}
+
+std::int64_t MetricsStore::watermark(const char* resolution, std::int64_t fallback) {
+    SQLite::Statement query(maintenance_, "SELECT watermark FROM metrics_rollup WHERE resolution = ?;");
+    query.bind(1, std::string(resolution));
+    return query.executeStep() ? static_cast<std::int64_t>(query.getColumn(0).getInt64()) : fallback;
+}
+
+void MetricsStore::set_watermark(const char* resolution, std::int64_t value) {
+    SQLite::Statement stmt(maintenance_, "INSERT INTO metrics_rollup (resolution, watermark) VALUES (?, ?) "
+                                         "ON CONFLICT (resolution) DO UPDATE SET watermark = excluded.watermark;");
+    stmt.bind(1, std::string(resolution));
+    stmt.bind(2, static_cast<long long>(value));
+    stmt.exec();
+}
+
+/**
+ * @brief Reads a metric as buckets of `step` milliseconds over [from, to).
+ *
+ * @param metric_name The metric to read.
+ * @param from Start of the range, in milliseconds since the epoch.
+ * @param to End of the range, exclusive.
+ * @param step Requested bucket width; widened to keep at most max_points buckets.
+ */
+MetricSeries MetricsStore::series(const std::string& metric_name, std::int64_t from, std::int64_t to, std::int64_t step) {
+    std::int64_t const now_ms = to_ms(clock::now());
+    std::int64_t const today = floor_to(now_ms, ms_per_day) / ms_per_day;
+    std::int64_t const oldest_raw = (today - std::max(retention_.raw_days, 1) + 1) * ms_per_day;
+    std::int64_t const oldest_minute = now_ms - retention_.minute_days * ms_per_day;
+
+    MetricSeries result;
+    result.to = to;
+
+    // Nothing is kept beyond the hour rollups' retention, so wider spans and steps are cut to it.
+    // This also keeps every sum and product below within range for any input.
+    std::int64_t const max_span = std::max(retention_.hour_days, 1) * ms_per_day;
+    if (to > from && static_cast<std::uint64_t>(to) - static_cast<std::uint64_t>(from) > static_cast<std::uint64_t>(max_span)) {
+        from = to - max_span;
+    }
+    std::int64_t const span = to > from ? to - from : 0;
+    step = std::min(std::max({step, std::int64_t{1000}, (span + max_points - 1) / max_points}), max_span);
+
+    // The coarsest table needed; steps are whole multiples of its buckets so none straddles two points.
+    std::int64_t resolution = 0;
+    if (step < ms_per_minute && from >= oldest_raw) {
+        result.resolution = "raw";
+    } else if (step < ms_per_hour && from >= oldest_minute) {
+        result.resolution = "1m";
+        resolution = ms_per_minute;
+    } else {
+        result.resolution = "1h";
+        resolution = ms_per_hour;
+    }
+    if (resolution > 0) {
+        step = (step + resolution - 1) / resolution * resolution;
+    }
+    from = floor_to(from, step);
+    result.from = from;
+    result.step = step;
+    if (from >= to) {
+        return result;
+    }
+
+    std::vector<BucketAccumulator> buckets(static_cast<std::size_t>((to - from + step - 1) / step));
+    auto bucket_of = [&](std::int64_t t) -> BucketAccumulator* {
+        if (t < from || t >= to) {
+            return nullptr;
+        }
+        auto const i = static_cast<std::size_t>((t - from) / step);
+        return i < buckets.size() ? &buckets[i] : nullptr;
+    };
+
+    std::int64_t minute_watermark = from;
+    std::int64_t hour_watermark = from;
+    auto& watermarks = reader_statements_.get("SELECT resolution, watermark FROM metrics_rollup;");
+    while (watermarks.executeStep()) {
+        std::string const name = watermarks.getColumn(0).getString();
+        std::int64_t const value = watermarks.getColumn(1).getInt64();
+        (name == "1m" ? minute_watermark : hour_watermark) = value;
+    }
+
+    // Coarse rows up to each table's watermark, then the finer table for the rest
+    std::int64_t cursor = from;
+    auto read_rollup = [&](const char* table, std::int64_t until) {
+        until = std::min(until, to);
+        if (cursor >= until) {
+            return;
+        }
+        auto& query = reader_statements_.get(std::string("SELECT bucket, count, sum, min, max, p99 FROM ") + table
+                                             + " WHERE metric_name = ? AND bucket >= ? AND bucket < ?;");
+        query.bind(1, metric_name);
+        query.bind(2, static_cast<long long>(cursor));
+        query.bind(3, static_cast<long long>(until));
+        while (query.executeStep()) {
+            if (auto* bucket = bucket_of(query.getColumn(0).getInt64())) {
+                bucket->add_rollup(
+                    query.getColumn(1).getInt64(), query.getColumn(2).getDouble(), query.getColumn(3).getDouble(),
+                    query.getColumn(4).getDouble(), query.getColumn(5).getDouble());
+            }
+        }
+        cursor = until;
+    };
+    if (resolution == ms_per_hour) {
+        read_rollup("metrics_1h", hour_watermark);
+    }
+    if (resolution >= ms_per_minute) {
+        read_rollup("metrics_1m", minute_watermark);
+    }
+
+    for (std::int64_t const day : partition_days(reader_statements_.get(partitions_sql))) {
+        std::int64_t const day_from = std::max(cursor, day * ms_per_day);
+        std::int64_t const day_to = std::min(to, (day + 1) * ms_per_day);
+        if (day_from >= day_to) {
+            continue;
+        }
+        auto& query = reader_statements_.get("SELECT ts, metric_value FROM " + partition_name(day)
+                                             + " WHERE ts >= ? AND ts < ? AND metric_name = ?;");
+        query.bind(1, static_cast<long long>(day_from));
+        query.bind(2, static_cast<long long>(day_to));
+        query.bind(3, metric_name);
+        while (query.executeStep()) {
+            if (auto* bucket = bucket_of(query.getColumn(0).getInt64())) {
+                bucket->add_sample(query.getColumn(1).getDouble());
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i < buckets.size(); ++i) {
+        auto& bucket = buckets[i];
+        if (bucket.count == 0) {
+            continue;
+        }
+        MetricPoint point;
+        point.time = from + static_cast<std::int64_t>(i) * step;
+        point.count = bucket.count;
+        point.average_value = bucket.sum / static_cast<double>(bucket.count);
+        point.p99_value = bucket.merged_p99();
+        point.min_value = bucket.min;
+        point.max_value = bucket.max;
+        result.points.push_back(point);
+    }
+    return result;
+}
+
+/**
+ * @brief Folds completed minutes and hours into the rollups and applies retention.
+ *
+ * A minute is rolled up once it ended a few seconds ago and no sample taken in
+ * it is still waiting to be written: samples are written in batches, and a
+ * batch that runs late must not land behind the watermark, where it would
+ * never be counted. Rollups merge into existing rows, so a bucket that
+ * straddles two passes still ends up whole.
+ *
+ * @param now The current time.
+ * @param unwritten When the oldest sample not written yet was taken, or time_point::max().
+ */
+void MetricsStore::roll_up(clock::time_point now, clock::time_point unwritten) {
+    auto logger = LoggerManager::getLogger("metrics_logger", LogLevel::INFO, LogOutput::CONSOLE);
+    std::lock_guard<std::mutex> lock(rollup_mutex_);
+
+    constexpr std::int64_t settle_ms = 5000;
+    std::int64_t const now_ms = to_ms(now);
+    std::int64_t const today = floor_to(now_ms, ms_per_day) / ms_per_day;
+
+    try {
+        SQLite::Transaction transaction(maintenance_);
+        SQLite::Statement partitions(maintenance_, partitions_sql);
+        std::vector<std::int64_t> const days = partition_days(partitions);
+
+        // Raw samples into minutes, partition by partition
+        std::int64_t const minute_end = floor_to(std::min(now_ms - settle_ms, to_ms(unwritten)), ms_per_minute);
+        std::int64_t const minute_start = watermark("1m", days.empty() ? minute_end : days.front() * ms_per_day);
+        for (std::int64_t const day : days) {
+            std::int64_t const from = std::max(minute_start, day * ms_per_day);
+            std::int64_t const to = std::min(minute_end, (day + 1) * ms_per_day);
+            if (from < to) {
+                fold_minutes(day, from, to);
+            }
+        }
+        std::int64_t const minutes_done = std::max(minute_start, minute_end);
+        set_watermark("1m", minutes_done);
+
+        // Completed hours of minutes into hours
+        std::int64_t const hour_end = floor_to(minutes_done, ms_per_hour);
+        std::int64_t const hour_start = watermark("1h", floor_to(minute_start, ms_per_hour));
+        if (hour_start < hour_end) {
+            SQLite::Statement stmt(maintenance_,
+                "INSERT INTO metrics_1h (metric_name, bucket, count, sum, min, max, p99) "
+                "SELECT metric_name, (bucket / 3600000) * 3600000, SUM(count), SUM(sum), MIN(min), MAX(max), MAX(p99) "
+                "FROM metrics_1m WHERE bucket >= ? AND bucket < ? GROUP BY 1, 2 "
+                "ON CONFLICT (metric_name, bucket) DO UPDATE SET "
+                "count = count + excluded.count, sum = sum + excluded.sum, "
+                "min = MIN(min, excluded.min), max = MAX(max, excluded.max), p99 = MAX(p99, excluded.p99);");
+            stmt.bind(1, static_cast<long long>(hour_start));
+            stmt.bind(2, static_cast<long long>(hour_end));
+            stmt.exec();
+        }
+        set_watermark("1h", std::max(hour_start, hour_end));
+
+        // Retention: whole raw partitions, once they are rolled up, and old rollup rows
+        std::int64_t const oldest_raw_day = today - std::max(retention_.raw_days, 1) + 1;
+        std::vector<std::string> dropped;
+        for (std::int64_t const day : days) {
+            if (day < oldest_raw_day && (day + 1) * ms_per_day <= minutes_done) {
+                dropped.push_back(partition_name(day));
+                maintenance_.exec("DROP TABLE IF EXISTS " + dropped.back() + ";");
+            }
+        }
+        maintenance_.exec("DELETE FROM metrics_1m WHERE bucket < "
+                          + std::to_string(now_ms - retention_.minute_days * ms_per_day) + ";");
+        maintenance_.exec("DELETE FROM metrics_1h WHERE bucket < "
+                          + std::to_string(now_ms - retention_.hour_days * ms_per_day) + ";");
+
+        transaction.commit();
+        for (const auto& table : dropped) {
+            // Statement SQL names its partition, so each day adds statements to the caches until then
+            writer_statements_.retire(table);
+            reader_statements_.retire(table);
+            logger->log(LogLevel::INFO, "Dropped expired metrics partition " + table + ".");
+        }
+    } catch (const std::exception& e) {
+        // Nothing was committed, so the next pass redoes the same range.
+        logger->log(LogLevel::ERROR, "Metrics rollup failed: " + std::string(e.what()));
+    }
+}
@@ -0,0 +1,112 @@
+#include "../include/query_id.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <random>
+
+namespace {
+
+constexpr char alphabet[] = "0123456789ABCDEFGHJKMNPQRSTVWXYZ";
+
+constexpr std::size_t time_chars = 9;
+constexpr std::size_t generator_chars = 2;
+constexpr std::size_t sequence_chars = 4;
+constexpr std::uint32_t generator_count = 1u << (5 * generator_chars);
+constexpr std::uint32_t sequence_mask = (1u << (5 * sequence_chars)) - 1;
+
+/**
+ * @brief Writes the low 5 * `chars` bits of `value` as base32, most significant first.
+ */
+void encode(char* out, std::uint64_t value, std::size_t chars)
+{
+    for (std::size_t i = chars; i-- > 0;) {
+        out[i] = alphabet[value & 31];
+        value >>= 5;
+    }
+}
+
+/**
+ * @brief Returns the value of a base32 character, or -1.
+ */
+int decode(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'Z') {
+        // Crockford's alphabet leaves out I, L, O and U
+        static constexpr signed char letters[26] = {
+            10, 11, 12, 13, 14, 15, 16, 17, -1, 18, 19, -1, 20,
+            21, -1, 22, 23, 24, 25, 26, -1, 27, 28, 29, 30, 31};
+        return letters[c - 'A'];
+    }
+    return -1;
+}
+
+struct generator_state {
+    std::uint32_t generator;
+    std::uint32_t sequence;
+};
+
+generator_state& this_thread_state()
+{
+    static std::atomic<std::uint32_t> next_generator{0};
+    thread_local generator_state state{
+        next_generator.fetch_add(1, std::memory_order_relaxed) % generator_count,
+        std::random_device{}() & sequence_mask};
+    return state;
+}
+
+/**
+ * @brief Returns the sequence number of an ID, or -1 if it is not in this format.
+ */
+long sequence_of(std::string_view id)
+{
+    if (id.size() != QueryId::length) {
+        return -1;
+    }
+    long value = 0;
+    for (std::size_t i = 0; i < QueryId::length; ++i) {
+        int const digit = decode(id[i]);
+        if (digit < 0) {
+            return -1;
+        }
+        if (i >= time_chars + generator_chars) {
+            value = value << 5 | digit;
+        }
+    }
+    return value;
+}
+
+} // namespace
+
+/**
+ * @brief Returns a new ID.
+ */
+std::string QueryId::next()
+{
+    generator_state& state = this_thread_state();
+    state.sequence = (state.sequence + 1) & sequence_mask;
+
+    auto const now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    std::string id(length, '0');
+    encode(&id[0], static_cast<std::uint64_t>(now), time_chars);
+    encode(&id[time_chars], state.generator, generator_chars);
+    encode(&id[time_chars + generator_chars], state.sequence, sequence_chars);
+    return id;
+}
+
+/**
+ * @brief Maps an ID to one of `shard_count` partitions.
+ */
+std::size_t QueryId::shard(std::string_view id, std::size_t shard_count)
+{
+    // The sequence, not the generator: the HTTP handlers run on a few I/O
+    // threads, and keying by thread would leave most partitions empty.
+    long const sequence = sequence_of(id);
+    if (sequence >= 0) {
+        return static_cast<std::size_t>(sequence) % shard_count;
+    }
+    return std::hash<std::string_view>{}(id) % shard_count;
+}
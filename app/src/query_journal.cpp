@@ -0,0 +1,315 @@
+#include "../include/query_journal.hpp"
+#include "../../log/include/log.hpp"
+#include "../../ollama/include/json.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+/// Records larger than this are treated as corruption rather than allocated.
+constexpr std::uint32_t max_record_size = 64 * 1024 * 1024;
+
+/**
+ * @brief CRC-32 (IEEE) of a buffer, to tell a torn or corrupt record from a good one.
+ */
+std::uint32_t crc32(const char* data, std::size_t size)
+{
+    static const auto table = [] {
+        std::array<std::uint32_t, 256> t{};
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    std::uint32_t crc = 0xFFFFFFFFu;
+    for (std::size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+void put_u32(std::string& out, std::uint32_t v)
+{
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+    }
+}
+
+std::uint32_t get_u32(const char* p)
+{
+    std::uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) {
+        v |= static_cast<std::uint32_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    }
+    return v;
+}
+
+/**
+ * @brief Frames a payload as a record: little-endian length, CRC-32, payload.
+ */
+void encode_record(std::string& out, const std::string& payload)
+{
+    put_u32(out, static_cast<std::uint32_t>(payload.size()));
+    put_u32(out, crc32(payload.data(), payload.size()));
+    out.append(payload);
+}
+
+std::string submitted_payload(const std::string& id, const std::string& prompt, const std::string& context)
+{
+    nlohmann::json j;
+    j["t"] = "s";
+    j["id"] = id;
+    j["prompt"] = prompt;
+    j["context"] = context;
+    return j.dump();
+}
+
+std::string completed_payload(const std::string& id, bool canceled, const std::vector<std::string>& partial_responses)
+{
+    nlohmann::json j;
+    j["t"] = "c";
+    j["id"] = id;
+    j["canceled"] = canceled;
+    j["responses"] = partial_responses;
+    return j.dump();
+}
+
+} // namespace
+
+/**
+ * @brief Remembers the journal file; recover() opens it and starts the writer thread.
+ *
+ * @param path The journal file.
+ */
+QueryJournal::QueryJournal(std::string path)
+    : path_(std::move(path))
+{
+}
+
+/**
+ * @brief Writes and syncs everything pending, then stops the writer thread.
+ */
+QueryJournal::~QueryJournal()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_one();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+/**
+ * @brief Replays the journal and compacts it to the queries returned.
+ *
+ * @param max_completed The most recent completed queries to keep; older ones are dropped.
+ * @return The recovered queries in submission order.
+ */
+std::vector<QueryJournal::Entry> QueryJournal::recover(std::size_t max_completed)
+{
+    auto logger = LoggerManager::getLogger("query_journal_logger", LogLevel::INFO, LogOutput::CONSOLE);
+
+    std::ifstream in(path_, std::ios::binary);
+    std::string const data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+
+    std::vector<Entry> entries;
+    std::vector<std::size_t> completion_order;  // Indices into entries, in order of completion
+    std::unordered_map<std::string, std::size_t> index;
+    std::size_t pos = 0;
+    std::size_t records = 0;
+    while (data.size() - pos >= 8) {
+        std::uint32_t const size = get_u32(data.data() + pos);
+        std::uint32_t const crc = get_u32(data.data() + pos + 4);
+        if (size > max_record_size || data.size() - pos - 8 < size
+                || crc32(data.data() + pos + 8, size) != crc) {
+            break;  // Torn write at the crash point, or corruption: nothing after it is trusted
+        }
+
+        try {
+            auto const j = nlohmann::json::parse(data.begin() + pos + 8, data.begin() + pos + 8 + size);
+            auto const id = j.at("id").get<std::string>();
+            if (j.at("t") == "s") {
+                if (index.emplace(id, entries.size()).second) {
+                    Entry entry;
+                    entry.id = id;
+                    entry.prompt = j.at("prompt").get<std::string>();
+                    entry.context = j.at("context").get<std::string>();
+                    entries.push_back(std::move(entry));
+                }
+            } else if (auto it = index.find(id); it != index.end() && !entries[it->second].completed) {
+                auto& entry = entries[it->second];
+                entry.completed = true;
+                entry.canceled = j.at("canceled").get<bool>();
+                entry.partial_responses = j.at("responses").get<std::vector<std::string>>();
+                completion_order.push_back(it->second);
+            }
+        } catch (const nlohmann::json::exception& e) {
+            logger->log(LogLevel::WARN, "Skipping unreadable journal record: " + std::string(e.what()));
+        }
+
+        pos += 8 + size;
+        ++records;
+    }
+    if (pos < data.size()) {
+        logger->log(LogLevel::WARN, "Dropped " + std::to_string(data.size() - pos) + " bytes of incomplete journal records.");
+    }
+
+    // Keep only the most recent completed queries
+    std::vector<bool> dropped(entries.size(), false);
+    if (completion_order.size() > max_completed) {
+        for (std::size_t i = 0; i < completion_order.size() - max_completed; ++i) {
+            dropped[completion_order[i]] = true;
+        }
+    }
+    std::vector<Entry> survivors;
+    survivors.reserve(entries.size());
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        if (!dropped[i]) {
+            survivors.push_back(std::move(entries[i]));
+        }
+    }
+
+    // Compact: write the survivors to a new file and swap it in atomically
+    std::string compacted;
+    for (const auto& entry : survivors) {
+        encode_record(compacted, submitted_payload(entry.id, entry.prompt, entry.context));
+        if (entry.completed) {
+            encode_record(compacted, completed_payload(entry.id, entry.canceled, entry.partial_responses));
+        }
+    }
+    std::string const tmp_path = path_ + ".tmp";
+    int tmp = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool const compacted_ok = tmp >= 0 && write_all(tmp, compacted) && ::fdatasync(tmp) == 0
+        && ::close(std::exchange(tmp, -1)) == 0
+        && std::rename(tmp_path.c_str(), path_.c_str()) == 0;
+    if (compacted_ok) {
+        logger->log(LogLevel::INFO, "Recovered " + std::to_string(survivors.size()) + " queries from "
+            + std::to_string(records) + " journal records.");
+    } else {
+        // Appending to the old file still works; it is just not compacted.
+        logger->log(LogLevel::ERROR, "Could not compact query journal: " + std::string(std::strerror(errno)));
+        if (tmp >= 0) {
+            ::close(tmp);
+        }
+        std::remove(tmp_path.c_str());
+    }
+
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        logger->log(LogLevel::ERROR, "Cannot open query journal " + path_ + ": " + std::strerror(errno));
+    } else if (!compacted_ok && pos < data.size() && ::ftruncate(fd_, static_cast<off_t>(pos)) != 0) {
+        // New records must not land behind the torn tail, where replay would never reach them.
+        logger->log(LogLevel::ERROR, "Cannot truncate query journal: " + std::string(std::strerror(errno)));
+    }
+    writer_ = std::thread(&QueryJournal::run, this);
+    return survivors;
+}
+
+/**
+ * @brief Records a submitted query.
+ *
+ * @param id The query ID.
+ * @param prompt The prompt.
+ * @param context JSON of the context, or empty.
+ */
+void QueryJournal::submitted(const std::string& id, const std::string& prompt, const std::string& context)
+{
+    append(submitted_payload(id, prompt, context));
+}
+
+/**
+ * @brief Records a finished query with its responses.
+ *
+ * @param id The query ID.
+ * @param canceled Whether the query was canceled.
+ * @param partial_responses The responses received.
+ */
+void QueryJournal::completed(const std::string& id, bool canceled, const std::vector<std::string>& partial_responses)
+{
+    append(completed_payload(id, canceled, partial_responses));
+}
+
+/**
+ * @brief Appends an encoded record to the pending buffer and wakes the writer.
+ */
+void QueryJournal::append(const std::string& payload)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        encode_record(pending_, payload);
+    }
+    cv_.notify_one();
+}
+
+/**
+ * @brief Writer thread: writes and syncs the pending buffer until stopped.
+ *
+ * Whatever accumulates while one batch is being synced goes out as the next
+ * batch, so the number of syncs follows the disk, not the request rate.
+ */
+void QueryJournal::run()
+{
+    auto logger = LoggerManager::getLogger("query_journal_logger", LogLevel::INFO, LogOutput::CONSOLE);
+    std::string batch;
+    bool failed = false;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+        if (pending_.empty()) {
+            return;  // Stopping with nothing left to write
+        }
+
+        batch.clear();
+        batch.swap(pending_);
+        lock.unlock();
+
+        bool const ok = fd_ >= 0 && write_all(fd_, batch) && ::fdatasync(fd_) == 0;
+        if (!ok && !failed) {
+            // Logged once; the server keeps serving without durability rather than failing requests.
+            logger->log(LogLevel::ERROR, "Query journal write failed: " + std::string(std::strerror(errno)));
+        }
+        failed = !ok;
+
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Writes a whole buffer to the journal file; returns false on error.
+ */
+bool QueryJournal::write_all(int fd, const std::string& data)
+{
+    std::size_t written = 0;
+    while (written < data.size()) {
+        auto const n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += static_cast<std::size_t>(n);
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+#include "../include/query_registry.hpp"
+#include "../include/application.hpp"
+#include "../include/query_id.hpp"
+
+#include <mutex>
+
+/**
+ * @brief Adds a query under its ID, unless the ID is already taken.
+ */
+bool QueryRegistry::insert(const std::shared_ptr<Query>& query)
+{
+    shard& s = shard_of(query->id);
+    std::unique_lock<std::shared_mutex> lock(s.mutex);
+    return s.queries.emplace(query->id, query).second;
+}
+
+/**
+ * @brief Adds a query, replacing any query with the same ID.
+ */
+void QueryRegistry::insert_or_assign(const std::shared_ptr<Query>& query)
+{
+    shard& s = shard_of(query->id);
+    std::unique_lock<std::shared_mutex> lock(s.mutex);
+    s.queries.insert_or_assign(query->id, query);
+}
+
+/**
+ * @brief Returns the query with the given ID, or null.
+ */
+std::shared_ptr<Query> QueryRegistry::find(const std::string& query_id) const
+{
+    const shard& s = shard_of(query_id);
+    std::shared_lock<std::shared_mutex> lock(s.mutex);
+    auto it = s.queries.find(query_id);
+    return it == s.queries.end() ? nullptr : it->second;
+}
+
+QueryRegistry::shard& QueryRegistry::shard_of(const std::string& query_id)
+{
+    return shards_[QueryId::shard(query_id, shard_count)];
+}
+
+const QueryRegistry::shard& QueryRegistry::shard_of(const std::string& query_id) const
+{
+    return shards_[QueryId::shard(query_id, shard_count)];
+}
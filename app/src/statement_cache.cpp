@@ -0,0 +1,68 @@
+#include "../include/statement_cache.hpp"
+
+#include <algorithm>
+
+/**
+ * @brief Returns the calling thread's statement for `sql`, reset and with its bindings cleared.
+ *
+ * @param sql The SQL text; also the cache key.
+ * @return The prepared statement, valid until the cache is destroyed.
+ */
+SQLite::Statement& StatementCache::get(const std::string& sql)
+{
+    thread_state* state = nullptr;
+    std::vector<std::string> retired;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto [it, created] = threads_.try_emplace(std::this_thread::get_id());
+        state = &it->second;
+        if (created) {
+            state->retired_seen = retired_count_;  // Nothing of its own to remove yet
+        } else if (state->retired_seen != retired_count_) {
+            for (const auto& [seq, name] : retired_) {
+                if (seq > state->retired_seen) {
+                    retired.push_back(name);
+                }
+            }
+            state->retired_seen = retired_count_;
+
+            // Forget names every thread has applied
+            std::uint64_t oldest_seen = retired_count_;
+            for (const auto& entry : threads_) {
+                oldest_seen = std::min(oldest_seen, entry.second.retired_seen);
+            }
+            retired_.erase(
+                std::remove_if(retired_.begin(), retired_.end(),
+                               [oldest_seen](const auto& entry) { return entry.first <= oldest_seen; }),
+                retired_.end());
+        }
+    }
+
+    // Only this thread touches its own map, so no lock is needed from here on.
+    thread_statements& statements = state->statements;
+    for (const auto& name : retired) {
+        for (auto it = statements.begin(); it != statements.end();) {
+            it = it->first.find(name) != std::string::npos ? statements.erase(it) : std::next(it);
+        }
+    }
+
+    auto& stmt = statements[sql];
+    if (!stmt) {
+        stmt = std::make_unique<SQLite::Statement>(db_, sql);
+    } else {
+        stmt->reset();
+        stmt->clearBindings();
+    }
+    return *stmt;
+}
+
+/**
+ * @brief Removes every thread's statements whose SQL mentions `name`.
+ *
+ * @param name A table name, such as that of a dropped table.
+ */
+void StatementCache::retire(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    retired_.emplace_back(++retired_count_, name);
+}
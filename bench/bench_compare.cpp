@@ -0,0 +1,147 @@
+#include "include/bench_compare.hpp"
+#include "include/options.hpp"
+#include "include/report.hpp"
+#include "../log/include/log.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+const char* const usage =
+    "Usage: bench_compare save  --suite=NAME --input=REPORT [--dir=bench/baselines]\n"
+    "       bench_compare check --suite=NAME --input=REPORT [--dir=bench/baselines]\n"
+    "                           [--threshold=0.10] [--alpha=0.05] [--min-samples=3]\n"
+    "                           [--metrics=real_time,latency_p99_us,...] [--out=comparison.json]\n";
+
+nlohmann::json read_json(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        throw std::runtime_error("Could not open " + path);
+    }
+    return nlohmann::json::parse(in);
+}
+
+std::vector<std::string> split(const std::string& list)
+{
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+} // namespace
+
+/**
+ * @brief Stores benchmark results as a baseline, or checks new results against one.
+ *
+ * `save` writes `<dir>/<suite>.json`, bumping its version. `check` prints a
+ * per-metric comparison and exits with status 1 if any gated metric regressed
+ * by more than the threshold with statistical significance.
+ */
+int main(int argc, char* argv[])
+{
+    auto logger = LoggerManager::getLogger("BenchCompareMain", LogLevel::INFO, LogOutput::CONSOLE);
+
+    if (argc < 2 || std::string(argv[1]) == "--help") {
+        std::cout << usage;
+        return argc < 2 ? 2 : EXIT_SUCCESS;
+    }
+
+    try {
+        std::string const command = argv[1];
+        Options opts(argc - 1, argv + 1);
+        auto const suite = opts.get("suite", "");
+        auto const input = opts.get("input", "");
+        if (suite.empty() || input.empty()) {
+            std::cerr << usage;
+            return 2;
+        }
+
+        std::filesystem::path const dir = opts.get("dir", "bench/baselines");
+        auto const baseline_path = dir / (suite + ".json");
+        auto const results = normalize_report(read_json(input));
+
+        if (command == "save") {
+            nlohmann::json previous;
+            if (std::filesystem::exists(baseline_path)) {
+                previous = read_json(baseline_path.string());
+            }
+            std::filesystem::create_directories(dir);
+            auto const baseline = make_baseline(suite, results, previous);
+            write_report(baseline, baseline_path.string());
+            logger->log(LogLevel::INFO, "Saved baseline " + baseline_path.string() + " (version " +
+                std::to_string(baseline["version"].get<int>()) + ", " + std::to_string(results.size()) + " benchmarks)");
+            return EXIT_SUCCESS;
+        }
+
+        if (command != "check") {
+            std::cerr << usage;
+            return 2;
+        }
+
+        if (!std::filesystem::exists(baseline_path)) {
+            logger->log(LogLevel::ERROR, "No baseline at " + baseline_path.string() + "; run `bench_compare save` first.");
+            return 2;
+        }
+        auto const baseline = read_json(baseline_path.string());
+
+        CompareOptions options;
+        options.threshold = opts.get_double("threshold", options.threshold);
+        options.alpha = opts.get_double("alpha", options.alpha);
+        options.min_samples = static_cast<std::size_t>(opts.get_int("min-samples", static_cast<long long>(options.min_samples)));
+        options.metrics = split(opts.get("metrics", ""));
+
+        auto const comparisons = compare_results(baseline["benchmarks"], results, options);
+
+        std::size_t regressions = 0;
+        nlohmann::json out = nlohmann::json::array();
+        std::printf("%-44s %-18s %14s %14s %9s %8s  %s\n", "benchmark", "metric", "baseline", "current", "change", "p", "verdict");
+        for (const auto& c : comparisons) {
+            const char* verdict = c.regression ? "REGRESSION" : (c.improvement ? "improved" : "ok");
+            if (c.regression) ++regressions;
+            std::printf("%-44s %-18s %14.2f %14.2f %+8.1f%% %8s  %s\n",
+                c.benchmark.c_str(), c.metric.c_str(), c.baseline, c.current, c.change * 100.0,
+                c.tested ? std::to_string(c.p_value).substr(0, 6).c_str() : "-", verdict);
+
+            out.push_back({
+                {"benchmark", c.benchmark}, {"metric", c.metric}, {"unit", c.unit},
+                {"baseline", c.baseline}, {"current", c.current}, {"change", c.change},
+                {"p_value", c.p_value}, {"tested", c.tested}, {"verdict", verdict},
+            });
+        }
+
+        if (opts.has("out")) {
+            write_report(nlohmann::json{
+                {"suite", suite},
+                {"baseline_version", baseline.value("version", 0)},
+                {"baseline_revision", baseline.value("revision", std::string())},
+                {"threshold", options.threshold},
+                {"alpha", options.alpha},
+                {"comparisons", out},
+            }, opts.get("out", ""));
+        }
+
+        if (comparisons.empty()) {
+            logger->log(LogLevel::WARN, "No metrics in common with baseline " + baseline_path.string());
+        }
+        if (regressions > 0) {
+            logger->log(LogLevel::ERROR, std::to_string(regressions) + " regression(s) against baseline version " +
+                std::to_string(baseline.value("version", 0)));
+            return EXIT_FAILURE;
+        }
+        logger->log(LogLevel::INFO, "No regressions against baseline version " + std::to_string(baseline.value("version", 0)));
+    } catch (const std::exception& e) {
+        logger->log(LogLevel::ERROR, std::string("bench_compare: ") + e.what());
+        return 2;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+#ifndef BENCH_COMPARE_HPP
+#define BENCH_COMPARE_HPP
+
+#include "../../ollama/include/json.hpp"
+#include <string>
+#include <vector>
+
+/**
+ * @file bench_compare.hpp
+ * @brief Baseline storage and regression detection for benchmark results.
+ *
+ * Both report layouts produced in this repository are accepted: the
+ * load generator's (see report.hpp) and Google Benchmark's JSON output from
+ * bin/microbench. They are normalised to
+ *
+ * @code
+ * { "<benchmark>": { "<metric>": { "value": 1.0, "unit": "ns", "better": "lower", "samples": [ ... ] } } }
+ * @endcode
+ *
+ * and baselines are stored in that form together with a version number and
+ * the revision they were recorded at.
+ */
+
+/**
+ * @brief Outcome of comparing one metric against its baseline.
+ */
+struct MetricComparison {
+    std::string benchmark;      ///< Benchmark name.
+    std::string metric;         ///< Metric name.
+    std::string unit;           ///< Unit of the metric.
+    double baseline = 0.0;      ///< Baseline value (median of samples when available).
+    double current = 0.0;       ///< New value (median of samples when available).
+    double change = 0.0;        ///< Relative change in the "worse" direction; positive means slower/lower throughput.
+    double p_value = 1.0;       ///< Two-sided Mann-Whitney U p-value, or 1 when there are too few samples.
+    bool tested = false;        ///< True if both sides had enough samples for the significance test.
+    bool regression = false;    ///< True if the change exceeds the threshold (and is significant when tested).
+    bool improvement = false;   ///< True if the metric improved beyond the threshold (and is significant when tested).
+};
+
+/**
+ * @brief Settings for a comparison.
+ */
+struct CompareOptions {
+    double threshold = 0.10;          ///< Relative change tolerated before flagging (0.10 = 10 %).
+    double alpha = 0.05;              ///< Significance level for the Mann-Whitney U test.
+    std::size_t min_samples = 3;      ///< Samples needed on both sides to run the test.
+    std::vector<std::string> metrics; ///< Metrics to gate on; empty gates on all.
+};
+
+/**
+ * @brief Converts a load generator or Google Benchmark report to the normalised form.
+ *
+ * @param report The parsed report.
+ * @return Metrics by benchmark name.
+ * @throws std::runtime_error if the layout is not recognised.
+ */
+nlohmann::json normalize_report(const nlohmann::json& report);
+
+/**
+ * @brief Wraps normalised results into a baseline document.
+ *
+ * @param suite Name of the suite (e.g. "micro", "load").
+ * @param results Normalised results.
+ * @param previous The baseline being replaced, or null; used to bump the version.
+ * @return The baseline document.
+ */
+nlohmann::json make_baseline(const std::string& suite, const nlohmann::json& results, const nlohmann::json& previous);
+
+/**
+ * @brief Two-sided Mann-Whitney U test with tie correction (normal approximation).
+ *
+ * @return The p-value, or 1 if either sample is empty.
+ */
+double mann_whitney_p(const std::vector<double>& a, const std::vector<double>& b);
+
+/**
+ * @brief Compares normalised results with a baseline.
+ *
+ * @param baseline The `benchmarks` object of a baseline document.
+ * @param current Normalised results of the new run.
+ * @param options Thresholds and metric selection.
+ * @return One entry per metric present in both.
+ */
+std::vector<MetricComparison> compare_results(const nlohmann::json& baseline, const nlohmann::json& current, const CompareOptions& options);
+
+#endif // BENCH_COMPARE_HPP
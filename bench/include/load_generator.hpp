@@ -0,0 +1,205 @@
+#ifndef LOAD_GENERATOR_HPP
+#define LOAD_GENERATOR_HPP
+
+#include "../../ollama/include/json.hpp"
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * @file load_generator.hpp
+ * @brief Open-loop HTTPS load generator driving the real server.
+ *
+ * Requests are scheduled at fixed (or Poisson) arrival times independent of how
+ * fast the server answers, and latency is measured from the scheduled time, not
+ * from when a connection became free. A slow server therefore shows up as queueing
+ * delay instead of silently lowering the offered load (coordinated omission).
+ */
+
+/**
+ * @brief The request types the generator can issue.
+ */
+enum class LoadEndpoint {
+    static_get,    ///< GET of a static file from the document root.
+    json_data,     ///< GET /json_data.
+    post_query,    ///< POST / submitting a prompt.
+    query_status,  ///< GET /query_status/{id} polling a previously submitted query.
+};
+
+/// Number of LoadEndpoint values.
+constexpr std::size_t load_endpoint_count = 4;
+
+/**
+ * @brief Returns the report name of an endpoint.
+ */
+const char* load_endpoint_name(LoadEndpoint endpoint);
+
+/**
+ * @brief Configuration of a load test run.
+ */
+struct LoadConfig {
+    std::string host = "127.0.0.1";                  ///< Server address.
+    std::string port = "8080";                       ///< Server port.
+    double duration_s = 10.0;                        ///< Measured duration.
+    double warmup_s = 2.0;                           ///< Leading period excluded from the results.
+    double drain_s = 5.0;                            ///< Time allowed for in-flight requests after the run.
+    double rate = 200.0;                             ///< Offered load in requests per second; 0 runs closed-loop.
+    bool poisson = false;                            ///< Exponential inter-arrival times instead of a fixed interval.
+    std::size_t connections = 16;                    ///< Maximum concurrent connections.
+    double keep_alive_ratio = 1.0;                   ///< Probability that a connection is reused for the next request.
+    std::array<double, load_endpoint_count> weights{{4.0, 1.0, 1.0, 4.0}};  ///< Request mix, indexed by LoadEndpoint.
+    std::vector<std::string> static_paths{"/", "/script.js", "/styles.css"};  ///< Targets for static GETs.
+    double timeout_s = 10.0;                         ///< Per-request timeout.
+    std::size_t max_pending = 100000;                ///< Scheduled requests allowed to wait for a connection.
+    bool tcp_nodelay = true;                         ///< Disable Nagle on client sockets.
+    std::uint64_t seed = 1;                          ///< Seed for the request mix and arrival times.
+    std::string metrics_target;                      ///< If set, fetched once after the run and embedded in the report.
+
+    /**
+     * @brief Returns the configuration as JSON for the report.
+     */
+    nlohmann::json to_json() const;
+};
+
+/**
+ * @brief Drives the server with the configured mix and collects latency statistics.
+ *
+ * The generator is single-threaded: all connections share one io_context, so
+ * no synchronisation is needed for the statistics.
+ */
+class LoadGenerator {
+public:
+    /**
+     * @brief Constructs a generator for the given configuration.
+     */
+    explicit LoadGenerator(LoadConfig config);
+
+    ~LoadGenerator();
+
+    /**
+     * @brief Runs the load test to completion.
+     *
+     * @return The report (see report.hpp) with one benchmark per endpoint and an "all" summary.
+     * @throws std::runtime_error if the server address cannot be resolved.
+     */
+    nlohmann::json run();
+
+private:
+    class Connection;
+    friend class Connection;
+
+    using clock = std::chrono::steady_clock;
+
+    /**
+     * @brief A request waiting for, or being served by, a connection.
+     */
+    struct Pending {
+        LoadEndpoint endpoint;
+        clock::time_point intended;  ///< When the request was scheduled to be sent.
+    };
+
+    /**
+     * @brief Latency observations for one endpoint.
+     */
+    struct Samples {
+        std::vector<double> latency_us;               ///< Scheduled time to response, per request.
+        std::vector<double> service_us;               ///< Send to response, per request.
+        std::vector<std::vector<double>> windows;     ///< Latencies bucketed by one-second completion window.
+        std::uint64_t errors = 0;                     ///< Transport errors and timeouts.
+        std::uint64_t non_2xx = 0;                    ///< Responses with a status outside 200-299.
+        std::uint64_t bytes = 0;                      ///< Response body bytes received.
+    };
+
+    LoadConfig config_;
+    boost::asio::io_context ioc_;
+    boost::asio::ssl::context ssl_ctx_;
+    boost::asio::ip::tcp::resolver::results_type endpoints_;
+    boost::asio::steady_timer arrival_timer_;
+    boost::asio::steady_timer drain_timer_;
+    std::mt19937_64 rng_;
+    std::discrete_distribution<int> mix_;
+
+    std::vector<std::shared_ptr<Connection>> connections_;
+    std::vector<std::shared_ptr<Connection>> idle_;
+    std::deque<Pending> pending_;
+    std::vector<std::string> query_ids_;  ///< Recently submitted query ids used for status polling.
+    std::size_t next_query_id_ = 0;
+
+    clock::time_point start_;
+    clock::time_point measure_start_;
+    clock::time_point end_;
+    clock::time_point next_arrival_;
+    std::uint64_t scheduled_ = 0;
+    std::uint64_t dropped_ = 0;
+    std::uint64_t connects_ = 0;
+    std::size_t busy_ = 0;
+    bool finished_ = false;
+
+    std::array<Samples, load_endpoint_count> samples_;
+
+    /**
+     * @brief Returns the next scheduled arrival time after `t`.
+     */
+    clock::time_point next_arrival_after(clock::time_point t);
+
+    /**
+     * @brief Arms the arrival timer for the next scheduled request.
+     */
+    void schedule_next();
+
+    /**
+     * @brief Enqueues every request whose scheduled time has passed.
+     */
+    void on_arrival(boost::system::error_code ec);
+
+    /**
+     * @brief Picks the endpoint for the next request according to the mix.
+     */
+    LoadEndpoint pick_endpoint();
+
+    /**
+     * @brief Hands pending requests to idle connections.
+     */
+    void dispatch();
+
+    /**
+     * @brief Builds the HTTP request for an endpoint.
+     */
+    std::string target_for(LoadEndpoint endpoint);
+
+    /**
+     * @brief Records a completed request and returns its connection to the idle pool.
+     */
+    void on_complete(const std::shared_ptr<Connection>& conn, const Pending& request,
+                     clock::time_point sent, bool ok, unsigned status, const std::string& body);
+
+    /**
+     * @brief Called once the measured period is over; waits for in-flight requests then stops.
+     */
+    void begin_drain();
+
+    /**
+     * @brief Stops the io_context once nothing is in flight.
+     */
+    void maybe_finish();
+
+    /**
+     * @brief Fetches `metrics_target` synchronously after the run.
+     */
+    nlohmann::json fetch_metrics();
+
+    /**
+     * @brief Builds the report from the collected samples.
+     */
+    nlohmann::json make_load_report(double measured_s);
+};
+
+#endif // LOAD_GENERATOR_HPP
@@ -0,0 +1,120 @@
+#ifndef MOCK_OLLAMA_HPP
+#define MOCK_OLLAMA_HPP
+
+#include "../../ollama/include/httplib.hpp"
+#include "../../ollama/include/json.hpp"
+#include "../../log/include/log.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * @file mock_ollama.hpp
+ * @brief A deterministic stand-in for the Ollama REST API used for load testing.
+ *
+ * The mock implements the subset of the API that the application and the
+ * bundled `Ollama` client use (`/api/generate`, `/api/chat`, `/api/embed`,
+ * `/api/tags` and `/api/version`) and streams NDJSON tokens with a
+ * configurable cadence, so that queueing, streaming and cancellation can be
+ * measured without a GPU or a real model.
+ */
+
+/**
+ * @brief Tunables for the mock backend.
+ *
+ * All randomness (token choice, jitter, injected failures) is derived from
+ * `seed` and the request sequence number, so two runs with the same
+ * configuration and request order produce identical streams.
+ */
+struct MockOllamaConfig {
+    std::string host = "127.0.0.1";              ///< Address to listen on.
+    int port = 11434;                             ///< Port to listen on (Ollama's default).
+    int threads = 8;                              ///< Worker threads; each streaming request occupies one.
+    std::string model = "llava:latest";           ///< Model name reported by `/api/tags`.
+    std::size_t tokens_per_response = 64;         ///< Tokens generated per request.
+    double tokens_per_second = 50.0;              ///< Token emission rate; 0 disables throttling.
+    std::chrono::milliseconds first_token_latency{100};  ///< Delay before the first token ("prompt eval").
+    std::chrono::milliseconds latency_jitter{0};  ///< Uniform jitter added to every delay.
+    std::size_t chunk_split = 0;                  ///< Split each NDJSON line into chunks of this many bytes (0 = whole lines).
+    double error_rate = 0.0;                      ///< Fraction of requests answered with HTTP 500.
+    double abort_rate = 0.0;                      ///< Fraction of streams cut off mid-response.
+    std::size_t embedding_dimensions = 384;       ///< Length of each vector returned by `/api/embed`.
+    std::size_t context_limit = 2048;             ///< Maximum length of the returned `context` array.
+    std::uint64_t seed = 42;                      ///< Seed for all generated data.
+};
+
+/**
+ * @brief Counters describing what the mock has served so far.
+ *
+ * Exposed through `GET /mock/stats` so a load test can correlate client-side
+ * numbers with what the backend actually did.
+ */
+struct MockOllamaStats {
+    std::atomic<std::uint64_t> requests{0};         ///< Requests received on any endpoint.
+    std::atomic<std::uint64_t> streams_started{0};  ///< Streaming responses started.
+    std::atomic<std::uint64_t> streams_completed{0};///< Streaming responses that sent their final line.
+    std::atomic<std::uint64_t> streams_canceled{0}; ///< Streams stopped because the client went away.
+    std::atomic<std::uint64_t> streams_aborted{0};  ///< Streams cut off by `abort_rate`.
+    std::atomic<std::uint64_t> injected_errors{0};  ///< Requests failed by `error_rate`.
+    std::atomic<std::uint64_t> tokens_sent{0};      ///< Token lines written to clients.
+};
+
+/**
+ * @brief HTTP server emulating the Ollama API.
+ */
+class MockOllama {
+public:
+    /**
+     * @brief Constructs the mock and registers all endpoints.
+     *
+     * @param config The behaviour of the mock backend.
+     */
+    explicit MockOllama(MockOllamaConfig config);
+
+    /**
+     * @brief Binds to the configured address and serves requests until stop() is called.
+     *
+     * @throws std::runtime_error if the server cannot listen on the configured address.
+     */
+    void run();
+
+    /**
+     * @brief Stops a running server. Safe to call from any thread.
+     */
+    void stop();
+
+    /**
+     * @brief Returns the counters as JSON.
+     */
+    nlohmann::json stats_json() const;
+
+private:
+    MockOllamaConfig config_;                 ///< Behaviour of the mock.
+    httplib::Server server_;                  ///< Underlying HTTP server.
+    std::shared_ptr<Logger> logger_;          ///< Logger for the mock.
+    std::atomic<std::uint64_t> sequence_{0};  ///< Request sequence number used to derive per-request seeds.
+    MockOllamaStats stats_;                   ///< Counters reported by `/mock/stats`.
+
+    /**
+     * @brief Handles `/api/generate` and `/api/chat`.
+     *
+     * @param req The incoming request.
+     * @param res The response to fill.
+     * @param chat True for `/api/chat`, false for `/api/generate`.
+     */
+    void handle_generation(const httplib::Request& req, httplib::Response& res, bool chat);
+
+    /**
+     * @brief Handles `/api/embed`.
+     */
+    void handle_embed(const httplib::Request& req, httplib::Response& res);
+
+    /**
+     * @brief Returns true if this request should fail with an injected error, and fills `res` if so.
+     */
+    bool inject_error(std::uint64_t request_seed, httplib::Response& res);
+};
+
+#endif // MOCK_OLLAMA_HPP
@@ -0,0 +1,76 @@
+#ifndef BENCH_OPTIONS_HPP
+#define BENCH_OPTIONS_HPP
+
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+/**
+ * @brief Minimal `--key=value` command line parser shared by the benchmark tools.
+ *
+ * Flags without a value (`--json`) are stored as "1". Unknown positional
+ * arguments are rejected so that typos don't silently fall back to defaults.
+ */
+class Options {
+public:
+    /**
+     * @brief Parses the command line arguments.
+     *
+     * @param argc Argument count as passed to main().
+     * @param argv Argument vector as passed to main().
+     * @throws std::invalid_argument if an argument is not of the form `--key[=value]`.
+     */
+    Options(int argc, char* argv[])
+    {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg.rfind("--", 0) != 0) {
+                throw std::invalid_argument("Unexpected argument: " + arg);
+            }
+            auto const eq = arg.find('=');
+            if (eq == std::string::npos) {
+                values_[arg.substr(2)] = "1";
+            } else {
+                values_[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+            }
+        }
+    }
+
+    /**
+     * @brief Returns true if the option was given on the command line.
+     */
+    bool has(const std::string& key) const { return values_.count(key) != 0; }
+
+    /**
+     * @brief Returns the option as a string, or the default if it was not given.
+     */
+    std::string get(const std::string& key, const std::string& def) const
+    {
+        auto it = values_.find(key);
+        return it == values_.end() ? def : it->second;
+    }
+
+    /**
+     * @brief Returns the option as a floating point number, or the default if it was not given.
+     */
+    double get_double(const std::string& key, double def) const
+    {
+        auto it = values_.find(key);
+        return it == values_.end() ? def : std::strtod(it->second.c_str(), nullptr);
+    }
+
+    /**
+     * @brief Returns the option as an integer, or the default if it was not given.
+     */
+    long long get_int(const std::string& key, long long def) const
+    {
+        auto it = values_.find(key);
+        return it == values_.end() ? def : std::strtoll(it->second.c_str(), nullptr, 10);
+    }
+
+private:
+    std::map<std::string, std::string> values_;  ///< Parsed options by name.
+};
+
+#endif // BENCH_OPTIONS_HPP
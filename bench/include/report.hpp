@@ -0,0 +1,73 @@
+#ifndef BENCH_REPORT_HPP
+#define BENCH_REPORT_HPP
+
+#include "../../ollama/include/json.hpp"
+#include <string>
+#include <vector>
+
+/**
+ * @file report.hpp
+ * @brief Helpers for the JSON reports written by the benchmark tools.
+ *
+ * Every tool writes the same layout so results can be archived and compared:
+ *
+ * @code
+ * {
+ *   "schema": 1,
+ *   "tool": "load_generator",
+ *   "created_at": "2024-01-01T00:00:00Z",
+ *   "revision": "<git revision or empty>",
+ *   "config": { ... },
+ *   "benchmarks": [
+ *     { "name": "static_get",
+ *       "metrics": { "latency_p99_us": { "value": 812.0, "unit": "us", "better": "lower", "samples": [ ... ] } } }
+ *   ]
+ * }
+ * @endcode
+ *
+ * `samples` holds the per-window (or per-repetition) observations the value was
+ * derived from, which is what regression checks use for significance testing.
+ */
+
+/// Version of the report layout; bump when the layout changes incompatibly.
+constexpr int bench_report_schema = 1;
+
+/**
+ * @brief Returns the p-th percentile (0-100) of `sorted` using nearest-rank interpolation.
+ *
+ * @param sorted Values sorted in ascending order.
+ * @param p The percentile to compute.
+ * @return The percentile, or 0 if `sorted` is empty.
+ */
+double percentile(const std::vector<double>& sorted, double p);
+
+/**
+ * @brief Builds a single metric entry.
+ *
+ * @param value The headline value.
+ * @param unit Unit of the value (e.g. "us", "req/s").
+ * @param higher_is_better Direction of improvement, used by regression checks.
+ * @param samples Observations the value was derived from (may be empty).
+ * @return The metric as JSON.
+ */
+nlohmann::json make_metric(double value, const std::string& unit, bool higher_is_better, const std::vector<double>& samples = {});
+
+/**
+ * @brief Creates the top-level report object for a tool.
+ *
+ * The revision is taken from the BENCH_REVISION environment variable when set.
+ *
+ * @param tool Name of the tool writing the report.
+ * @param config The configuration the run used.
+ * @return A report with an empty `benchmarks` array.
+ */
+nlohmann::json make_report(const std::string& tool, const nlohmann::json& config);
+
+/**
+ * @brief Writes a report to a file, or to stdout when `path` is empty or "-".
+ *
+ * @throws std::runtime_error if the file cannot be written.
+ */
+void write_report(const nlohmann::json& report, const std::string& path);
+
+#endif // BENCH_REPORT_HPP
@@ -0,0 +1,107 @@
+#include "include/load_generator.hpp"
+#include "include/options.hpp"
+#include "include/report.hpp"
+#include "../log/include/log.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+/**
+ * @brief Splits a comma separated list.
+ */
+std::vector<std::string> split(const std::string& list)
+{
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+/**
+ * @brief Parses a mix such as "static:4,json:1,post:1,poll:4" into endpoint weights.
+ */
+std::array<double, load_endpoint_count> parse_mix(const std::string& mix)
+{
+    std::array<double, load_endpoint_count> weights{};
+    for (const auto& item : split(mix)) {
+        auto const colon = item.find(':');
+        auto const name = item.substr(0, colon);
+        auto const weight = colon == std::string::npos ? 1.0 : std::strtod(item.c_str() + colon + 1, nullptr);
+        if (name == "static") weights[static_cast<std::size_t>(LoadEndpoint::static_get)] = weight;
+        else if (name == "json") weights[static_cast<std::size_t>(LoadEndpoint::json_data)] = weight;
+        else if (name == "post") weights[static_cast<std::size_t>(LoadEndpoint::post_query)] = weight;
+        else if (name == "poll") weights[static_cast<std::size_t>(LoadEndpoint::query_status)] = weight;
+        else throw std::invalid_argument("Unknown mix entry: " + name);
+    }
+    return weights;
+}
+
+} // namespace
+
+/**
+ * @brief Runs an HTTPS load test against the server and writes a JSON report.
+ *
+ * Usage: load_generator [--host=127.0.0.1] [--port=8080] [--duration=10] [--warmup=2]
+ *                       [--rate=200] [--poisson] [--connections=16] [--keep-alive=1.0]
+ *                       [--mix=static:4,json:1,post:1,poll:4] [--paths=/,/script.js,/styles.css]
+ *                       [--timeout=10] [--seed=1] [--no-nodelay] [--metrics=/performance_statistics]
+ *                       [--out=report.json]
+ *
+ * `--rate=0` runs closed-loop with one outstanding request per connection.
+ */
+int main(int argc, char* argv[])
+{
+    auto logger = LoggerManager::getLogger("LoadGeneratorMain", LogLevel::INFO, LogOutput::CONSOLE);
+
+    try {
+        Options opts(argc, argv);
+        if (opts.has("help")) {
+            std::cout << "Usage: load_generator [--host=127.0.0.1] [--port=8080] [--duration=10] [--warmup=2]\n"
+                         "                      [--rate=200] [--poisson] [--connections=16] [--keep-alive=1.0]\n"
+                         "                      [--mix=static:4,json:1,post:1,poll:4] [--paths=/,/script.js,/styles.css]\n"
+                         "                      [--timeout=10] [--seed=1] [--no-nodelay] [--metrics=/performance_statistics]\n"
+                         "                      [--out=report.json]\n";
+            return EXIT_SUCCESS;
+        }
+
+        LoadConfig config;
+        config.host = opts.get("host", config.host);
+        config.port = opts.get("port", config.port);
+        config.duration_s = opts.get_double("duration", config.duration_s);
+        config.warmup_s = opts.get_double("warmup", config.warmup_s);
+        config.drain_s = opts.get_double("drain", config.drain_s);
+        config.rate = opts.get_double("rate", config.rate);
+        config.poisson = opts.has("poisson");
+        config.connections = static_cast<std::size_t>(opts.get_int("connections", static_cast<long long>(config.connections)));
+        config.keep_alive_ratio = opts.get_double("keep-alive", config.keep_alive_ratio);
+        if (opts.has("mix")) config.weights = parse_mix(opts.get("mix", ""));
+        if (opts.has("paths")) config.static_paths = split(opts.get("paths", ""));
+        config.timeout_s = opts.get_double("timeout", config.timeout_s);
+        config.tcp_nodelay = !opts.has("no-nodelay");
+        config.seed = static_cast<std::uint64_t>(opts.get_int("seed", static_cast<long long>(config.seed)));
+        config.metrics_target = opts.get("metrics", "");
+
+        LoadGenerator generator(config);
+        auto const report = generator.run();
+        write_report(report, opts.get("out", "-"));
+
+        for (const auto& bench : report["benchmarks"]) {
+            const auto& m = bench["metrics"];
+            logger->log(LogLevel::INFO, bench["name"].get<std::string>() +
+                ": " + std::to_string(m["throughput_rps"]["value"].get<double>()) + " req/s, p50 " +
+                std::to_string(m["latency_p50_us"]["value"].get<double>()) + " us, p99 " +
+                std::to_string(m["latency_p99_us"]["value"].get<double>()) + " us, errors " +
+                std::to_string(bench["errors"].get<std::uint64_t>()));
+        }
+    } catch (const std::exception& e) {
+        logger->log(LogLevel::ERROR, std::string("load_generator: ") + e.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,389 @@
+#include "../http/include/http_tools.hpp"
+#include "../http/include/session_pool.hpp"
+#include "../http/include/rate_limiter.hpp"
+#include "../app/include/application.hpp"
+#include "../app/include/query_id.hpp"
+#include "../log/include/log.hpp"
+#include "../log/include/alloc_stats.hpp"
+#include "../ollama/include/ollama.hpp"
+#include <benchmark/benchmark.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @file microbench.cpp
+ * @brief Microbenchmarks for the per-request and per-token hot paths.
+ *
+ * Built on Google Benchmark; run `make microbench` or `bin/microbench --help`.
+ * `--benchmark_repetitions=N --benchmark_format=json` produces the samples used
+ * by the regression gate. Built with `make ALLOC_STATS=1`, each benchmark also
+ * reports `allocs` and `alloc_bytes` per iteration.
+ */
+
+namespace {
+
+const std::vector<std::string> sample_paths = {
+    "www/index.html", "www/script.js", "www/styles.css", "www/data/mock.json",
+    "www/img/logo.PNG", "www/favicon.ico", "www/archive.tar", "www/",
+};
+
+/**
+ * @brief Builds a representative request for the response builders.
+ */
+http::request<http::string_body> make_request(http::verb method, const std::string& target)
+{
+    http::request<http::string_body> req{method, target, 11};
+    req.set(http::field::host, "localhost");
+    req.set(http::field::user_agent, "Mozilla/5.0 (X11; Linux x86_64)");
+    req.set(http::field::accept, "*/*");
+    req.keep_alive(true);
+    return req;
+}
+
+/**
+ * @brief Returns one NDJSON line as streamed by /api/generate.
+ */
+std::string token_line(std::size_t i)
+{
+    return R"({"model":"llava:latest","created_at":"2024-01-01T00:00:00Z","response":" token)" +
+           std::to_string(i) + R"(","done":false})" "\n";
+}
+
+/**
+ * @brief Returns the final /api/generate line carrying a context of `context_size` ids.
+ */
+std::string final_line(std::size_t context_size)
+{
+    nlohmann::json line;
+    line["model"] = "llava:latest";
+    line["created_at"] = "2024-01-01T00:00:00Z";
+    line["response"] = "";
+    line["done"] = true;
+    line["eval_count"] = 64;
+    std::vector<int> context(context_size);
+    for (std::size_t i = 0; i < context_size; ++i) context[i] = static_cast<int>(1000 + i % 30000);
+    line["context"] = context;
+    return line.dump() + "\n";
+}
+
+/**
+ * @brief Reports operator new calls per iteration as the "allocs" and "alloc_bytes" counters.
+ *
+ * Does nothing unless built with ALLOC_STATS.
+ */
+class AllocCounter {
+public:
+    explicit AllocCounter(benchmark::State& state)
+        : state_(state)
+        , start_(alloc_stats::thread_counters())
+    {
+    }
+
+    ~AllocCounter()
+    {
+        if (!alloc_stats::enabled) return;
+        auto const used = alloc_stats::thread_counters() - start_;
+        state_.counters["allocs"] = benchmark::Counter(static_cast<double>(used.allocs), benchmark::Counter::kAvgIterations);
+        state_.counters["alloc_bytes"] = benchmark::Counter(static_cast<double>(used.bytes), benchmark::Counter::kAvgIterations);
+    }
+
+private:
+    benchmark::State& state_;
+    AllocCounters start_;
+};
+
+void BM_MimeType(benchmark::State& state)
+{
+    std::size_t i = 0;
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(mime_type(sample_paths[i++ % sample_paths.size()]));
+    }
+}
+BENCHMARK(BM_MimeType);
+
+void BM_PathCat(benchmark::State& state)
+{
+    std::size_t i = 0;
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(path_cat("www", sample_paths[i++ % sample_paths.size()]));
+    }
+}
+BENCHMARK(BM_PathCat);
+
+void BM_SendResponse(benchmark::State& state)
+{
+    auto const req = make_request(http::verb::get, "/query_status/123");
+    std::string const body(static_cast<std::size_t>(state.range(0)), 'x');
+    // send_ logs every response at DEBUG; measure construction, not console output.
+    LoggerManager::getLogger("http_tools_logger")->setLevel(LogLevel::ERROR);
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        auto msg = send_(req, http::status::ok, body, "application/json");
+        benchmark::DoNotOptimize(msg);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_SendResponse)->Arg(64)->Arg(1024)->Arg(16384);
+
+void BM_SendResponseWire(benchmark::State& state)
+{
+    auto const req = make_request(http::verb::get, "/query_status/123");
+    std::string const body(static_cast<std::size_t>(state.range(0)), 'x');
+    LoggerManager::getLogger("http_tools_logger")->setLevel(LogLevel::ERROR);
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        // Build and serialize, as a session does before writing: measures the header bytes too.
+        auto msg = send_(req, http::status::ok, body, "application/json");
+        beast::error_code ec;
+        std::size_t bytes = 0;
+        while (!msg.is_done()) {
+            auto const buffers = msg.prepare(ec);
+            bytes += beast::buffer_bytes(buffers);
+            msg.consume(beast::buffer_bytes(buffers));
+        }
+        benchmark::DoNotOptimize(bytes);
+    }
+}
+BENCHMARK(BM_SendResponseWire)->Arg(64)->Arg(1024);
+
+void BM_SessionBuffersChurn(benchmark::State& state)
+{
+    // One short-lived connection per iteration: take buffers, use them once, give them back.
+    std::string const request(512, 'x');
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        auto buffers = acquire_session_buffers();
+        buffers->read_buffer.commit(boost::asio::buffer_copy(
+            buffers->read_buffer.prepare(512), boost::asio::buffer(request)));
+        benchmark::DoNotOptimize(buffers->request_arena.allocate(2048, alignof(std::max_align_t)));
+    }
+}
+BENCHMARK(BM_SessionBuffersChurn);
+
+void BM_RateLimiterAcquire(benchmark::State& state)
+{
+    // Each thread is its own client; the budget is high enough that nothing is refused.
+    static rate_limiter limiter([] {
+        RateLimits limits;
+        limits.budgets[static_cast<std::size_t>(rate_class::static_content)] = {1e9, 1e9};
+        return limits;
+    }());
+    auto const client = rate_limiter::client_id(boost::asio::ip::make_address_v4(0x0a000001u + state.thread_index()));
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(limiter.acquire(client, rate_class::static_content));
+    }
+}
+BENCHMARK(BM_RateLimiterAcquire)->ThreadRange(1, 8)->UseRealTime();
+
+void BM_LoggerLog(benchmark::State& state)
+{
+    static auto logger = LoggerManager::getLogger("microbench_file_logger", LogLevel::DEBUG, LogOutput::FILE, "/dev/null");
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        logger->log(LogLevel::DEBUG, "Received request: GET /query_status/" + std::to_string(state.iterations()));
+    }
+}
+BENCHMARK(BM_LoggerLog)->ThreadRange(1, 8)->UseRealTime();
+
+void BM_LoggerLogFiltered(benchmark::State& state)
+{
+    // The common case in the server: DEBUG messages built and then discarded by an INFO logger.
+    static auto logger = LoggerManager::getLogger("microbench_filtered_logger", LogLevel::INFO, LogOutput::FILE, "/dev/null");
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        logger->log(LogLevel::DEBUG, "Received request: GET /query_status/" + std::to_string(state.iterations()));
+    }
+}
+BENCHMARK(BM_LoggerLogFiltered)->ThreadRange(1, 8)->UseRealTime();
+
+void BM_GetLogger(benchmark::State& state)
+{
+    LoggerManager::getLogger("http_tools_logger");
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(LoggerManager::getLogger("http_tools_logger"));
+    }
+}
+BENCHMARK(BM_GetLogger)->ThreadRange(1, 8)->UseRealTime();
+
+void BM_Base64Encode(benchmark::State& state)
+{
+    std::string const data(static_cast<std::size_t>(state.range(0)), '\x5a');
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(macaron::Base64::Encode(data));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_Base64Encode)->Arg(64)->Arg(4096)->Arg(1 << 20);
+
+void BM_Base64Decode(benchmark::State& state)
+{
+    std::string const encoded = macaron::Base64::Encode(std::string(static_cast<std::size_t>(state.range(0)), '\x5a'));
+    std::string out;
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        macaron::Base64::Decode(encoded, out);
+        benchmark::DoNotOptimize(out);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_Base64Decode)->Arg(64)->Arg(4096)->Arg(1 << 20);
+
+void BM_ResponseParseToken(benchmark::State& state)
+{
+    auto const line = token_line(42);
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        ollama::response response(line);
+        benchmark::DoNotOptimize(response);
+    }
+}
+BENCHMARK(BM_ResponseParseToken);
+
+void BM_ResponseParseFinal(benchmark::State& state)
+{
+    auto const line = final_line(static_cast<std::size_t>(state.range(0)));
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        ollama::response response(line);
+        benchmark::DoNotOptimize(response);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * line.size()));
+}
+BENCHMARK(BM_ResponseParseFinal)->Arg(256)->Arg(2048)->Arg(8192);
+
+void BM_ResponseCopy(benchmark::State& state)
+{
+    ollama::response const response(final_line(static_cast<std::size_t>(state.range(0))));
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        ollama::response copy = response;
+        benchmark::DoNotOptimize(copy);
+    }
+}
+BENCHMARK(BM_ResponseCopy)->Arg(2048);
+
+/**
+ * @brief Extracts 'message' and 'context' from a POST /api body carrying a context of range(0) ids.
+ */
+void BM_PostBodyScan(benchmark::State& state)
+{
+    auto const context = final_line(static_cast<std::size_t>(state.range(0)));
+    std::string const body = R"({"message":"Describe the \"image\" in one line.","context":)" + context + "}";
+    std::string message;
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        std::string_view fields[2];
+        json_scan::find_fields(body, {"message", "context"}, fields);
+        json_scan::decode_string(fields[0], message);
+        benchmark::DoNotOptimize(fields);
+        benchmark::DoNotOptimize(message);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * body.size()));
+}
+BENCHMARK(BM_PostBodyScan)->Arg(256)->Arg(8192);
+
+/**
+ * @brief Streams a whole generation through the NDJSON callback.
+ *
+ * range(0) is the number of tokens, range(1) the HTTP chunk size the body is
+ * split into (0 = one chunk per line), which exercises the partial-line path.
+ */
+void BM_StreamCallback(benchmark::State& state)
+{
+    auto const tokens = static_cast<std::size_t>(state.range(0));
+    auto const split = static_cast<std::size_t>(state.range(1));
+
+    std::vector<std::string> chunks;
+    for (std::size_t i = 0; i < tokens; ++i) {
+        auto const line = i + 1 == tokens ? final_line(2048) : token_line(i);
+        if (split == 0) {
+            chunks.push_back(line);
+            continue;
+        }
+        for (std::size_t off = 0; off < line.size(); off += split) {
+            chunks.push_back(line.substr(off, split));
+        }
+    }
+
+    std::size_t received = 0;
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        auto callback = ollama::make_stream_callback([&received](const ollama::response& r) {
+            benchmark::DoNotOptimize(r);
+            ++received;
+        });
+        for (const auto& chunk : chunks) {
+            callback(chunk.data(), chunk.size());
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * tokens));
+    state.counters["responses"] = benchmark::Counter(static_cast<double>(received), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_StreamCallback)->Args({64, 0})->Args({64, 16})->Args({512, 0});
+
+void BM_QueryStatusJson(benchmark::State& state)
+{
+    Query query;
+    query.id = "1234567890";
+    query.running = true;
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        query.partial_responses.push_back(" token" + std::to_string(i));
+    }
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Application::query_status_json(query.id, query));
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_QueryStatusJson)->Arg(16)->Arg(256)->Arg(4096);
+
+void BM_QueryIdNext(benchmark::State& state)
+{
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        std::string id = QueryId::next();
+        benchmark::DoNotOptimize(id);
+    }
+}
+BENCHMARK(BM_QueryIdNext)->Threads(1)->Threads(4);
+
+void BM_QueryRegistryFind(benchmark::State& state)
+{
+    // Status polls from several I/O threads against a registry of 4096 queries,
+    // created on four threads as the I/O threads would.
+    static QueryRegistry registry;
+    static std::vector<std::string> const ids = [] {
+        std::vector<std::string> ids(4096);
+        std::vector<std::thread> threads;
+        for (std::size_t t = 0; t < 4; ++t) {
+            threads.emplace_back([&ids, t] {
+                for (std::size_t i = t; i < ids.size(); i += 4) {
+                    auto query = std::make_shared<Query>();
+                    query->id = QueryId::next();
+                    registry.insert(query);
+                    ids[i] = query->id;
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        return ids;
+    }();
+    std::size_t i = static_cast<std::size_t>(state.thread_index()) * 997;
+    AllocCounter allocs(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(registry.find(ids[i++ % ids.size()]));
+    }
+}
+BENCHMARK(BM_QueryRegistryFind)->ThreadRange(1, 8)->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
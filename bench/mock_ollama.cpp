@@ -0,0 +1,56 @@
+#include "include/mock_ollama.hpp"
+#include "include/options.hpp"
+#include "../log/include/log.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+/**
+ * @brief Runs the mock Ollama backend.
+ *
+ * Usage: mock_ollama [--host=127.0.0.1] [--port=11434] [--threads=8] [--model=llava:latest]
+ *                    [--tokens=64] [--rate=50] [--first-token-ms=100] [--jitter-ms=0]
+ *                    [--chunk-split=0] [--error-rate=0] [--abort-rate=0]
+ *                    [--embedding-dims=384] [--context-limit=2048] [--seed=42]
+ *
+ * Point the application at it with `OLLAMA_URL=http://<host>:<port>`.
+ */
+int main(int argc, char* argv[])
+{
+    auto logger = LoggerManager::getLogger("MockOllamaMain", LogLevel::INFO, LogOutput::CONSOLE);
+
+    try {
+        Options opts(argc, argv);
+        if (opts.has("help")) {
+            std::cout << "Usage: mock_ollama [--host=127.0.0.1] [--port=11434] [--threads=8] [--model=llava:latest]\n"
+                         "                   [--tokens=64] [--rate=50] [--first-token-ms=100] [--jitter-ms=0]\n"
+                         "                   [--chunk-split=0] [--error-rate=0] [--abort-rate=0]\n"
+                         "                   [--embedding-dims=384] [--context-limit=2048] [--seed=42]\n";
+            return EXIT_SUCCESS;
+        }
+
+        MockOllamaConfig config;
+        config.host = opts.get("host", config.host);
+        config.port = static_cast<int>(opts.get_int("port", config.port));
+        config.threads = static_cast<int>(opts.get_int("threads", config.threads));
+        config.model = opts.get("model", config.model);
+        config.tokens_per_response = static_cast<std::size_t>(opts.get_int("tokens", static_cast<long long>(config.tokens_per_response)));
+        config.tokens_per_second = opts.get_double("rate", config.tokens_per_second);
+        config.first_token_latency = std::chrono::milliseconds(opts.get_int("first-token-ms", config.first_token_latency.count()));
+        config.latency_jitter = std::chrono::milliseconds(opts.get_int("jitter-ms", config.latency_jitter.count()));
+        config.chunk_split = static_cast<std::size_t>(opts.get_int("chunk-split", static_cast<long long>(config.chunk_split)));
+        config.error_rate = opts.get_double("error-rate", config.error_rate);
+        config.abort_rate = opts.get_double("abort-rate", config.abort_rate);
+        config.embedding_dimensions = static_cast<std::size_t>(opts.get_int("embedding-dims", static_cast<long long>(config.embedding_dimensions)));
+        config.context_limit = static_cast<std::size_t>(opts.get_int("context-limit", static_cast<long long>(config.context_limit)));
+        config.seed = static_cast<std::uint64_t>(opts.get_int("seed", static_cast<long long>(config.seed)));
+
+        MockOllama mock(config);
+        mock.run();
+    } catch (const std::exception& e) {
+        logger->log(LogLevel::ERROR, std::string("mock_ollama: ") + e.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,39 @@
+#!/usr/bin/env bash
+# Runs one end-to-end benchmark: mock Ollama backend + server + load generator.
+#
+# Expects the binaries to be built (see `make bench`) and a .env with the
+# certificate settings in the working directory, like `make run`. Extra
+# arguments are passed to the load generator.
+set -eu
+
+TARGET=${TARGET:-bin/main}
+MOCK_TARGET=${MOCK_TARGET:-bin/mock_ollama}
+LOADGEN_TARGET=${LOADGEN_TARGET:-bin/load_generator}
+BENCH_PORT=${BENCH_PORT:-8443}
+BENCH_MOCK_PORT=${BENCH_MOCK_PORT:-11500}
+BENCH_THREADS=${BENCH_THREADS:-2}
+BENCH_OUT=${BENCH_OUT:-bench/results/load.json}
+BENCH_DOC_ROOT=${BENCH_DOC_ROOT:-www}
+MOCK_ARGS=${MOCK_ARGS:-}
+
+mkdir -p "$(dirname "$BENCH_OUT")"
+log_dir=$(dirname "$BENCH_OUT")
+
+BENCH_REVISION=${BENCH_REVISION:-$(git rev-parse --short HEAD 2>/dev/null || echo "")}
+export BENCH_REVISION
+
+"$MOCK_TARGET" --port="$BENCH_MOCK_PORT" $MOCK_ARGS > "$log_dir/mock.log" 2>&1 &
+mock_pid=$!
+# The load generator is one client, so rate limiting stays off unless RATE_LIMIT is set.
+OLLAMA_URL="http://127.0.0.1:$BENCH_MOCK_PORT" RATE_LIMIT="${RATE_LIMIT:-0}" "$TARGET" 127.0.0.1 "$BENCH_PORT" "$BENCH_DOC_ROOT" "$BENCH_THREADS" > "$log_dir/server.log" 2>&1 &
+server_pid=$!
+trap 'kill $server_pid $mock_pid 2>/dev/null || true' EXIT INT TERM
+
+# Wait for the listener instead of sleeping a fixed time.
+tries=0
+until (echo > "/dev/tcp/127.0.0.1/$BENCH_PORT") 2>/dev/null || [ $tries -ge 50 ]; do
+    tries=$((tries + 1))
+    sleep 0.1
+done
+
+"$LOADGEN_TARGET" --host=127.0.0.1 --port="$BENCH_PORT" --out="$BENCH_OUT" "$@"
@@ -0,0 +1,214 @@
+#include "../include/bench_compare.hpp"
+#include "../include/report.hpp"
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <stdexcept>
+
+namespace {
+
+/// Keys of a Google Benchmark run entry that are not measurements.
+const std::set<std::string> google_benchmark_fields = {
+    "name", "family_index", "per_family_instance_index", "run_name", "run_type", "repetitions",
+    "repetition_index", "threads", "iterations", "real_time", "cpu_time", "time_unit",
+    "aggregate_name", "aggregate_unit", "label", "error_occurred", "error_message",
+    "bytes_per_second", "items_per_second",
+};
+
+double median(std::vector<double> values)
+{
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    auto const mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2.0;
+}
+
+/**
+ * @brief Appends a sample to a normalised metric, creating it if needed.
+ */
+void add_sample(nlohmann::json& metrics, const std::string& name, double value, const std::string& unit, bool higher_is_better)
+{
+    if (!metrics.contains(name)) {
+        metrics[name] = make_metric(0.0, unit, higher_is_better);
+    }
+    metrics[name]["samples"].push_back(value);
+}
+
+/**
+ * @brief Normalises Google Benchmark output; repetitions become samples.
+ */
+nlohmann::json normalize_google_benchmark(const nlohmann::json& report)
+{
+    nlohmann::json results = nlohmann::json::object();
+
+    for (const auto& run : report["benchmarks"]) {
+        if (run.value("run_type", std::string("iteration")) != "iteration" || run.value("error_occurred", false)) {
+            continue;
+        }
+        auto const name = run.value("run_name", run.value("name", std::string()));
+        auto& metrics = results[name];
+        auto const unit = run.value("time_unit", std::string("ns"));
+
+        add_sample(metrics, "real_time", run.value("real_time", 0.0), unit, false);
+        add_sample(metrics, "cpu_time", run.value("cpu_time", 0.0), unit, false);
+        if (run.contains("bytes_per_second")) add_sample(metrics, "bytes_per_second", run["bytes_per_second"].get<double>(), "B/s", true);
+        if (run.contains("items_per_second")) add_sample(metrics, "items_per_second", run["items_per_second"].get<double>(), "items/s", true);
+
+        // Allocation counters (see the ALLOC_STATS build) are the only user counters with a known direction.
+        for (auto it = run.begin(); it != run.end(); ++it) {
+            if (google_benchmark_fields.count(it.key()) || !it->is_number()) continue;
+            if (it.key().rfind("alloc", 0) == 0) {
+                add_sample(metrics, it.key(), it->get<double>(), "count", false);
+            }
+        }
+    }
+
+    for (auto& [name, metrics] : results.items()) {
+        for (auto& [metric, m] : metrics.items()) {
+            m["value"] = median(m["samples"].get<std::vector<double>>());
+        }
+    }
+    return results;
+}
+
+/**
+ * @brief Normalises a report in the layout of report.hpp.
+ */
+nlohmann::json normalize_bench_report(const nlohmann::json& report)
+{
+    nlohmann::json results = nlohmann::json::object();
+    for (const auto& bench : report["benchmarks"]) {
+        results[bench["name"].get<std::string>()] = bench["metrics"];
+    }
+    return results;
+}
+
+std::vector<double> samples_of(const nlohmann::json& metric)
+{
+    if (metric.contains("samples") && metric["samples"].is_array()) {
+        return metric["samples"].get<std::vector<double>>();
+    }
+    return {};
+}
+
+} // namespace
+
+/**
+ * @brief Converts a load generator or Google Benchmark report to the normalised form.
+ */
+nlohmann::json normalize_report(const nlohmann::json& report)
+{
+    if (report.contains("schema") && report.contains("benchmarks")) {
+        return normalize_bench_report(report);
+    }
+    if (report.contains("context") && report.contains("benchmarks")) {
+        return normalize_google_benchmark(report);
+    }
+    throw std::runtime_error("Unrecognised benchmark report layout");
+}
+
+/**
+ * @brief Wraps normalised results into a baseline document.
+ */
+nlohmann::json make_baseline(const std::string& suite, const nlohmann::json& results, const nlohmann::json& previous)
+{
+    auto baseline = make_report("bench_compare", nlohmann::json{{"suite", suite}});
+    baseline["version"] = previous.is_object() ? previous.value("version", 0) + 1 : 1;
+    baseline["benchmarks"] = results;
+    return baseline;
+}
+
+/**
+ * @brief Two-sided Mann-Whitney U test with tie correction (normal approximation).
+ */
+double mann_whitney_p(const std::vector<double>& a, const std::vector<double>& b)
+{
+    if (a.empty() || b.empty()) {
+        return 1.0;
+    }
+
+    std::vector<std::pair<double, int>> all;
+    all.reserve(a.size() + b.size());
+    for (double v : a) all.emplace_back(v, 0);
+    for (double v : b) all.emplace_back(v, 1);
+    std::sort(all.begin(), all.end());
+
+    // Average ranks over ties and accumulate the tie correction term.
+    double rank_sum_a = 0.0;
+    double tie_term = 0.0;
+    for (std::size_t i = 0; i < all.size();) {
+        std::size_t j = i;
+        while (j < all.size() && all[j].first == all[i].first) ++j;
+        auto const avg_rank = (static_cast<double>(i + 1) + static_cast<double>(j)) / 2.0;
+        for (std::size_t k = i; k < j; ++k) {
+            if (all[k].second == 0) rank_sum_a += avg_rank;
+        }
+        auto const t = static_cast<double>(j - i);
+        tie_term += t * t * t - t;
+        i = j;
+    }
+
+    auto const n1 = static_cast<double>(a.size());
+    auto const n2 = static_cast<double>(b.size());
+    auto const n = n1 + n2;
+    auto const u = rank_sum_a - n1 * (n1 + 1.0) / 2.0;
+    auto const mean = n1 * n2 / 2.0;
+    auto const variance = n1 * n2 / 12.0 * ((n + 1.0) - tie_term / (n * (n - 1.0)));
+    if (variance <= 0.0) {
+        return 1.0;
+    }
+
+    auto const z = (std::abs(u - mean) - 0.5) / std::sqrt(variance);
+    return std::erfc(std::max(z, 0.0) / std::sqrt(2.0));
+}
+
+/**
+ * @brief Compares normalised results with a baseline.
+ */
+std::vector<MetricComparison> compare_results(const nlohmann::json& baseline, const nlohmann::json& current, const CompareOptions& options)
+{
+    std::vector<MetricComparison> comparisons;
+
+    for (auto it = current.begin(); it != current.end(); ++it) {
+        if (!baseline.contains(it.key())) continue;
+        const auto& base_metrics = baseline[it.key()];
+
+        for (auto m = it->begin(); m != it->end(); ++m) {
+            if (!base_metrics.contains(m.key())) continue;
+            if (!options.metrics.empty() &&
+                std::find(options.metrics.begin(), options.metrics.end(), m.key()) == options.metrics.end()) {
+                continue;
+            }
+
+            const auto& base = base_metrics[m.key()];
+            auto const base_samples = samples_of(base);
+            auto const new_samples = samples_of(*m);
+            bool const higher_is_better = m->value("better", std::string("lower")) == "higher";
+
+            MetricComparison c;
+            c.benchmark = it.key();
+            c.metric = m.key();
+            c.unit = m->value("unit", std::string());
+            c.tested = base_samples.size() >= options.min_samples && new_samples.size() >= options.min_samples;
+            c.baseline = c.tested ? median(base_samples) : base.value("value", 0.0);
+            c.current = c.tested ? median(new_samples) : m->value("value", 0.0);
+            if (c.tested) {
+                c.p_value = mann_whitney_p(base_samples, new_samples);
+            }
+
+            if (c.baseline != 0.0) {
+                c.change = (c.current - c.baseline) / std::abs(c.baseline);
+                if (higher_is_better) c.change = -c.change;
+            }
+
+            bool const significant = !c.tested || c.p_value < options.alpha;
+            c.regression = c.baseline != 0.0 && c.change > options.threshold && significant;
+            c.improvement = c.baseline != 0.0 && c.change < -options.threshold && significant;
+            comparisons.push_back(c);
+        }
+    }
+
+    return comparisons;
+}
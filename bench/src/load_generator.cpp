@@ -0,0 +1,583 @@
+#include "../include/load_generator.hpp"
+#include "../include/report.hpp"
+#include "../../log/include/log.hpp"
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/beast/version.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+namespace ssl = boost::asio::ssl;
+using tcp = boost::asio::ip::tcp;
+
+namespace {
+
+/// Width of the windows used for per-window samples.
+constexpr auto window_width = std::chrono::seconds(1);
+
+double to_us(std::chrono::steady_clock::duration d)
+{
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+} // namespace
+
+/**
+ * @brief Returns the report name of an endpoint.
+ */
+const char* load_endpoint_name(LoadEndpoint endpoint)
+{
+    switch (endpoint) {
+        case LoadEndpoint::static_get: return "static_get";
+        case LoadEndpoint::json_data: return "json_data";
+        case LoadEndpoint::post_query: return "post_query";
+        case LoadEndpoint::query_status: return "query_status";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief Returns the configuration as JSON for the report.
+ */
+nlohmann::json LoadConfig::to_json() const
+{
+    nlohmann::json config;
+    config["host"] = host;
+    config["port"] = port;
+    config["duration_s"] = duration_s;
+    config["warmup_s"] = warmup_s;
+    config["rate"] = rate;
+    config["arrivals"] = rate <= 0.0 ? "closed" : (poisson ? "poisson" : "uniform");
+    config["connections"] = connections;
+    config["keep_alive_ratio"] = keep_alive_ratio;
+    for (std::size_t i = 0; i < load_endpoint_count; ++i) {
+        config["mix"][load_endpoint_name(static_cast<LoadEndpoint>(i))] = weights[i];
+    }
+    config["static_paths"] = static_paths;
+    config["timeout_s"] = timeout_s;
+    config["tcp_nodelay"] = tcp_nodelay;
+    config["seed"] = seed;
+    return config;
+}
+
+/**
+ * @brief One client connection issuing requests on behalf of the generator.
+ *
+ * A connection serves one request at a time. It connects lazily, reconnects
+ * after the server or the keep-alive ratio closed it, and reports every
+ * outcome back to the generator through on_complete().
+ */
+class LoadGenerator::Connection : public std::enable_shared_from_this<LoadGenerator::Connection> {
+public:
+    explicit Connection(LoadGenerator& gen) : gen_(gen) {}
+
+    /**
+     * @brief Issues a request, connecting first if necessary.
+     *
+     * @param request The scheduled request.
+     * @param keep_alive Whether to keep the connection open after the response.
+     */
+    void start(const Pending& request, bool keep_alive)
+    {
+        current_ = request;
+        keep_alive_ = keep_alive;
+        sent_ = clock::now();
+        if (connected_) {
+            do_write();
+        } else {
+            do_connect();
+        }
+    }
+
+    /**
+     * @brief Closes the underlying socket without a TLS close_notify.
+     */
+    void close()
+    {
+        if (stream_) {
+            beast::error_code ec;
+            beast::get_lowest_layer(*stream_).socket().shutdown(tcp::socket::shutdown_both, ec);
+            beast::get_lowest_layer(*stream_).close();
+        }
+        connected_ = false;
+        buffer_.clear();
+    }
+
+private:
+    LoadGenerator& gen_;
+    std::unique_ptr<beast::ssl_stream<beast::tcp_stream>> stream_;
+    beast::flat_buffer buffer_;
+    http::request<http::string_body> req_;
+    http::response<http::string_body> res_;
+    Pending current_{LoadEndpoint::static_get, clock::time_point{}};
+    clock::time_point sent_;
+    bool connected_ = false;
+    bool keep_alive_ = true;
+
+    std::chrono::steady_clock::duration timeout() const
+    {
+        return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(gen_.config_.timeout_s));
+    }
+
+    void do_connect()
+    {
+        stream_ = std::make_unique<beast::ssl_stream<beast::tcp_stream>>(gen_.ioc_, gen_.ssl_ctx_);
+        if (!SSL_set_tlsext_host_name(stream_->native_handle(), gen_.config_.host.c_str())) {
+            return fail(beast::error_code{static_cast<int>(::ERR_get_error()), net::error::get_ssl_category()});
+        }
+        ++gen_.connects_;
+        beast::get_lowest_layer(*stream_).expires_after(timeout());
+        beast::get_lowest_layer(*stream_).async_connect(
+            gen_.endpoints_,
+            [self = shared_from_this()](beast::error_code ec, tcp::endpoint) { self->on_connect(ec); });
+    }
+
+    void on_connect(beast::error_code ec)
+    {
+        if (ec) {
+            return fail(ec);
+        }
+        if (gen_.config_.tcp_nodelay) {
+            beast::get_lowest_layer(*stream_).socket().set_option(tcp::no_delay(true), ec);
+        }
+        stream_->async_handshake(
+            ssl::stream_base::client,
+            [self = shared_from_this()](beast::error_code ec) { self->on_handshake(ec); });
+    }
+
+    void on_handshake(beast::error_code ec)
+    {
+        if (ec) {
+            return fail(ec);
+        }
+        connected_ = true;
+        do_write();
+    }
+
+    void do_write()
+    {
+        auto const target = gen_.target_for(current_.endpoint);
+        req_ = {};
+        req_.version(11);
+        req_.target(target);
+        req_.set(http::field::host, gen_.config_.host);
+        req_.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+        if (current_.endpoint == LoadEndpoint::post_query) {
+            req_.method(http::verb::post);
+            req_.set(http::field::content_type, "application/json");
+            req_.body() = R"({"message":"benchmark prompt )" + std::to_string(gen_.scheduled_) + "\"}";
+        } else {
+            req_.method(http::verb::get);
+        }
+        req_.keep_alive(keep_alive_);
+        req_.prepare_payload();
+
+        beast::get_lowest_layer(*stream_).expires_after(timeout());
+        http::async_write(*stream_, req_,
+            [self = shared_from_this()](beast::error_code ec, std::size_t) { self->on_write(ec); });
+    }
+
+    void on_write(beast::error_code ec)
+    {
+        if (ec) {
+            return fail(ec);
+        }
+        res_ = {};
+        http::async_read(*stream_, buffer_, res_,
+            [self = shared_from_this()](beast::error_code ec, std::size_t) { self->on_read(ec); });
+    }
+
+    void on_read(beast::error_code ec)
+    {
+        if (ec) {
+            return fail(ec);
+        }
+        beast::get_lowest_layer(*stream_).expires_never();
+        if (!keep_alive_ || !res_.keep_alive()) {
+            close();
+        }
+        gen_.on_complete(shared_from_this(), current_, sent_, true, res_.result_int(), res_.body());
+    }
+
+    void fail(beast::error_code ec)
+    {
+        boost::ignore_unused(ec);
+        close();
+        gen_.on_complete(shared_from_this(), current_, sent_, false, 0, std::string());
+    }
+};
+
+/**
+ * @brief Constructs a generator for the given configuration.
+ */
+LoadGenerator::LoadGenerator(LoadConfig config)
+    : config_(std::move(config))
+    , ssl_ctx_(ssl::context::tlsv12_client)
+    , arrival_timer_(ioc_)
+    , drain_timer_(ioc_)
+    , rng_(config_.seed)
+    , mix_(config_.weights.begin(), config_.weights.end())
+{
+    // The server uses a self-signed certificate in every setup we benchmark.
+    ssl_ctx_.set_verify_mode(ssl::verify_none);
+
+    for (std::size_t i = 0; i < std::max<std::size_t>(1, config_.connections); ++i) {
+        connections_.push_back(std::make_shared<Connection>(*this));
+    }
+    idle_ = connections_;
+}
+
+LoadGenerator::~LoadGenerator() = default;
+
+/**
+ * @brief Runs the load test to completion.
+ */
+nlohmann::json LoadGenerator::run()
+{
+    auto logger = LoggerManager::getLogger("load_generator_logger", LogLevel::INFO, LogOutput::CONSOLE);
+
+    tcp::resolver resolver(ioc_);
+    endpoints_ = resolver.resolve(config_.host, config_.port);
+
+    auto const seconds = [](double s) {
+        return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(s));
+    };
+
+    start_ = clock::now();
+    measure_start_ = start_ + seconds(config_.warmup_s);
+    end_ = measure_start_ + seconds(config_.duration_s);
+
+    logger->log(LogLevel::INFO, "Load test against " + config_.host + ":" + config_.port + " for " +
+        std::to_string(config_.warmup_s + config_.duration_s) + " s with " +
+        std::to_string(connections_.size()) + " connections");
+
+    if (config_.rate > 0.0) {
+        next_arrival_ = start_;
+        schedule_next();
+    } else {
+        // Closed loop: every connection always has exactly one request outstanding.
+        for (std::size_t i = 0; i < connections_.size(); ++i) {
+            pending_.push_back(Pending{pick_endpoint(), clock::now()});
+            ++scheduled_;
+        }
+        dispatch();
+        drain_timer_.expires_at(end_);
+        drain_timer_.async_wait([this](boost::system::error_code ec) {
+            if (!ec) begin_drain();
+        });
+    }
+
+    ioc_.run();
+
+    for (auto& conn : connections_) {
+        conn->close();
+    }
+
+    auto report = make_load_report(config_.duration_s);
+    if (!config_.metrics_target.empty()) {
+        report["server_metrics"] = fetch_metrics();
+    }
+    return report;
+}
+
+/**
+ * @brief Returns the next scheduled arrival time after `t`.
+ */
+LoadGenerator::clock::time_point LoadGenerator::next_arrival_after(clock::time_point t)
+{
+    double interval = 1.0 / config_.rate;
+    if (config_.poisson) {
+        interval = std::exponential_distribution<double>(config_.rate)(rng_);
+    }
+    return t + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(interval));
+}
+
+/**
+ * @brief Arms the arrival timer for the next scheduled request.
+ */
+void LoadGenerator::schedule_next()
+{
+    arrival_timer_.expires_at(next_arrival_);
+    arrival_timer_.async_wait([this](boost::system::error_code ec) { on_arrival(ec); });
+}
+
+/**
+ * @brief Enqueues every request whose scheduled time has passed.
+ *
+ * If the timer fired late, all overdue arrivals are enqueued with their
+ * original scheduled times so the delay counts against latency.
+ */
+void LoadGenerator::on_arrival(boost::system::error_code ec)
+{
+    if (ec) {
+        return;
+    }
+
+    auto const now = clock::now();
+    while (next_arrival_ <= now && next_arrival_ < end_) {
+        if (pending_.size() >= config_.max_pending) {
+            if (next_arrival_ >= measure_start_) ++dropped_;
+        } else {
+            pending_.push_back(Pending{pick_endpoint(), next_arrival_});
+            ++scheduled_;
+        }
+        next_arrival_ = next_arrival_after(next_arrival_);
+    }
+
+    dispatch();
+
+    if (next_arrival_ < end_) {
+        schedule_next();
+    } else {
+        begin_drain();
+    }
+}
+
+/**
+ * @brief Picks the endpoint for the next request according to the mix.
+ */
+LoadEndpoint LoadGenerator::pick_endpoint()
+{
+    return static_cast<LoadEndpoint>(mix_(rng_));
+}
+
+/**
+ * @brief Hands pending requests to idle connections.
+ */
+void LoadGenerator::dispatch()
+{
+    std::bernoulli_distribution keep_alive(config_.keep_alive_ratio);
+    while (!pending_.empty() && !idle_.empty()) {
+        auto conn = idle_.back();
+        idle_.pop_back();
+        auto const request = pending_.front();
+        pending_.pop_front();
+        ++busy_;
+        conn->start(request, keep_alive(rng_));
+    }
+}
+
+/**
+ * @brief Builds the request target for an endpoint.
+ */
+std::string LoadGenerator::target_for(LoadEndpoint endpoint)
+{
+    switch (endpoint) {
+        case LoadEndpoint::static_get: {
+            if (config_.static_paths.empty()) return "/";
+            std::uniform_int_distribution<std::size_t> pick(0, config_.static_paths.size() - 1);
+            return config_.static_paths[pick(rng_)];
+        }
+        case LoadEndpoint::json_data:
+            return "/json_data";
+        case LoadEndpoint::post_query:
+            return "/";
+        case LoadEndpoint::query_status:
+            if (query_ids_.empty()) return "/query_status/unknown";
+            return "/query_status/" + query_ids_[next_query_id_++ % query_ids_.size()];
+    }
+    return "/";
+}
+
+/**
+ * @brief Records a completed request and returns its connection to the idle pool.
+ */
+void LoadGenerator::on_complete(const std::shared_ptr<Connection>& conn, const Pending& request,
+                                clock::time_point sent, bool ok, unsigned status, const std::string& body)
+{
+    auto const done = clock::now();
+    --busy_;
+
+    if (ok && request.endpoint == LoadEndpoint::post_query && status == 200) {
+        try {
+            auto const reply = nlohmann::json::parse(body);
+            if (reply.contains("query_id")) {
+                // Poll the most recent submissions, like browsers waiting on their own queries.
+                if (query_ids_.size() >= 256) query_ids_.erase(query_ids_.begin());
+                query_ids_.push_back(reply["query_id"].get<std::string>());
+            }
+        } catch (const std::exception&) {
+        }
+    }
+
+    if (request.intended >= measure_start_ && request.intended < end_) {
+        auto& s = samples_[static_cast<std::size_t>(request.endpoint)];
+        if (!ok) {
+            ++s.errors;
+        } else {
+            if (status < 200 || status >= 300) ++s.non_2xx;
+            s.bytes += body.size();
+            auto const latency = to_us(done - request.intended);
+            s.latency_us.push_back(latency);
+            s.service_us.push_back(to_us(done - sent));
+            if (done >= measure_start_ && done < end_) {
+                auto const window = static_cast<std::size_t>((done - measure_start_) / window_width);
+                if (s.windows.size() <= window) s.windows.resize(window + 1);
+                s.windows[window].push_back(latency);
+            }
+        }
+    }
+
+    idle_.push_back(conn);
+
+    if (config_.rate <= 0.0 && !finished_ && clock::now() < end_) {
+        pending_.push_back(Pending{pick_endpoint(), clock::now()});
+        ++scheduled_;
+    }
+
+    if (finished_) {
+        maybe_finish();
+    } else {
+        dispatch();
+    }
+}
+
+/**
+ * @brief Called once the measured period is over; waits for in-flight requests then stops.
+ */
+void LoadGenerator::begin_drain()
+{
+    finished_ = true;
+    drain_timer_.expires_after(std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(config_.drain_s)));
+    drain_timer_.async_wait([this](boost::system::error_code ec) {
+        if (ec) return;
+        // Whatever is still queued or in flight missed the drain deadline.
+        for (const auto& p : pending_) {
+            if (p.intended >= measure_start_) ++dropped_;
+        }
+        pending_.clear();
+        ioc_.stop();
+    });
+    dispatch();
+    maybe_finish();
+}
+
+/**
+ * @brief Stops the io_context once nothing is in flight.
+ */
+void LoadGenerator::maybe_finish()
+{
+    if (pending_.empty() && busy_ == 0) {
+        arrival_timer_.cancel();
+        drain_timer_.cancel();
+        ioc_.stop();
+    } else {
+        dispatch();
+    }
+}
+
+/**
+ * @brief Fetches `metrics_target` synchronously after the run.
+ */
+nlohmann::json LoadGenerator::fetch_metrics()
+{
+    try {
+        net::io_context ioc;
+        beast::ssl_stream<beast::tcp_stream> stream(ioc, ssl_ctx_);
+        SSL_set_tlsext_host_name(stream.native_handle(), config_.host.c_str());
+        beast::get_lowest_layer(stream).connect(endpoints_);
+        stream.handshake(ssl::stream_base::client);
+
+        http::request<http::string_body> req{http::verb::get, config_.metrics_target, 11};
+        req.set(http::field::host, config_.host);
+        req.keep_alive(false);
+        http::write(stream, req);
+
+        beast::flat_buffer buffer;
+        http::response<http::string_body> res;
+        http::read(stream, buffer, res);
+
+        try {
+            return nlohmann::json::parse(res.body());
+        } catch (const std::exception&) {
+            return res.body();
+        }
+    } catch (const std::exception& e) {
+        return nlohmann::json{{"error", e.what()}};
+    }
+}
+
+/**
+ * @brief Builds the report from the collected samples.
+ */
+nlohmann::json LoadGenerator::make_load_report(double measured_s)
+{
+    auto report = make_report("load_generator", config_.to_json());
+
+    auto const add_benchmark = [&](const std::string& name, const std::vector<const Samples*>& parts) {
+        std::vector<double> latency;
+        std::vector<double> service;
+        std::vector<std::vector<double>> windows;
+        std::uint64_t errors = 0;
+        std::uint64_t non_2xx = 0;
+        std::uint64_t bytes = 0;
+        for (const auto* s : parts) {
+            latency.insert(latency.end(), s->latency_us.begin(), s->latency_us.end());
+            service.insert(service.end(), s->service_us.begin(), s->service_us.end());
+            if (windows.size() < s->windows.size()) windows.resize(s->windows.size());
+            for (std::size_t w = 0; w < s->windows.size(); ++w) {
+                windows[w].insert(windows[w].end(), s->windows[w].begin(), s->windows[w].end());
+            }
+            errors += s->errors;
+            non_2xx += s->non_2xx;
+            bytes += s->bytes;
+        }
+        std::sort(latency.begin(), latency.end());
+        std::sort(service.begin(), service.end());
+
+        auto const total_windows = static_cast<std::size_t>(measured_s);
+        windows.resize(std::max(windows.size(), total_windows));
+        std::vector<double> window_rps;
+        std::vector<double> window_p50;
+        std::vector<double> window_p99;
+        for (auto& w : windows) {
+            window_rps.push_back(static_cast<double>(w.size()));
+            if (w.empty()) continue;
+            std::sort(w.begin(), w.end());
+            window_p50.push_back(percentile(w, 50.0));
+            window_p99.push_back(percentile(w, 99.0));
+        }
+
+        auto const completed = static_cast<double>(latency.size());
+        auto const attempted = completed + static_cast<double>(errors);
+
+        nlohmann::json bench;
+        bench["name"] = name;
+        bench["requests"] = latency.size();
+        bench["errors"] = errors;
+        bench["non_2xx"] = non_2xx;
+        bench["bytes"] = bytes;
+        auto& m = bench["metrics"];
+        m["throughput_rps"] = make_metric(measured_s > 0 ? completed / measured_s : 0.0, "req/s", true, window_rps);
+        m["error_rate"] = make_metric(attempted > 0 ? static_cast<double>(errors) / attempted : 0.0, "ratio", false);
+        m["latency_p50_us"] = make_metric(percentile(latency, 50.0), "us", false, window_p50);
+        m["latency_p90_us"] = make_metric(percentile(latency, 90.0), "us", false);
+        m["latency_p99_us"] = make_metric(percentile(latency, 99.0), "us", false, window_p99);
+        m["latency_p999_us"] = make_metric(percentile(latency, 99.9), "us", false);
+        m["latency_max_us"] = make_metric(latency.empty() ? 0.0 : latency.back(), "us", false);
+        m["service_p50_us"] = make_metric(percentile(service, 50.0), "us", false);
+        m["service_p99_us"] = make_metric(percentile(service, 99.0), "us", false);
+        report["benchmarks"].push_back(bench);
+    };
+
+    std::vector<const Samples*> all;
+    for (std::size_t i = 0; i < load_endpoint_count; ++i) {
+        if (config_.weights[i] <= 0.0) continue;
+        add_benchmark(load_endpoint_name(static_cast<LoadEndpoint>(i)), {&samples_[i]});
+        all.push_back(&samples_[i]);
+    }
+    add_benchmark("all", all);
+
+    report["summary"] = {
+        {"scheduled", scheduled_},
+        {"dropped", dropped_},
+        {"connections_opened", connects_},
+        {"offered_rate", config_.rate},
+    };
+    return report;
+}
@@ -0,0 +1,439 @@
+#include "../include/mock_ollama.hpp"
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <iomanip>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using json = nlohmann::json;
+
+/// Words the mock "generates"; token ids are the index into this table offset by 1000.
+const char* const vocabulary[] = {
+    "the", "quick", "brown", "fox", "jumps", "over", "a", "lazy", "dog", "while",
+    "streaming", "tokens", "arrive", "at", "steady", "rate", "and", "every", "one", "is",
+    "deterministic", "so", "benchmarks", "can", "be", "repeated", "on", "any", "machine", "without",
+    "model", "weights", "or", "GPU", "time", "queue", "latency", "matters", "more", "than",
+};
+constexpr std::size_t vocabulary_size = sizeof(vocabulary) / sizeof(vocabulary[0]);
+constexpr int token_id_base = 1000;
+
+/**
+ * @brief Returns the current UTC time in the RFC 3339 form Ollama uses for `created_at`.
+ */
+std::string timestamp_now()
+{
+    auto const now = std::time(nullptr);
+    std::tm tm{};
+    gmtime_r(&now, &tm);
+    std::ostringstream ss;
+    ss << std::put_time(&tm, "%Y-%m-%dT%H:%M:%SZ");
+    return ss.str();
+}
+
+/**
+ * @brief Mixes the configured seed with a request sequence number.
+ */
+std::uint64_t mix_seed(std::uint64_t seed, std::uint64_t sequence)
+{
+    std::uint64_t z = seed + 0x9e3779b97f4a7c15ULL * (sequence + 1);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Per-request state of a streaming response.
+ *
+ * The chunked content provider is invoked repeatedly by httplib; each call
+ * either continues writing the current NDJSON line (when lines are split into
+ * several chunks) or waits for the next token and starts a new line.
+ */
+struct stream_state {
+    std::mt19937_64 rng;
+    bool chat = false;
+    std::size_t total_tokens = 0;
+    std::size_t next_token = 0;
+    std::size_t abort_after = std::numeric_limits<std::size_t>::max();
+    std::vector<int> context;
+    std::string line;          ///< Line currently being written.
+    std::size_t offset = 0;    ///< Bytes of `line` already written.
+    bool final_sent = false;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+};
+
+/**
+ * @brief Builds the `context` array returned with the final line.
+ *
+ * Mirrors Ollama's behaviour of returning the incoming context extended with
+ * the prompt and generated tokens, so the array grows across a conversation.
+ */
+std::vector<int> build_context(const json& body, const std::string& prompt, std::size_t limit)
+{
+    std::vector<int> context;
+    if (body.contains("context") && body["context"].is_array()) {
+        for (const auto& v : body["context"]) {
+            if (v.is_number_integer()) context.push_back(v.get<int>());
+        }
+    }
+    std::istringstream words(prompt);
+    std::string word;
+    while (words >> word) {
+        context.push_back(token_id_base + static_cast<int>(std::hash<std::string>{}(word) % 30000));
+    }
+    if (context.size() > limit) {
+        context.erase(context.begin(), context.end() - static_cast<std::ptrdiff_t>(limit));
+    }
+    return context;
+}
+
+/**
+ * @brief Extracts the prompt text from a generate or chat request body.
+ */
+std::string prompt_of(const json& body, bool chat)
+{
+    if (!chat) {
+        return body.value("prompt", std::string());
+    }
+    std::string prompt;
+    if (body.contains("messages") && body["messages"].is_array()) {
+        for (const auto& m : body["messages"]) {
+            if (m.contains("content") && m["content"].is_string()) {
+                prompt += m["content"].get<std::string>();
+                prompt += ' ';
+            }
+        }
+    }
+    return prompt;
+}
+
+} // namespace
+
+/**
+ * @brief Constructs the mock and registers all endpoints.
+ *
+ * @param config The behaviour of the mock backend.
+ */
+MockOllama::MockOllama(MockOllamaConfig config)
+    : config_(std::move(config))
+    , logger_(LoggerManager::getLogger("mock_ollama_logger", LogLevel::INFO, LogOutput::CONSOLE))
+{
+    auto const threads = static_cast<std::size_t>(std::max(1, config_.threads));
+    server_.new_task_queue = [threads] { return new httplib::ThreadPool(threads); };
+
+    server_.Post("/api/generate", [this](const httplib::Request& req, httplib::Response& res) {
+        handle_generation(req, res, false);
+    });
+
+    server_.Post("/api/chat", [this](const httplib::Request& req, httplib::Response& res) {
+        handle_generation(req, res, true);
+    });
+
+    server_.Post("/api/embed", [this](const httplib::Request& req, httplib::Response& res) {
+        handle_embed(req, res);
+    });
+
+    server_.Get("/api/tags", [this](const httplib::Request&, httplib::Response& res) {
+        ++stats_.requests;
+        json model;
+        model["name"] = config_.model;
+        model["model"] = config_.model;
+        model["modified_at"] = timestamp_now();
+        model["size"] = 0;
+        model["digest"] = "mock";
+        model["details"] = {{"format", "gguf"}, {"family", "mock"}, {"parameter_size", "0B"}, {"quantization_level", "none"}};
+        res.set_content(json{{"models", json::array({model})}}.dump(), "application/json");
+    });
+
+    server_.Get("/api/version", [this](const httplib::Request&, httplib::Response& res) {
+        ++stats_.requests;
+        res.set_content(R"({"version":"0.0.0-mock"})", "application/json");
+    });
+
+    server_.Get("/mock/stats", [this](const httplib::Request&, httplib::Response& res) {
+        res.set_content(stats_json().dump(), "application/json");
+    });
+}
+
+/**
+ * @brief Binds to the configured address and serves requests until stop() is called.
+ *
+ * @throws std::runtime_error if the server cannot listen on the configured address.
+ */
+void MockOllama::run()
+{
+    logger_->log(LogLevel::INFO, "Mock Ollama listening on " + config_.host + ":" + std::to_string(config_.port) +
+        " (" + std::to_string(config_.tokens_per_response) + " tokens at " + std::to_string(config_.tokens_per_second) + " tok/s)");
+
+    if (!server_.listen(config_.host, config_.port)) {
+        logger_->log(LogLevel::ERROR, "Mock Ollama failed to listen on " + config_.host + ":" + std::to_string(config_.port));
+        throw std::runtime_error("Failed to start mock Ollama server");
+    }
+}
+
+/**
+ * @brief Stops a running server. Safe to call from any thread.
+ */
+void MockOllama::stop()
+{
+    server_.stop();
+}
+
+/**
+ * @brief Returns the counters as JSON.
+ */
+nlohmann::json MockOllama::stats_json() const
+{
+    json stats;
+    stats["requests"] = stats_.requests.load();
+    stats["streams_started"] = stats_.streams_started.load();
+    stats["streams_completed"] = stats_.streams_completed.load();
+    stats["streams_canceled"] = stats_.streams_canceled.load();
+    stats["streams_aborted"] = stats_.streams_aborted.load();
+    stats["injected_errors"] = stats_.injected_errors.load();
+    stats["tokens_sent"] = stats_.tokens_sent.load();
+    return stats;
+}
+
+/**
+ * @brief Returns true if this request should fail with an injected error, and fills `res` if so.
+ */
+bool MockOllama::inject_error(std::uint64_t request_seed, httplib::Response& res)
+{
+    if (config_.error_rate <= 0.0) {
+        return false;
+    }
+    std::mt19937_64 rng(request_seed ^ 0x5bd1e995ULL);
+    if (std::uniform_real_distribution<double>(0.0, 1.0)(rng) >= config_.error_rate) {
+        return false;
+    }
+    ++stats_.injected_errors;
+    res.status = 500;
+    res.set_content(R"({"error":"mock: injected failure"})", "application/json");
+    return true;
+}
+
+/**
+ * @brief Handles `/api/generate` and `/api/chat`.
+ *
+ * @param req The incoming request.
+ * @param res The response to fill.
+ * @param chat True for `/api/chat`, false for `/api/generate`.
+ */
+void MockOllama::handle_generation(const httplib::Request& req, httplib::Response& res, bool chat)
+{
+    ++stats_.requests;
+    auto const request_seed = mix_seed(config_.seed, sequence_++);
+
+    json body;
+    try {
+        body = json::parse(req.body);
+    } catch (const json::exception& e) {
+        res.status = 400;
+        res.set_content(json{{"error", std::string("invalid JSON: ") + e.what()}}.dump(), "application/json");
+        return;
+    }
+
+    if (inject_error(request_seed, res)) {
+        return;
+    }
+
+    auto state = std::make_shared<stream_state>();
+    state->rng.seed(request_seed);
+    state->chat = chat;
+    state->total_tokens = config_.tokens_per_response;
+    state->context = build_context(body, prompt_of(body, chat), config_.context_limit);
+
+    if (config_.abort_rate > 0.0 &&
+        std::uniform_real_distribution<double>(0.0, 1.0)(state->rng) < config_.abort_rate) {
+        state->abort_after = std::uniform_int_distribution<std::size_t>(0, state->total_tokens)(state->rng);
+    }
+
+    auto const model = body.value("model", config_.model);
+    auto const jitter = [this, state] {
+        if (config_.latency_jitter.count() <= 0) return std::chrono::microseconds(0);
+        auto const max_us = std::chrono::duration_cast<std::chrono::microseconds>(config_.latency_jitter).count();
+        return std::chrono::microseconds(std::uniform_int_distribution<long long>(0, max_us)(state->rng));
+    };
+    auto const token_delay = [this, jitter](std::size_t index) {
+        std::chrono::microseconds delay(0);
+        if (index == 0) {
+            delay = std::chrono::duration_cast<std::chrono::microseconds>(config_.first_token_latency);
+        } else if (config_.tokens_per_second > 0.0) {
+            delay = std::chrono::microseconds(static_cast<long long>(1e6 / config_.tokens_per_second));
+        }
+        return delay + jitter();
+    };
+    auto const next_word = [state](std::size_t index) {
+        auto const word = std::uniform_int_distribution<std::size_t>(0, vocabulary_size - 1)(state->rng);
+        state->context.push_back(token_id_base + static_cast<int>(word));
+        return index == 0 ? std::string(vocabulary[word]) : " " + std::string(vocabulary[word]);
+    };
+    auto const final_fields = [this, state](json& line) {
+        auto const elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - state->started).count();
+        line["done"] = true;
+        line["done_reason"] = "stop";
+        line["total_duration"] = elapsed;
+        line["load_duration"] = 0;
+        line["prompt_eval_count"] = state->context.size() > state->total_tokens ? state->context.size() - state->total_tokens : 0;
+        line["prompt_eval_duration"] = std::chrono::duration_cast<std::chrono::nanoseconds>(config_.first_token_latency).count();
+        line["eval_count"] = state->total_tokens;
+        line["eval_duration"] = elapsed;
+        if (state->context.size() > config_.context_limit) {
+            state->context.erase(state->context.begin(),
+                state->context.end() - static_cast<std::ptrdiff_t>(config_.context_limit));
+        }
+        if (!state->chat) {
+            line["context"] = state->context;
+        }
+    };
+
+    // Non-streaming requests get the whole answer after the simulated generation time.
+    if (!body.value("stream", true)) {
+        std::string text;
+        for (std::size_t i = 0; i < state->total_tokens; ++i) {
+            std::this_thread::sleep_for(token_delay(i));
+            text += next_word(i);
+        }
+        json line;
+        line["model"] = model;
+        line["created_at"] = timestamp_now();
+        if (chat) {
+            line["message"] = {{"role", "assistant"}, {"content", text}};
+        } else {
+            line["response"] = text;
+        }
+        final_fields(line);
+        res.set_content(line.dump(), "application/json");
+        return;
+    }
+
+    ++stats_.streams_started;
+    res.set_chunked_content_provider("application/x-ndjson",
+        [this, state, model, token_delay, next_word, final_fields](std::size_t, httplib::DataSink& sink) {
+            auto const write_pending = [this, state, &sink] {
+                auto const remaining = state->line.size() - state->offset;
+                auto const n = config_.chunk_split > 0 ? std::min(config_.chunk_split, remaining) : remaining;
+                if (!sink.write(state->line.data() + state->offset, n)) {
+                    ++stats_.streams_canceled;
+                    return false;
+                }
+                state->offset += n;
+                return true;
+            };
+
+            // Finish the current line first when lines are split into several chunks.
+            if (state->offset < state->line.size()) {
+                return write_pending();
+            }
+
+            if (state->final_sent) {
+                ++stats_.streams_completed;
+                sink.done();
+                return true;
+            }
+
+            if (state->next_token == state->abort_after) {
+                ++stats_.streams_aborted;
+                return false;
+            }
+
+            if (!sink.is_writable()) {
+                ++stats_.streams_canceled;
+                return false;
+            }
+
+            json line;
+            line["model"] = model;
+            line["created_at"] = timestamp_now();
+            if (state->next_token < state->total_tokens) {
+                std::this_thread::sleep_for(token_delay(state->next_token));
+                auto word = next_word(state->next_token);
+                if (state->chat) {
+                    line["message"] = {{"role", "assistant"}, {"content", std::move(word)}};
+                } else {
+                    line["response"] = std::move(word);
+                }
+                line["done"] = false;
+                ++state->next_token;
+                ++stats_.tokens_sent;
+            } else {
+                if (state->chat) {
+                    line["message"] = {{"role", "assistant"}, {"content", ""}};
+                } else {
+                    line["response"] = "";
+                }
+                final_fields(line);
+                state->final_sent = true;
+            }
+
+            state->line = line.dump();
+            state->line += '\n';
+            state->offset = 0;
+            return write_pending();
+        });
+}
+
+/**
+ * @brief Handles `/api/embed`.
+ *
+ * Every input string maps to a unit vector derived from its hash, so equal
+ * inputs always produce equal embeddings.
+ */
+void MockOllama::handle_embed(const httplib::Request& req, httplib::Response& res)
+{
+    ++stats_.requests;
+    auto const request_seed = mix_seed(config_.seed, sequence_++);
+
+    json body;
+    try {
+        body = json::parse(req.body);
+    } catch (const json::exception& e) {
+        res.status = 400;
+        res.set_content(json{{"error", std::string("invalid JSON: ") + e.what()}}.dump(), "application/json");
+        return;
+    }
+
+    if (inject_error(request_seed, res)) {
+        return;
+    }
+
+    std::vector<std::string> inputs;
+    if (body.contains("input") && body["input"].is_array()) {
+        for (const auto& v : body["input"]) {
+            if (v.is_string()) inputs.push_back(v.get<std::string>());
+        }
+    } else if (body.contains("input") && body["input"].is_string()) {
+        inputs.push_back(body["input"].get<std::string>());
+    }
+
+    std::this_thread::sleep_for(config_.first_token_latency);
+
+    json embeddings = json::array();
+    for (const auto& input : inputs) {
+        std::mt19937_64 rng(config_.seed ^ std::hash<std::string>{}(input));
+        std::normal_distribution<double> dist(0.0, 1.0);
+        std::vector<double> vec(config_.embedding_dimensions);
+        double norm = 0.0;
+        for (auto& v : vec) {
+            v = dist(rng);
+            norm += v * v;
+        }
+        norm = std::sqrt(norm);
+        for (auto& v : vec) {
+            v = norm > 0.0 ? v / norm : 0.0;
+        }
+        embeddings.push_back(vec);
+    }
+
+    json reply;
+    reply["model"] = body.value("model", config_.model);
+    reply["embeddings"] = std::move(embeddings);
+    res.set_content(reply.dump(), "application/json");
+}
@@ -0,0 +1,75 @@
+#include "../include/report.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+/**
+ * @brief Returns the p-th percentile (0-100) of `sorted` using nearest-rank interpolation.
+ */
+double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    auto const rank = static_cast<std::size_t>(std::ceil(p / 100.0 * static_cast<double>(sorted.size())));
+    return sorted[rank == 0 ? 0 : std::min(rank, sorted.size()) - 1];
+}
+
+/**
+ * @brief Builds a single metric entry.
+ */
+nlohmann::json make_metric(double value, const std::string& unit, bool higher_is_better, const std::vector<double>& samples)
+{
+    nlohmann::json metric;
+    metric["value"] = value;
+    metric["unit"] = unit;
+    metric["better"] = higher_is_better ? "higher" : "lower";
+    metric["samples"] = samples;
+    return metric;
+}
+
+/**
+ * @brief Creates the top-level report object for a tool.
+ */
+nlohmann::json make_report(const std::string& tool, const nlohmann::json& config)
+{
+    auto const now = std::time(nullptr);
+    std::tm tm{};
+    gmtime_r(&now, &tm);
+    std::ostringstream created_at;
+    created_at << std::put_time(&tm, "%Y-%m-%dT%H:%M:%SZ");
+
+    const char* revision = std::getenv("BENCH_REVISION");
+
+    nlohmann::json report;
+    report["schema"] = bench_report_schema;
+    report["tool"] = tool;
+    report["created_at"] = created_at.str();
+    report["revision"] = revision ? revision : "";
+    report["config"] = config;
+    report["benchmarks"] = nlohmann::json::array();
+    return report;
+}
+
+/**
+ * @brief Writes a report to a file, or to stdout when `path` is empty or "-".
+ */
+void write_report(const nlohmann::json& report, const std::string& path)
+{
+    if (path.empty() || path == "-") {
+        std::cout << report.dump(2) << std::endl;
+        return;
+    }
+
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        throw std::runtime_error("Could not open report file: " + path);
+    }
+    out << report.dump(2) << '\n';
+}
@@ -0,0 +1,103 @@
+#ifndef ALLOC_PHASE_EXECUTOR_HPP
+#define ALLOC_PHASE_EXECUTOR_HPP
+
+#include "../../log/include/alloc_stats.hpp"
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/execution.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/strand.hpp>
+#include <memory>
+#include <utility>
+
+/**
+ * @file alloc_phase_executor.hpp
+ * @brief Executor wrapper that charges a connection's allocations to its phase tracker.
+ *
+ * In the ALLOC_STATS build the server accepts each socket onto an
+ * alloc_phase_executor around its strand. Every handler of that connection,
+ * including the intermediate handlers of Beast's composed read and write
+ * operations, then runs inside an AllocPhaseTracker::Scope.
+ */
+
+/**
+ * @brief Wraps an executor so that every function it runs is charged to a tracker.
+ *
+ * Properties are forwarded to the inner executor, so the wrapper can be stored
+ * in an any_io_executor like the strand it wraps.
+ *
+ * @tparam Inner The wrapped executor type.
+ */
+template <class Inner>
+class alloc_phase_executor {
+public:
+    alloc_phase_executor(Inner inner, std::shared_ptr<AllocPhaseTracker> tracker) noexcept
+        : inner_(std::move(inner))
+        , tracker_(std::move(tracker))
+    {
+    }
+
+    /**
+     * @brief Returns the tracker functions are charged to.
+     */
+    const std::shared_ptr<AllocPhaseTracker>& tracker() const noexcept { return tracker_; }
+
+    template <class Function>
+    void execute(Function&& f) const
+    {
+        inner_.execute([tracker = tracker_, f = std::forward<Function>(f)]() mutable {
+            AllocPhaseTracker::Scope scope(*tracker);
+            std::move(f)();
+        });
+    }
+
+    template <class Property>
+    auto query(const Property& p) const
+        -> decltype(boost::asio::query(std::declval<const Inner&>(), p))
+    {
+        return boost::asio::query(inner_, p);
+    }
+
+    template <class Property>
+    auto require(const Property& p) const
+        -> alloc_phase_executor<std::decay_t<decltype(boost::asio::require(std::declval<const Inner&>(), p))>>
+    {
+        return {boost::asio::require(inner_, p), tracker_};
+    }
+
+    template <class Property>
+    auto prefer(const Property& p) const
+        -> alloc_phase_executor<std::decay_t<decltype(boost::asio::prefer(std::declval<const Inner&>(), p))>>
+    {
+        return {boost::asio::prefer(inner_, p), tracker_};
+    }
+
+    friend bool operator==(const alloc_phase_executor& a, const alloc_phase_executor& b) noexcept
+    {
+        return a.inner_ == b.inner_ && a.tracker_ == b.tracker_;
+    }
+
+    friend bool operator!=(const alloc_phase_executor& a, const alloc_phase_executor& b) noexcept
+    {
+        return !(a == b);
+    }
+
+private:
+    Inner inner_;
+    std::shared_ptr<AllocPhaseTracker> tracker_;
+};
+
+/// The executor sessions are accepted onto in the ALLOC_STATS build.
+using session_alloc_executor = alloc_phase_executor<boost::asio::strand<boost::asio::io_context::executor_type>>;
+
+/**
+ * @brief Returns the tracker of a connection's executor, or null if it is not a session_alloc_executor.
+ */
+inline std::shared_ptr<AllocPhaseTracker> alloc_phase_tracker(const boost::asio::any_io_executor& ex)
+{
+    if (auto const* wrapped = ex.target<session_alloc_executor>()) {
+        return wrapped->tracker();
+    }
+    return nullptr;
+}
+
+#endif // ALLOC_PHASE_EXECUTOR_HPP
@@ -0,0 +1,186 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @file arena.hpp
+ * @brief Per-connection monotonic arena and the allocator adaptors that use it.
+ *
+ * A session allocates its request, the response built for it and the Asio
+ * operations that read and write them from one arena. Deallocation is a
+ * no-op; the session resets the arena once nothing allocated from it is
+ * alive, which rewinds it without returning memory to the heap. After the
+ * first few requests of a connection the arena has settled on one block
+ * large enough for a request/response cycle and keep-alive requests stop
+ * touching the global heap for these objects.
+ */
+
+/**
+ * @brief Monotonic bump allocator that keeps its memory across resets.
+ *
+ * Not thread-safe: a session only uses it from its strand.
+ */
+class arena {
+public:
+    /**
+     * @brief Constructs an arena; no memory is allocated until first use.
+     *
+     * @param initial_size Size of the first block.
+     * @param max_retained Capacity above which reset() gives memory back instead of keeping it.
+     */
+    explicit arena(std::size_t initial_size = 8 * 1024, std::size_t max_retained = 256 * 1024) noexcept;
+
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+
+    /**
+     * @brief Allocates `size` bytes aligned to `alignment`.
+     *
+     * @throws std::bad_alloc if a new block cannot be allocated.
+     */
+    void* allocate(std::size_t size, std::size_t alignment);
+
+    /**
+     * @brief Makes all memory available again.
+     *
+     * If the last cycle spilled into more than one block, they are replaced by
+     * a single block of the combined size so the next cycle fits in one.
+     * Everything allocated from the arena must have been destroyed.
+     */
+    void reset() noexcept;
+
+    /**
+     * @brief Makes sure the first block holds at least `size` bytes.
+     *
+     * Only takes effect while the arena holds no memory; used to pre-size
+     * pooled arenas before their first request.
+     *
+     * @throws std::bad_alloc if the block cannot be allocated.
+     */
+    void reserve(std::size_t size);
+
+    /**
+     * @brief Returns the number of bytes handed out since the last reset, including padding.
+     */
+    std::size_t size() const noexcept;
+
+    /**
+     * @brief Returns the total size of the blocks currently held.
+     */
+    std::size_t capacity() const noexcept { return capacity_; }
+
+private:
+    struct block {
+        std::unique_ptr<std::byte[]> data;
+        std::size_t size;
+    };
+
+    /**
+     * @brief Moves to the next held block, or allocates one of at least `min_size` bytes.
+     */
+    void next_block(std::size_t min_size);
+
+    std::vector<block> blocks_;
+    std::size_t current_ = 0;  ///< Index of the block being bumped.
+    std::size_t offset_ = 0;   ///< Offset of the next free byte in the current block.
+    std::size_t capacity_ = 0;
+    std::size_t initial_size_;
+    std::size_t max_retained_;
+};
+
+/**
+ * @brief Standard allocator that allocates from an arena.
+ *
+ * Usable wherever Beast takes an allocator, e.g. `http::basic_fields` and
+ * `http::basic_string_body`. Propagates on copy, move and swap so that moved
+ * messages keep allocating from the arena they were built in.
+ */
+template <class T>
+class arena_allocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    template <class U>
+    struct rebind {
+        using other = arena_allocator<U>;
+    };
+
+    explicit arena_allocator(arena& a) noexcept : arena_(&a) {}
+
+    template <class U>
+    arena_allocator(const arena_allocator<U>& other) noexcept : arena_(other.get_arena()) {}
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, std::size_t) noexcept {}
+
+    arena* get_arena() const noexcept { return arena_; }
+
+    template <class U>
+    friend bool operator==(const arena_allocator& a, const arena_allocator<U>& b) noexcept
+    {
+        return a.get_arena() == b.get_arena();
+    }
+
+    template <class U>
+    friend bool operator!=(const arena_allocator& a, const arena_allocator<U>& b) noexcept
+    {
+        return a.get_arena() != b.get_arena();
+    }
+
+private:
+    arena* arena_;
+};
+
+/**
+ * @brief Completion handler wrapper that makes Asio allocate the operation's state from an arena.
+ *
+ * Equivalent to `net::bind_allocator(arena_allocator<char>(a), handler)`; Asio
+ * finds the allocator through the nested allocator_type.
+ */
+template <class Handler>
+class arena_handler {
+public:
+    using allocator_type = arena_allocator<char>;
+
+    arena_handler(arena& a, Handler handler)
+        : handler_(std::move(handler))
+        , arena_(&a)
+    {
+    }
+
+    allocator_type get_allocator() const noexcept { return allocator_type(*arena_); }
+
+    template <class... Args>
+    void operator()(Args&&... args)
+    {
+        handler_(std::forward<Args>(args)...);
+    }
+
+private:
+    Handler handler_;
+    arena* arena_;
+};
+
+/**
+ * @brief Wraps a completion handler so its operation state is allocated from `a`.
+ */
+template <class Handler>
+arena_handler<std::decay_t<Handler>> bind_arena(arena& a, Handler&& handler)
+{
+    return arena_handler<std::decay_t<Handler>>(a, std::forward<Handler>(handler));
+}
+
+#endif // ARENA_HPP
@@ -0,0 +1,50 @@
+#ifndef CORO_SESSION_HPP
+#define CORO_SESSION_HPP
+
+#include "../../app/include/application.hpp"
+#include "beast.hpp"
+#include <memory>
+#include <string>
+
+/**
+ * @file coro_session.hpp
+ * @brief C++20 coroutine version of the HTTP/1.1 session loop.
+ *
+ * Built with `make COROUTINES=1`, which compiles the tree as C++20 and makes
+ * the server accept connections into this loop instead of the callback-based
+ * session class. Each connection is one coroutine spawned with co_spawn: the
+ * stream, buffers and request live in its frame instead of a shared session
+ * object, so there is no shared_from_this() hop per operation. Coroutine
+ * frames and the completion handler are allocated through Asio's per-thread
+ * recycling allocator.
+ *
+ * Responses are written one request at a time; requests already in the read
+ * buffer are still parsed from it without reading the socket, but there is no
+ * read-ahead while a response is being written (see session for that).
+ * Connections get the same per-phase timeouts as session (session_timeouts.hpp)
+ * but are not tracked by the idle reaper.
+ */
+
+#ifdef MMLBEAST_COROUTINE_SESSION
+
+/**
+ * @brief Serves an accepted connection with the coroutine session loop.
+ *
+ * Performs the TLS handshake, hands the connection to an http2_session if ALPN
+ * selected h2, and otherwise reads, routes and answers HTTP/1.1 requests until
+ * the client closes the connection or a request asks to close it.
+ *
+ * @param socket The accepted socket; its executor is the connection's strand.
+ * @param ctx The SSL context for managing SSL connections.
+ * @param doc_root The document root directory for serving files.
+ * @param app Shared pointer to the application instance.
+ */
+void run_coro_session(
+    tcp::socket&& socket,
+    ssl::context& ctx,
+    std::shared_ptr<std::string const> const& doc_root,
+    std::shared_ptr<Application> app);
+
+#endif // MMLBEAST_COROUTINE_SESSION
+
+#endif // CORO_SESSION_HPP
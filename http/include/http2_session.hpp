@@ -0,0 +1,188 @@
+#ifndef HTTP2_SESSION_HPP
+#define HTTP2_SESSION_HPP
+
+#include "../../app/include/application.hpp"
+#include "beast.hpp"
+#include "session_timeouts.hpp"
+#include <nghttp2/nghttp2.h>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * @file http2_session.hpp
+ * @brief HTTP/2 connections negotiated through ALPN on the TLS listener.
+ *
+ * Framing, HPACK and flow control are handled by nghttp2; this class feeds it
+ * the bytes read from the TLS stream, writes what it produces, and dispatches
+ * every complete request stream to the same handle_request as HTTP/1.1.
+ */
+
+/// ALPN protocol identifier for HTTP/2 over TLS.
+constexpr char http2_alpn_id[] = "h2";
+
+/**
+ * @brief Registers an ALPN selection callback that prefers "h2" over "http/1.1".
+ *
+ * Clients that offer neither, or don't use ALPN, get HTTP/1.1.
+ *
+ * @param ctx The server's SSL context.
+ */
+void enable_http2_alpn(ssl::context& ctx);
+
+/**
+ * @brief Returns whether ALPN selected HTTP/2 for the given stream.
+ *
+ * @param stream A stream whose handshake has completed.
+ */
+bool negotiated_http2(beast::ssl_stream<beast::tcp_stream>& stream);
+
+/**
+ * @brief Manages one HTTP/2 connection after the TLS handshake.
+ *
+ * Streams are multiplexed on the connection; each is answered as soon as its
+ * request is complete, independently of the others. The connection counts as
+ * idle for the reaper while it has no open streams.
+ */
+class http2_session : public std::enable_shared_from_this<http2_session>
+{
+    /**
+     * @brief Request being received, and response being sent, on one stream.
+     */
+    struct stream_state {
+        http::request<http::string_body> req;  // Request assembled from HEADERS and DATA frames
+        bool rejected = false;  // The request body went over the limit; DATA is dropped
+        std::optional<http::message_generator> response;  // Serializes the response as nghttp2 asks for body
+        std::optional<http::response_parser<http::buffer_body>> parser;  // Splits the serialized response into header and body
+    };
+
+    beast::ssl_stream<beast::tcp_stream> stream_;  // SSL stream taken over from the HTTP/1.1 session
+    std::shared_ptr<std::string const> doc_root_;  // Document root directory
+    std::uint64_t client_id_;  // Rate limiter id of the peer address
+    std::shared_ptr<Application> app_;
+    nghttp2_session* session_ = nullptr;  // nghttp2 connection state
+    std::map<std::int32_t, std::unique_ptr<stream_state>> streams_;  // Open streams by id
+    std::array<char, 16 * 1024> read_buffer_;  // Buffer for reading frames
+    std::vector<std::uint8_t> write_buffer_;  // Frames being written
+    bool writing_ = false;  // Whether a write is in progress
+    bool closing_ = false;  // Whether the TLS shutdown has started
+    bool reaped_ = false;  // Whether the idle reaper closed the connection
+    idle_reaper::hook reap_hook_;  // Link in the idle reaper; last, so it is unlinked first
+public:
+    /**
+     * @brief Constructs an HTTP/2 session on a stream whose handshake selected "h2".
+     *
+     * @param stream The SSL stream.
+     * @param doc_root The document root directory for serving files.
+     * @param app Shared pointer to the application instance.
+     */
+    http2_session(
+        beast::ssl_stream<beast::tcp_stream>&& stream,
+        std::shared_ptr<std::string const> const& doc_root,
+        std::shared_ptr<Application> app);
+
+    ~http2_session();
+
+    http2_session(const http2_session&) = delete;
+    http2_session& operator=(const http2_session&) = delete;
+
+    /**
+     * @brief Sends the server's SETTINGS frame and starts reading frames.
+     */
+    void run();
+
+private:
+    /**
+     * @brief Reads the next chunk of frames from the client.
+     */
+    void do_read();
+
+    /**
+     * @brief Passes the bytes read to nghttp2 and writes whatever it has to send.
+     *
+     * @param ec The error code, if any, from the read operation.
+     * @param bytes_transferred The number of bytes read.
+     */
+    void on_read(beast::error_code ec, std::size_t bytes_transferred);
+
+    /**
+     * @brief Writes the frames nghttp2 has queued, unless a write is already in progress.
+     *
+     * Closes the connection once nghttp2 neither wants to read nor write.
+     */
+    void do_write();
+
+    /**
+     * @brief Handles the completion of a write and continues with the next frames.
+     *
+     * @param ec The error code, if any, from the write operation.
+     * @param bytes_transferred The number of bytes written.
+     */
+    void on_write(beast::error_code ec, std::size_t bytes_transferred);
+
+    /**
+     * @brief Shuts down TLS and closes the connection.
+     */
+    void do_close();
+
+    /**
+     * @brief Routes the completed request on a stream and submits its response.
+     *
+     * @param stream_id The stream the request arrived on.
+     */
+    void dispatch(std::int32_t stream_id);
+
+    /**
+     * @brief Submits the response to a request as HEADERS and DATA frames.
+     *
+     * @param stream_id The stream the request arrived on.
+     * @param head Whether the request was a HEAD request.
+     * @param msg The response.
+     */
+    void submit_response(std::int32_t stream_id, bool head, http::message_generator&& msg);
+
+    /**
+     * @brief Refuses a request whose body is over the limit with 413 Payload Too Large.
+     *
+     * @param stream_id The stream the request arrived on.
+     */
+    void reject_request_body(std::int32_t stream_id);
+
+    /**
+     * @brief Finds the state of an open stream.
+     *
+     * @return The stream's state, or null if it is unknown.
+     */
+    stream_state* find_stream(std::int32_t stream_id);
+
+    /**
+     * @brief Asks an idle session to close; called by the idle reaper from any thread.
+     *
+     * @param owner The session.
+     */
+    static void reap(void* owner);
+
+    /**
+     * @brief Sends GOAWAY and closes the connection if it still has no open streams.
+     */
+    void on_reap();
+
+    // nghttp2 callbacks; user_data is the http2_session.
+    static int on_begin_headers(nghttp2_session*, const nghttp2_frame* frame, void* user_data);
+    static int on_header(nghttp2_session*, const nghttp2_frame* frame,
+                         const std::uint8_t* name, std::size_t namelen,
+                         const std::uint8_t* value, std::size_t valuelen,
+                         std::uint8_t flags, void* user_data);
+    static int on_data_chunk_recv(nghttp2_session*, std::uint8_t flags, std::int32_t stream_id,
+                                  const std::uint8_t* data, std::size_t len, void* user_data);
+    static int on_frame_recv(nghttp2_session*, const nghttp2_frame* frame, void* user_data);
+    static int on_stream_close(nghttp2_session*, std::int32_t stream_id, std::uint32_t error_code, void* user_data);
+    static ssize_t read_response_body(nghttp2_session*, std::int32_t stream_id, std::uint8_t* buf, std::size_t length,
+                                      std::uint32_t* data_flags, nghttp2_data_source* source, void* user_data);
+};
+
+#endif // HTTP2_SESSION_HPP
@@ -10,6 +10,8 @@
 #include <boost/beast/http.hpp>
 #include <boost/beast/ssl.hpp>
 #include <boost/beast/version.hpp>
+#include <cstdint>
+#include <optional>
 #include <string>
 
 /**
@@ -29,6 +31,47 @@ beast::string_view mime_type(beast::string_view path);
  */
 std::string path_cat(beast::string_view base, beast::string_view path);
 
+/**
+ * @brief Build an HTTP response with the given status and body.
+ * 
+ * @param req The original HTTP request.
+ * @param status The HTTP status code.
+ * @param body The response body content.
+ * @param content_type The content type of the response.
+ * @return A message generator for the HTTP response.
+ */
+template <class Body, class Allocator>
+boost::beast::http::message_generator send_(
+    boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>> const& req,
+    boost::beast::http::status status,
+    const std::string& body,
+    const std::string& content_type = "application/json");
+
+/**
+ * @brief Returns whether the request is routed to a handler that blocks on disk or database I/O.
+ * 
+ * Sessions run such requests on Application::blocking_executor() instead of the I/O thread.
+ * 
+ * @param req The HTTP request.
+ */
+template <class Body, class Allocator>
+bool is_blocking_request(boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>> const& req);
+
+/**
+ * @brief Charges a request to its client's rate limit (see rate_limiter.hpp).
+ * 
+ * Always charged to the connection's peer address, and also to the request's
+ * X-API-Key if that key is configured in RATE_LIMIT_API_KEYS.
+ * 
+ * @param req The HTTP request.
+ * @param connection_client The client id of the connection's peer address.
+ * @return A 429 Too Many Requests response if the client is over budget, else nothing.
+ */
+template <class Body, class Allocator>
+std::optional<boost::beast::http::message_generator> check_rate_limit(
+    boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>> const& req,
+    std::uint64_t connection_client);
+
 /**
  * @brief Handle an incoming HTTP request and generate an appropriate response.
  * 
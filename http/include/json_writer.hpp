@@ -0,0 +1,170 @@
+#ifndef JSON_WRITER_HPP
+#define JSON_WRITER_HPP
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+/**
+ * @brief Streams JSON straight into a string, without building a document first.
+ *
+ * Works on any std::basic_string, including a response body allocated from the
+ * session arena, so a handler can serialize into the buffer that is written to
+ * the socket. Commas are placed automatically; the caller only has to nest
+ * begin/end calls correctly and put a key() before each value inside an object.
+ * Strings are expected to be UTF-8 and are escaped as JSON requires; numbers
+ * use the shortest representation that reads back the same, and NaN and
+ * infinities are written as null, as nlohmann::json does.
+ *
+ * Nesting is limited to 64 levels.
+ *
+ * @tparam String The std::basic_string type written to.
+ */
+template <class String>
+class json_writer {
+public:
+    /**
+     * @brief Appends to `out`, which must outlive the writer.
+     */
+    explicit json_writer(String& out) : out_(out) {}
+
+    json_writer& begin_object() { return open('{'); }
+    json_writer& end_object() { return close('}'); }
+    json_writer& begin_array() { return open('['); }
+    json_writer& end_array() { return close(']'); }
+
+    /**
+     * @brief Writes an object key; the next call writes its value.
+     */
+    json_writer& key(std::string_view name)
+    {
+        separate();
+        write_string(name);
+        out_.push_back(':');
+        after_key_ = true;
+        return *this;
+    }
+
+    json_writer& value(std::string_view s)
+    {
+        separate();
+        write_string(s);
+        return *this;
+    }
+
+    json_writer& value(const char* s) { return value(std::string_view(s)); }
+
+    json_writer& value(bool b)
+    {
+        separate();
+        append(b ? std::string_view("true") : std::string_view("false"));
+        return *this;
+    }
+
+    template <class Int, std::enable_if_t<std::is_integral_v<Int> && !std::is_same_v<Int, bool>, int> = 0>
+    json_writer& value(Int n)
+    {
+        separate();
+        char buf[24];
+        auto const end = std::to_chars(buf, buf + sizeof(buf), n).ptr;
+        out_.append(buf, static_cast<std::size_t>(end - buf));
+        return *this;
+    }
+
+    json_writer& value(double d)
+    {
+        if (!std::isfinite(d)) {
+            return null();
+        }
+        separate();
+        char buf[32];
+        auto const end = std::to_chars(buf, buf + sizeof(buf), d).ptr;
+        out_.append(buf, static_cast<std::size_t>(end - buf));
+        return *this;
+    }
+
+    json_writer& null()
+    {
+        separate();
+        append("null");
+        return *this;
+    }
+
+private:
+    json_writer& open(char bracket)
+    {
+        separate();
+        out_.push_back(bracket);
+        ++depth_;
+        first_ |= std::uint64_t{1} << depth_;
+        return *this;
+    }
+
+    json_writer& close(char bracket)
+    {
+        --depth_;
+        out_.push_back(bracket);
+        return *this;
+    }
+
+    /**
+     * @brief Writes the comma before a value or key unless it is the first of its container.
+     */
+    void separate()
+    {
+        if (after_key_) {
+            after_key_ = false;
+            return;
+        }
+        std::uint64_t const bit = std::uint64_t{1} << depth_;
+        if (first_ & bit) {
+            first_ &= ~bit;
+        } else {
+            out_.push_back(',');
+        }
+    }
+
+    void append(std::string_view s) { out_.append(s.data(), s.size()); }
+
+    /**
+     * @brief Writes a quoted, escaped string, copying runs that need no escaping in one append.
+     */
+    void write_string(std::string_view s)
+    {
+        static constexpr char hex[] = "0123456789abcdef";
+        out_.push_back('"');
+        std::size_t run = 0;
+        for (std::size_t i = 0; i < s.size(); ++i) {
+            auto const c = static_cast<unsigned char>(s[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+            out_.append(s.data() + run, i - run);
+            run = i + 1;
+            switch (c) {
+            case '"': append("\\\""); break;
+            case '\\': append("\\\\"); break;
+            case '\n': append("\\n"); break;
+            case '\r': append("\\r"); break;
+            case '\t': append("\\t"); break;
+            case '\b': append("\\b"); break;
+            case '\f': append("\\f"); break;
+            default: {
+                char const escape[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+                out_.append(escape, sizeof(escape));
+            }
+            }
+        }
+        out_.append(s.data() + run, s.size() - run);
+        out_.push_back('"');
+    }
+
+    String& out_;
+    std::uint64_t first_ = 1;  ///< Bit d is set while the container at depth d has no element yet.
+    unsigned depth_ = 0;
+    bool after_key_ = false;
+};
+
+#endif // JSON_WRITER_HPP
@@ -0,0 +1,157 @@
+#ifndef RATE_LIMITER_HPP
+#define RATE_LIMITER_HPP
+
+#include <boost/asio/ip/tcp.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @file rate_limiter.hpp
+ * @brief Per-client token buckets for LLM submissions, status polls and static content.
+ *
+ * Every request is charged to its peer IP address. A request whose X-API-Key
+ * is one of RATE_LIMIT_API_KEYS is also charged to that key, so a key can be
+ * given its own budget but cannot lift its address's; other keys are ignored,
+ * so sending a fresh key per request gains nothing. Each client has one bucket per request class;
+ * a request over budget is answered with 429 Too Many Requests and a
+ * Retry-After header instead of being routed.
+ *
+ * | Variable                | Default | Effect                                        |
+ * |-------------------------|---------|-----------------------------------------------|
+ * | RATE_LIMIT              | 1       | 0 disables rate limiting                      |
+ * | RATE_LIMIT_SUBMIT_RPS   | 0.5     | Sustained LLM submissions per second (POST /) |
+ * | RATE_LIMIT_SUBMIT_BURST | 5       | Submissions allowed back to back              |
+ * | RATE_LIMIT_STATUS_RPS   | 20      | Sustained status polls per second             |
+ * | RATE_LIMIT_STATUS_BURST | 40      | Status polls allowed back to back             |
+ * | RATE_LIMIT_STATIC_RPS   | 200     | Sustained static requests per second          |
+ * | RATE_LIMIT_STATIC_BURST | 400     | Static requests allowed back to back          |
+ * | RATE_LIMIT_SLOTS        | 4096    | Clients tracked at once (rounded up to a power of two) |
+ * | RATE_LIMIT_API_KEYS     | (none)  | Comma-separated X-API-Key values that get their own buckets |
+ *
+ * A rate of 0 leaves that class unlimited.
+ */
+
+/**
+ * @brief The budget a request is charged to.
+ */
+enum class rate_class : std::size_t {
+    submission,  ///< POST / — enqueues an LLM query.
+    status,  ///< Query status polls and statistics.
+    static_content,  ///< Files and everything else.
+    count
+};
+
+/**
+ * @brief Sustained rate and burst of one request class.
+ */
+struct RateBudget {
+    double per_second = 0;  ///< Sustained requests per second; 0 means unlimited.
+    double burst = 1;  ///< Requests allowed back to back.
+};
+
+/**
+ * @brief Rate limiter configuration, read from the environment.
+ */
+struct RateLimits {
+    bool enabled = true;
+    std::array<RateBudget, static_cast<std::size_t>(rate_class::count)> budgets{{
+        {0.5, 5},
+        {20, 40},
+        {200, 400},
+    }};
+    std::size_t slots = 4096;
+    std::vector<std::string> api_keys;  ///< Keys with their own buckets, sorted.
+
+    /**
+     * @brief Returns whether an X-API-Key value is one of api_keys.
+     */
+    bool known_api_key(std::string_view key) const;
+
+    /**
+     * @brief Reads the configuration from the environment.
+     */
+    static RateLimits from_env();
+
+    /**
+     * @brief Returns the configuration read from the environment at first use.
+     */
+    static const RateLimits& get();
+};
+
+/**
+ * @brief Lock-free token buckets keyed by client.
+ *
+ * Each bucket is a single atomic "theoretical arrival time" (the generic cell
+ * rate algorithm), so taking a token is one compare-and-swap and no lock is
+ * ever held. Clients live in a fixed open-addressed table of cache-line sized
+ * slots, so clients on different threads do not share lines. A slot whose
+ * buckets have all refilled is as good as empty and is reused when a probe
+ * finds no free one; if every slot probed is busy the client shares its home
+ * slot, which errs on the side of limiting.
+ */
+class rate_limiter {
+public:
+    using clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Constructs a limiter with the given budgets.
+     *
+     * @param limits The budgets and table size.
+     */
+    explicit rate_limiter(const RateLimits& limits);
+
+    /**
+     * @brief Returns the process-wide limiter, configured from RateLimits::get().
+     */
+    static rate_limiter& instance();
+
+    /**
+     * @brief Takes a token from a client's bucket for the given class.
+     *
+     * @param client The client, from client_id().
+     * @param cls The request class.
+     * @param now The current time.
+     * @return Zero if the request may proceed, otherwise how long until it would.
+     */
+    clock::duration acquire(std::uint64_t client, rate_class cls, clock::time_point now = clock::now());
+
+    /**
+     * @brief Identifies a client by its IP address: IPv4 whole, IPv6 by its /64 prefix.
+     */
+    static std::uint64_t client_id(const boost::asio::ip::address& address);
+
+    /**
+     * @brief Identifies a client by its peer address; clients without one share an id.
+     */
+    static std::uint64_t client_id(const boost::asio::ip::tcp::socket& socket);
+
+    /**
+     * @brief Identifies a client by its API key.
+     */
+    static std::uint64_t client_id(std::string_view api_key);
+
+private:
+    static constexpr std::size_t class_count = static_cast<std::size_t>(rate_class::count);
+    static constexpr std::size_t max_probe = 8;
+
+    struct alignas(64) slot {
+        std::atomic<std::uint64_t> client{0};  // 0 marks a free slot
+        std::array<std::atomic<std::int64_t>, class_count> tat{};  // Theoretical arrival time per class, in ns
+    };
+
+    slot& find(std::uint64_t client, std::int64_t now);
+
+    std::unique_ptr<slot[]> slots_;
+    std::size_t mask_;
+    std::array<std::int64_t, class_count> interval_{};  // ns per token; 0 means unlimited
+    std::array<std::int64_t, class_count> burst_{};  // ns of tokens a full bucket holds
+};
+
+#endif // RATE_LIMITER_HPP
@@ -0,0 +1,112 @@
+#ifndef RESPONSE_PROLOGUE_HPP
+#define RESPONSE_PROLOGUE_HPP
+
+#include "beast.hpp"
+#include <boost/beast/core/static_string.hpp>
+#include <boost/beast/http/field.hpp>
+#include <boost/optional.hpp>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+/**
+ * @file response_prologue.hpp
+ * @brief Response headers written from preserialized blocks.
+ *
+ * Most responses differ only in status, Content-Type, keep-alive, Date and
+ * Content-Length. prologue_fields serializes the first three as one cached
+ * block (status line, Server, Content-Type and, where needed, Connection),
+ * built once per combination and shared by every thread. The Date line comes
+ * from a per-thread buffer that is reformatted at most once a second. Nothing
+ * is inserted into a field list, so building and writing a small JSON response
+ * touches no allocator for its headers.
+ *
+ * Responses that need any other header keep using http::basic_fields.
+ * The one exception is Retry-After, which 429 responses need.
+ */
+
+/**
+ * @brief Returns the current time as an HTTP date, e.g. "Fri, 17 Oct 2026 09:00:00 GMT".
+ *
+ * Formatted at most once a second per thread; the view is valid on the calling
+ * thread until the next call.
+ */
+beast::string_view http_date();
+
+/**
+ * @brief Returns the preserialized status line and fixed headers of a response.
+ *
+ * @param version The HTTP version, 10 or 11.
+ * @param status The status code.
+ * @param content_type The Content-Type value.
+ * @param keep_alive Whether the connection stays open.
+ * @return The block, valid for the life of the process.
+ */
+const std::string& response_prologue(unsigned version, unsigned status, beast::string_view content_type, bool keep_alive);
+
+/**
+ * @brief A Fields type for responses whose only variable headers are Content-Type and Content-Length.
+ *
+ * Use it as the Fields of an http::response and set the Content-Type with
+ * content_type(); keep_alive(), content_length() and prepare_payload() work as
+ * with basic_fields. Requests cannot be serialized with it.
+ */
+class prologue_fields {
+public:
+    class writer;
+
+    /**
+     * @brief Sets the Content-Type; at most 128 characters.
+     */
+    void content_type(beast::string_view value) { content_type_.assign(value.data(), value.size()); }
+
+    beast::string_view content_type() const { return {content_type_.data(), content_type_.size()}; }
+
+    /**
+     * @brief Adds a Retry-After header, in seconds.
+     */
+    void retry_after(std::uint64_t seconds) { retry_after_ = seconds; }
+
+protected:
+    beast::string_view get_method_impl() const { return {}; }
+    beast::string_view get_target_impl() const { return {}; }
+    beast::string_view get_reason_impl() const { return {}; }
+    bool get_chunked_impl() const { return chunked_; }
+    bool get_keep_alive_impl(unsigned version) const { return keep_alive_ ? *keep_alive_ : version >= 11; }
+    bool has_content_length_impl() const { return content_length_.has_value(); }
+    void set_method_impl(beast::string_view) {}
+    void set_target_impl(beast::string_view) {}
+    void set_reason_impl(beast::string_view) {}  // The reason phrase always follows the status
+    void set_chunked_impl(bool value) { chunked_ = value; }
+    void set_content_length_impl(boost::optional<std::uint64_t> const& value)
+    {
+        content_length_ = value ? std::optional<std::uint64_t>(*value) : std::nullopt;
+    }
+    void set_keep_alive_impl(unsigned, bool value) { keep_alive_ = value; }
+
+private:
+    beast::static_string<128> content_type_;
+    std::optional<std::uint64_t> content_length_;
+    std::optional<bool> keep_alive_;
+    std::optional<std::uint64_t> retry_after_;
+    bool chunked_ = false;
+};
+
+/**
+ * @brief Serializes prologue_fields as the shared prologue, then Date, Retry-After, Content-Length and the blank line.
+ */
+class prologue_fields::writer {
+public:
+    using const_buffers_type = std::array<net::const_buffer, 2>;
+
+    writer(prologue_fields const& fields, unsigned version, unsigned status);
+
+    const_buffers_type get() const { return buffers_; }
+
+private:
+    char tail_[136];  // "Date: ...\r\n" + "Retry-After: ...\r\n" + "Content-Length: ...\r\n" or "Transfer-Encoding: chunked\r\n" + "\r\n"
+    const_buffers_type buffers_;
+};
+
+#endif // RESPONSE_PROLOGUE_HPP
@@ -38,6 +38,7 @@ class server : public std::enable_shared_from_this<server>
     std::shared_ptr<std::string const> doc_root_;  ///< Shared pointer to the document root directory.
     std::shared_ptr<Logger> logger_;
     std::shared_ptr<Application> app_;
+    boost::asio::steady_timer reap_timer_;  ///< Periodic check for connection or memory pressure.
 public:
     /**
      * @brief Constructs the server object.
@@ -82,6 +83,20 @@ private:
      * @param socket The socket representing the accepted connection.
      */
     void on_accept(boost::beast::error_code ec, boost::asio::ip::tcp::socket socket);
+
+    /**
+     * @brief Schedules the next check for connection or memory pressure.
+     *
+     * Only runs when REAP_CONNECTIONS or REAP_RSS_MB is set (see session_timeouts.hpp).
+     */
+    void do_reap_check();
+
+    /**
+     * @brief Reaps idle connections if the server is over its connection or memory limit.
+     *
+     * @param ec The result of the timer wait.
+     */
+    void on_reap_check(boost::beast::error_code ec);
 };
 
 #endif // SERVER_HPP
@@ -3,13 +3,38 @@
 
 #include "../../app/include/application.hpp"
 #include "http_tools.hpp"
+#include "arena.hpp"
+#include "session_pool.hpp"
+#include "session_timeouts.hpp"
+#include "../../log/include/alloc_stats.hpp"
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/ssl.hpp>
 #include <boost/asio.hpp>
+#include <array>
+#include <cstdint>
+#include <initializer_list>
 #include <memory>
+#include <optional>
 #include <string>
 
+/// Body of requests read by a session; allocated from the session's arena.
+using session_request_body = boost::beast::http::basic_string_body<char, std::char_traits<char>, arena_allocator<char>>;
+
+/// Requests read by a session; header fields are allocated from the session's arena.
+using session_request = boost::beast::http::request<session_request_body, boost::beast::http::basic_fields<arena_allocator<char>>>;
+
+/// Parser of session requests; reads the header and the body as separate phases with their own deadlines.
+using session_request_parser = boost::beast::http::request_parser<session_request_body, arena_allocator<char>>;
+
+/**
+ * @brief Copies a session request out of the arena, e.g. to hand it to another thread.
+ * 
+ * @param req The request read by a session.
+ * @return The same request using the default allocator.
+ */
+boost::beast::http::request<boost::beast::http::string_body> copy_session_request(session_request const& req);
+
 /**
  * @brief The session class manages an individual HTTP session.
  * 
@@ -19,10 +44,24 @@
 class session : public std::enable_shared_from_this<session>
 {
     boost::beast::ssl_stream<boost::beast::tcp_stream> stream_;  // SSL stream for the session
-    boost::beast::flat_buffer buffer_;  // Buffer for reading requests
     std::shared_ptr<std::string const> doc_root_;  // Document root directory
-    boost::beast::http::request<boost::beast::http::string_body> req_;  // HTTP request object
+    std::uint64_t client_id_;  // Rate limiter id of the peer address
+    pooled_session_buffers buffers_;  // Read buffer and arena, returned to the session pool on destruction
+    std::optional<session_request_parser> parser_;  // Parser of the current HTTP request, allocated from the arena
+    std::array<std::optional<boost::beast::http::message_generator>, 16> responses_;  // Ring of pipelined responses in request order, allocated from the arena
+    std::size_t response_head_ = 0;  // Index in responses_ of the response being written
+    std::size_t response_count_ = 0;  // Number of queued responses
+    std::size_t bytes_written_ = 0;  // Bytes of the front response written so far
+    std::chrono::steady_clock::time_point write_start_;  // When writing the front response began
+    bool reading_ = false;  // Whether a read is in progress
+    bool handler_pending_ = false;  // Whether a request is being handled on the blocking pool
+    bool read_closed_ = false;  // Whether no further requests will be read
+    bool waiting_ = false;  // Whether the session is idle, waiting for the first bytes of a request
+    bool reaped_ = false;  // Whether the idle reaper closed the connection
+    boost::beast::error_code read_error_;  // Error that ended reading, reported once the queue drains
     std::shared_ptr<Application> app_;
+    std::shared_ptr<AllocPhaseTracker> alloc_tracker_;  // Allocation phase tracker; null unless built with ALLOC_STATS
+    idle_reaper::hook reap_hook_;  // Link in the idle reaper; last, so it is unlinked first
 public:
     /**
      * @brief Constructs a session object.
@@ -55,7 +94,8 @@ private:
     /**
      * @brief Handles the SSL handshake completion.
      * 
-     * This method is called when the SSL handshake is complete.
+     * This method is called when the SSL handshake is complete. If ALPN selected
+     * HTTP/2, the connection is handed to an http2_session.
      * 
      * @param ec The error code, if any, from the handshake operation.
      */
@@ -65,9 +105,55 @@ private:
      * @brief Reads an HTTP request from the client.
      * 
      * Initiates an asynchronous read operation to receive the client's HTTP request.
+     * Requests already in the read buffer are parsed from it without reading the socket.
      */
     void do_read();
 
+    /**
+     * @brief Waits, under the idle timeout, for the first bytes of the next request.
+     * 
+     * The connection can be reaped while it waits here.
+     * 
+     * @param read_start_time When reading the request began.
+     */
+    void do_wait(std::chrono::steady_clock::time_point read_start_time);
+
+    /**
+     * @brief Handles the first bytes of a request, or the end of an idle wait.
+     * 
+     * @param ec The error code, if any, from the read operation.
+     * @param bytes_transferred The number of bytes read.
+     * @param read_start_time When reading the request began.
+     */
+    void on_wait(boost::beast::error_code ec, std::size_t bytes_transferred, std::chrono::steady_clock::time_point read_start_time);
+
+    /**
+     * @brief Reads the request header under the header timeout.
+     * 
+     * @param read_start_time When reading the request began.
+     */
+    void do_read_header(std::chrono::steady_clock::time_point read_start_time);
+
+    /**
+     * @brief Reads the request body, if any, under the body timeout and minimum transfer rate.
+     * 
+     * @param ec The error code, if any, from reading the header.
+     * @param bytes_transferred The number of bytes read.
+     * @param read_start_time When reading the request began.
+     */
+    void on_read_header(boost::beast::error_code ec, std::size_t bytes_transferred, std::chrono::steady_clock::time_point read_start_time);
+
+    /**
+     * @brief Returns whether another request may be read while earlier responses are queued.
+     * 
+     * Read-ahead stops when the response queue is full, a blocking handler is pending, or
+     * the arena, which can only be rewound once the queue drains, has grown past its
+     * per-cycle budget. It only parses requests the client has already sent: waiting for
+     * new ones under the idle timeout while a response is written could close the
+     * connection under it.
+     */
+    bool can_read_ahead() const;
+
     /**
      * @brief Handles the completion of the asynchronous read operation.
      * 
@@ -79,16 +165,48 @@ private:
     void on_read(boost::beast::error_code ec, std::size_t bytes_transferred, std::chrono::steady_clock::time_point read_start_time);
 
     /**
-     * @brief Sends an HTTP response to the client.
+     * @brief Handles the current request on the application's blocking pool.
+     * 
+     * The request is copied out of the arena, which keeps being used by this session's
+     * strand, and the response is posted back to the strand. No further requests are read
+     * until it arrives, so responses stay in request order.
+     */
+    void route_blocking();
+
+    /**
+     * @brief Queues the response of a request handled on the blocking pool and resumes reading.
+     * 
+     * @param msg The HTTP response to send.
+     */
+    void on_blocking_response(boost::beast::http::message_generator&& msg);
+
+    /**
+     * @brief Queues an HTTP response to be sent after the responses to earlier requests.
      * 
      * @param msg The HTTP response to send.
      */
     void send_response(boost::beast::http::message_generator&& msg);
 
+    /**
+     * @brief Writes the next part of the response at the front of the queue.
+     */
+    void do_write();
+
+    /**
+     * @brief Handles the completion of a partial write of the current response.
+     * 
+     * Continues writing until the response is complete, then removes it from the queue and calls on_write().
+     * 
+     * @param ec The error code, if any, from the write operation.
+     * @param bytes_transferred The number of bytes transferred by this write.
+     */
+    void on_write_some(boost::beast::error_code ec, std::size_t bytes_transferred);
+
     /**
      * @brief Handles the completion of the asynchronous write operation.
      * 
-     * Determines whether to keep the connection alive or close it.
+     * Determines whether to keep the connection alive or close it, and continues with the
+     * next queued response or the next read.
      * 
      * @param keep_alive Whether to keep the connection alive.
      * @param ec The error code, if any, from the write operation.
@@ -111,6 +229,32 @@ private:
      * @param ec The error code, if any, from the shutdown operation.
      */
     void on_shutdown(boost::beast::error_code ec);
+
+    /**
+     * @brief Asks an idle session to close; called by the idle reaper from any thread.
+     * 
+     * @param owner The session.
+     */
+    static void reap(void* owner);
+
+    /**
+     * @brief Closes the connection if the session is still idle.
+     */
+    void on_reap();
+
+    /**
+     * @brief Charges subsequent allocations to the given phase (ALLOC_STATS build only).
+     * 
+     * @param phase The phase the session is entering.
+     */
+    void enter_phase(AllocPhase phase);
+
+    /**
+     * @brief Records the allocations of the given phases as performance metrics and resets them.
+     * 
+     * @param phases The phases to report.
+     */
+    void report_phases(std::initializer_list<AllocPhase> phases);
 };
 
 #endif // SESSION_HPP
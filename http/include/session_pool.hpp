@@ -0,0 +1,144 @@
+#ifndef SESSION_POOL_HPP
+#define SESSION_POOL_HPP
+
+#include "arena.hpp"
+#include <boost/beast/core/flat_buffer.hpp>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+/**
+ * @file session_pool.hpp
+ * @brief Per-thread recycling of session objects and their buffers.
+ *
+ * Short-lived connections would otherwise allocate a session, grow its read
+ * buffer and arena from nothing, and free all of it again on close. The
+ * server instead allocates sessions through session_allocator and each
+ * session takes its buffers from the session pool; both are handed back to
+ * a free list of the thread that releases them when the connection closes.
+ */
+
+/**
+ * @brief The buffers a session reuses across requests and, through the pool, across connections.
+ */
+struct session_buffers {
+    static constexpr std::size_t read_buffer_size = 8 * 1024;  ///< Initial capacity of read_buffer.
+    static constexpr std::size_t arena_size = 16 * 1024;       ///< Initial size of the arena.
+
+    boost::beast::flat_buffer read_buffer;  ///< Buffer for reading requests.
+    arena request_arena{arena_size};        ///< Arena for a request, its response and their I/O operations.
+
+    /**
+     * @brief Deleter that returns the buffers to the pool instead of freeing them.
+     */
+    struct recycle {
+        void operator()(session_buffers* buffers) const noexcept;
+    };
+};
+
+/// Buffers owned by a session until it is destroyed.
+using pooled_session_buffers = std::unique_ptr<session_buffers, session_buffers::recycle>;
+
+/**
+ * @brief Takes a set of buffers from the calling thread's free list, or creates pre-sized ones.
+ *
+ * The returned buffers are empty and their arena has been reset.
+ */
+pooled_session_buffers acquire_session_buffers();
+
+/**
+ * @brief Fixed-size block cache shared by all session_allocator instances of one thread.
+ *
+ * Holds at most `max_cached` blocks of `Size` bytes; further blocks go back to
+ * the heap.
+ *
+ * @tparam Size Size of the cached blocks.
+ */
+template <std::size_t Size>
+class session_block_cache {
+public:
+    static constexpr std::size_t max_cached = 64;
+
+    ~session_block_cache()
+    {
+        for (void* block : blocks_) {
+            ::operator delete(block);
+        }
+    }
+
+    void* allocate()
+    {
+        if (blocks_.empty()) {
+            return ::operator new(Size);
+        }
+        void* block = blocks_.back();
+        blocks_.pop_back();
+        return block;
+    }
+
+    void deallocate(void* block) noexcept
+    {
+        if (blocks_.size() < max_cached) {
+            blocks_.push_back(block);  // Capacity is reserved up front; doesn't throw
+        } else {
+            ::operator delete(block);
+        }
+    }
+
+    static session_block_cache& local()
+    {
+        thread_local session_block_cache cache;
+        return cache;
+    }
+
+private:
+    session_block_cache() { blocks_.reserve(max_cached); }
+
+    std::vector<void*> blocks_;
+};
+
+/**
+ * @brief Allocator for std::allocate_shared<session> that recycles the session's memory.
+ *
+ * Single-object allocations come from the thread's session_block_cache; the
+ * memory of a closed session is reused for the next one accepted on the same
+ * thread. Alignment beyond the default new alignment is not supported.
+ */
+template <class T>
+class session_allocator {
+public:
+    using value_type = T;
+
+    static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "session_allocator only supports default alignment");
+
+    session_allocator() noexcept = default;
+
+    template <class U>
+    session_allocator(const session_allocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n)
+    {
+        if (n != 1) {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T*>(session_block_cache<sizeof(T)>::local().allocate());
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        if (n != 1) {
+            ::operator delete(p);
+            return;
+        }
+        session_block_cache<sizeof(T)>::local().deallocate(p);
+    }
+
+    template <class U>
+    friend bool operator==(const session_allocator&, const session_allocator<U>&) noexcept { return true; }
+
+    template <class U>
+    friend bool operator!=(const session_allocator&, const session_allocator<U>&) noexcept { return false; }
+};
+
+#endif // SESSION_POOL_HPP
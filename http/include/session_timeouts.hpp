@@ -0,0 +1,154 @@
+#ifndef SESSION_TIMEOUTS_HPP
+#define SESSION_TIMEOUTS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * @file session_timeouts.hpp
+ * @brief Per-phase connection timeouts and the idle-connection reaper.
+ *
+ * Each phase of a connection gets its own deadline instead of one blanket
+ * timeout, so an idle keep-alive connection or a client trickling in its
+ * headers gives up its socket and TLS state quickly, while a large upload or
+ * download still has the time it needs. Body reads and response writes must
+ * also keep up a minimum transfer rate: their deadline is the base timeout
+ * plus the time the transfer takes at that rate.
+ *
+ * | Variable          | Default | Effect                                                  |
+ * |-------------------|---------|---------------------------------------------------------|
+ * | HANDSHAKE_TIMEOUT | 10      | Seconds to complete the TLS handshake                   |
+ * | HEADER_TIMEOUT    | 10      | Seconds from the first byte of a request to its last header |
+ * | BODY_TIMEOUT      | 10      | Base seconds to read a request body                     |
+ * | IDLE_TIMEOUT      | 15      | Seconds a keep-alive connection may wait for a request  |
+ * | WRITE_TIMEOUT     | 10      | Base seconds to write a response                        |
+ * | SHUTDOWN_TIMEOUT  | 5       | Seconds to complete the TLS shutdown                    |
+ * | MIN_TRANSFER_RATE | 4096    | Bytes per second a body or response must move at; 0 disables |
+ * | REAP_CONNECTIONS  | 0       | Open connections above which idle ones are reaped; 0 disables |
+ * | REAP_RSS_MB       | 0       | Resident memory above which idle ones are reaped; 0 disables |
+ */
+
+/**
+ * @brief Deadlines for each phase of a connection, read from the environment.
+ */
+struct SessionTimeouts {
+    using duration = std::chrono::steady_clock::duration;
+
+    duration handshake = std::chrono::seconds(10);  ///< TLS handshake.
+    duration header = std::chrono::seconds(10);  ///< From the first byte of a request to the end of its header.
+    duration body = std::chrono::seconds(10);  ///< Base allowance for reading a request body.
+    duration idle = std::chrono::seconds(15);  ///< Waiting for the next request on a keep-alive connection.
+    duration write = std::chrono::seconds(10);  ///< Base allowance for writing a response.
+    duration shutdown = std::chrono::seconds(5);  ///< TLS shutdown.
+    std::uint64_t min_transfer_rate = 4096;  ///< Bytes per second; 0 disables the rate allowance.
+    std::size_t reap_connections = 0;  ///< Open connections above which idle ones are reaped; 0 disables.
+    std::size_t reap_rss_bytes = 0;  ///< Resident set size above which idle ones are reaped; 0 disables.
+
+    /**
+     * @brief Returns the time allowed to transfer a body of the given size.
+     *
+     * @param base The base timeout of the phase.
+     * @param bytes The size of the body.
+     */
+    duration with_transfer(duration base, std::uint64_t bytes) const;
+
+    /**
+     * @brief Reads the timeouts from the environment.
+     */
+    static SessionTimeouts from_env();
+
+    /**
+     * @brief Returns the timeouts read from the environment at first use.
+     */
+    static const SessionTimeouts& get();
+};
+
+/**
+ * @brief Tracks open connections and closes idle ones when the server is short of memory.
+ *
+ * Connections link themselves into the reaper once, when they start, and flag
+ * themselves idle while they wait for the next request, or for HTTP/2 while
+ * no stream is open; that flag is the only per-request cost. An HTTP/1.1
+ * session that hands its connection over to HTTP/2 unlinks as it ends, and the
+ * HTTP/2 session links in its place. The server checks for pressure periodically and asks the
+ * idle connections to close, oldest first, until it is relieved.
+ */
+class idle_reaper {
+public:
+    /**
+     * @brief A connection's link in the reaper.
+     *
+     * Links itself in on construction and out on destruction. Declare it as the
+     * owner's last member, so it is unlinked before the rest of the owner goes.
+     */
+    class hook {
+    public:
+        /**
+         * @brief Asks the owner to close if it is still idle.
+         *
+         * Called with the reaper's lock held, from any thread, possibly while the
+         * owner is being destroyed: it should only take a weak reference and post
+         * the close to the owner's executor, moving that reference into the handler.
+         * It must never release the last reference itself, since the owner's
+         * destructor unlinks the hook and would take the lock again.
+         */
+        using reap_fn = void (*)(void* owner);
+
+        hook(reap_fn reap, void* owner);
+        ~hook();
+
+        hook(const hook&) = delete;
+        hook& operator=(const hook&) = delete;
+
+        /**
+         * @brief Marks the connection as waiting for a request, or not.
+         */
+        void set_idle(bool idle) { idle_.store(idle, std::memory_order_relaxed); }
+
+    private:
+        friend class idle_reaper;
+
+        reap_fn reap_;
+        void* owner_;
+        hook* prev_ = nullptr;
+        hook* next_ = nullptr;
+        std::atomic<bool> idle_{false};
+    };
+
+    /**
+     * @brief Returns the process-wide reaper.
+     */
+    static idle_reaper& instance();
+
+    /**
+     * @brief Returns the number of open connections.
+     */
+    std::size_t connections() const;
+
+    /**
+     * @brief Reaps idle connections if a limit in the given timeouts is exceeded.
+     *
+     * @param timeouts Holds the connection and memory limits.
+     * @return The number of connections asked to close.
+     */
+    std::size_t reap_if_pressured(const SessionTimeouts& timeouts);
+
+private:
+    void link(hook& h);
+    void unlink(hook& h);
+
+    mutable std::mutex mutex_;
+    hook* head_ = nullptr;  // Oldest connection
+    hook* tail_ = nullptr;  // Newest connection
+    std::size_t count_ = 0;
+};
+
+/**
+ * @brief Returns the resident set size of the process in bytes, or 0 if unknown.
+ */
+std::size_t resident_memory_bytes();
+
+#endif // SESSION_TIMEOUTS_HPP
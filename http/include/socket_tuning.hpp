@@ -0,0 +1,84 @@
+#ifndef SOCKET_TUNING_HPP
+#define SOCKET_TUNING_HPP
+
+#include <boost/asio/ip/tcp.hpp>
+
+/**
+ * @file socket_tuning.hpp
+ * @brief Configurable TCP options for the listener, accepted and outbound sockets.
+ *
+ * Every option is read from the environment (or the .env file loaded at
+ * startup), so the bench target can measure them one at a time, e.g.
+ * `TCP_NOTSENT_LOWAT=16384 make bench`; `make bench-sockets` compares each
+ * against the defaults. Unset options keep the kernel
+ * defaults, except TCP_NODELAY, which is on unless set to 0.
+ *
+ * | Variable          | Applies to          | Effect                                          |
+ * |-------------------|---------------------|-------------------------------------------------|
+ * | TCP_NODELAY       | connections         | 0 re-enables Nagle's algorithm                  |
+ * | TCP_DEFER_ACCEPT  | listener            | Seconds to wait for the first bytes before accept |
+ * | TCP_FASTOPEN      | listener            | Fast Open queue length                          |
+ * | SOCKET_RCVBUF     | listener, outbound  | SO_RCVBUF in bytes                              |
+ * | SOCKET_SNDBUF     | listener, outbound  | SO_SNDBUF in bytes                              |
+ * | SOCKET_BUSY_POLL  | connections         | SO_BUSY_POLL in microseconds                    |
+ * | TCP_NOTSENT_LOWAT | connections         | Unsent bytes kept in the kernel while streaming |
+ * | LISTEN_BACKLOG    | listener            | listen() backlog                                |
+ *
+ * Buffer sizes are set on the listener because accepted sockets inherit them
+ * from it, in time for the window scale negotiated in the handshake.
+ */
+
+/**
+ * @brief TCP options applied by the server and the outbound HTTP client.
+ *
+ * Zero means "leave the kernel default".
+ */
+struct SocketTuning {
+    bool nodelay = true;  ///< TCP_NODELAY on connections.
+    int defer_accept = 0;  ///< TCP_DEFER_ACCEPT on the listener, in seconds.
+    int fastopen = 0;  ///< TCP_FASTOPEN queue length on the listener.
+    int rcvbuf = 0;  ///< SO_RCVBUF in bytes.
+    int sndbuf = 0;  ///< SO_SNDBUF in bytes.
+    int busy_poll = 0;  ///< SO_BUSY_POLL on connections, in microseconds.
+    int notsent_lowat = 0;  ///< TCP_NOTSENT_LOWAT on connections, in bytes.
+    int backlog = boost::asio::socket_base::max_listen_connections;  ///< listen() backlog.
+
+    /**
+     * @brief Reads the options from the environment.
+     */
+    static SocketTuning from_env();
+
+    /**
+     * @brief Returns the options read from the environment at first use.
+     */
+    static const SocketTuning& get();
+};
+
+/**
+ * @brief Applies the listener options to an open acceptor that is not yet listening.
+ *
+ * Failures are logged and otherwise ignored; an unsupported option should not
+ * keep the server from starting.
+ *
+ * @param acceptor The acceptor.
+ * @param tuning The options to apply.
+ */
+void apply_listener_options(boost::asio::ip::tcp::acceptor& acceptor, const SocketTuning& tuning);
+
+/**
+ * @brief Applies the per-connection options to an accepted socket.
+ *
+ * @param socket The accepted socket.
+ * @param tuning The options to apply.
+ */
+void apply_connection_options(boost::asio::ip::tcp::socket& socket, const SocketTuning& tuning);
+
+/**
+ * @brief Applies the per-connection options and buffer sizes to a connected outbound socket.
+ *
+ * @param socket The connected socket.
+ * @param tuning The options to apply.
+ */
+void apply_outbound_options(boost::asio::ip::tcp::socket& socket, const SocketTuning& tuning);
+
+#endif // SOCKET_TUNING_HPP
@@ -0,0 +1,101 @@
+#include "../include/arena.hpp"
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * @brief Constructs an arena; no memory is allocated until first use.
+ *
+ * @param initial_size Size of the first block.
+ * @param max_retained Capacity above which reset() gives memory back instead of keeping it.
+ */
+arena::arena(std::size_t initial_size, std::size_t max_retained) noexcept
+    : initial_size_(initial_size)
+    , max_retained_(max_retained)
+{
+}
+
+/**
+ * @brief Allocates `size` bytes aligned to `alignment`.
+ */
+void* arena::allocate(std::size_t size, std::size_t alignment)
+{
+    for (;;) {
+        if (current_ < blocks_.size()) {
+            auto& b = blocks_[current_];
+            auto const base = reinterpret_cast<std::uintptr_t>(b.data.get());
+            auto const aligned = (base + offset_ + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1);
+            auto const start = static_cast<std::size_t>(aligned - base);
+            if (start + size <= b.size) {
+                offset_ = start + size;
+                return b.data.get() + start;
+            }
+        }
+        next_block(size + alignment);
+    }
+}
+
+/**
+ * @brief Makes all memory available again.
+ */
+void arena::reset() noexcept
+{
+    if (capacity_ > max_retained_) {
+        // An unusually large request; don't pin its memory for the rest of the connection.
+        blocks_.clear();
+        capacity_ = 0;
+    } else if (blocks_.size() > 1 && current_ > 0) {
+        // Coalesce so that the next cycle is served from one block.
+        auto const total = capacity_;
+        blocks_.clear();
+        capacity_ = 0;
+        try {
+            blocks_.push_back({std::unique_ptr<std::byte[]>(new std::byte[total]), total});
+            capacity_ = total;
+        } catch (const std::bad_alloc&) {
+            // Start over with lazily allocated blocks.
+        }
+    }
+    current_ = 0;
+    offset_ = 0;
+}
+
+/**
+ * @brief Returns the number of bytes handed out since the last reset, including padding.
+ */
+std::size_t arena::size() const noexcept
+{
+    std::size_t used = offset_;
+    for (std::size_t i = 0; i < current_ && i < blocks_.size(); ++i) {
+        used += blocks_[i].size;
+    }
+    return used;
+}
+
+/**
+ * @brief Makes sure the first block holds at least `size` bytes.
+ */
+void arena::reserve(std::size_t size)
+{
+    if (blocks_.empty()) {
+        next_block(size);
+    }
+}
+
+/**
+ * @brief Moves to the next held block, or allocates one of at least `min_size` bytes.
+ */
+void arena::next_block(std::size_t min_size)
+{
+    if (current_ + 1 < blocks_.size()) {
+        ++current_;
+        offset_ = 0;
+        return;
+    }
+
+    // Grow geometrically so a cycle needs few blocks before coalescing.
+    auto const size = std::max({min_size, initial_size_, capacity_});
+    blocks_.push_back({std::unique_ptr<std::byte[]>(new std::byte[size]), size});
+    capacity_ += size;
+    current_ = blocks_.size() - 1;
+    offset_ = 0;
+}
@@ -1,5 +1,6 @@
 #include "../include/client.hpp"
 #include "../include/root_certificate.hpp"
+#include "../include/socket_tuning.hpp"
 #include <iostream>
 
 /**
@@ -91,6 +92,7 @@ std::string Client::send_request(const std::string& host, const std::string& por
         logger_->log(LogLevel::DEBUG, "Connecting to resolved address.");
         // Connect to the resolved IP address
         beast::get_lowest_layer(stream).connect(results);
+        apply_outbound_options(beast::get_lowest_layer(stream).socket(), SocketTuning::get());
 
         logger_->log(LogLevel::DEBUG, "Performing SSL handshake.");
         // Perform the SSL handshake
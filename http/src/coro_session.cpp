@@ -0,0 +1,246 @@
+#include "../include/coro_session.hpp"
+
+#ifdef MMLBEAST_COROUTINE_SESSION
+
+#include "../include/session.hpp"
+#include "../include/http_tools.hpp"
+#include "../include/http2_session.hpp"
+#include "../include/session_pool.hpp"
+#include "../include/session_timeouts.hpp"
+#include "../include/rate_limiter.hpp"
+#include "../include/utils.hpp"
+#include "../include/alloc_phase_executor.hpp"
+#include "../../log/include/log.hpp"
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/bind_allocator.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/recycling_allocator.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <initializer_list>
+#include <optional>
+
+namespace {
+
+/**
+ * @brief Charges a connection's allocations to its phases (ALLOC_STATS build only).
+ *
+ * The coroutine counterpart of session::enter_phase() and session::report_phases().
+ */
+class phase_reporter {
+public:
+    phase_reporter(std::shared_ptr<AllocPhaseTracker> tracker, std::shared_ptr<Application> app)
+        : tracker_(std::move(tracker))
+        , app_(std::move(app))
+    {
+    }
+
+    void enter(AllocPhase phase)
+    {
+        if (tracker_) {
+            tracker_->enter(phase);
+        }
+    }
+
+    void report(std::initializer_list<AllocPhase> phases)
+    {
+        if (!tracker_) {
+            return;
+        }
+
+        tracker_->enter(AllocPhase::other);
+        for (auto phase : phases) {
+            app_->log_allocation_metric(alloc_phase_name(phase), tracker_->take(phase));
+        }
+    }
+
+private:
+    std::shared_ptr<AllocPhaseTracker> tracker_;
+    std::shared_ptr<Application> app_;
+};
+
+/**
+ * @brief Routes a request, running blocking handlers on the application's blocking pool.
+ *
+ * Requests over the client's rate limit are answered with 429 instead.
+ *
+ * Resumes on the connection's strand either way.
+ */
+net::awaitable<http::message_generator> route(
+    session_request& req,
+    std::uint64_t client_id,
+    std::shared_ptr<std::string const> const& doc_root,
+    std::shared_ptr<Application> const& app)
+{
+    // Requests over the client's budget are answered without being routed
+    if (auto limited = check_rate_limit(req, client_id)) {
+        co_return std::move(*limited);
+    }
+
+    if (!is_blocking_request(req)) {
+        co_return handle_request(*doc_root, std::move(req), app);
+    }
+
+    // The arena is only used from the strand; give the pool its own copy.
+    std::optional<http::message_generator> msg;
+    co_await net::co_spawn(
+            app->blocking_executor(),
+            [&msg, &doc_root, &app, copy = copy_session_request(req)]() mutable -> net::awaitable<void> {
+                msg.emplace(handle_request(*doc_root, std::move(copy), app));
+                co_return;
+            },
+            net::use_awaitable);
+    co_return std::move(*msg);
+}
+
+/**
+ * @brief The session loop of one connection.
+ */
+net::awaitable<void> serve(
+    beast::ssl_stream<beast::tcp_stream> stream,
+    std::shared_ptr<std::string const> doc_root,
+    std::shared_ptr<Application> app)
+{
+    auto logger = LoggerManager::getLogger("session_logger");
+    phase_reporter phases(alloc_phase_tracker(stream.get_executor()), app);
+    auto const& timeouts = SessionTimeouts::get();
+    auto const client_id = rate_limiter::client_id(beast::get_lowest_layer(stream).socket());
+    beast::error_code ec;
+
+    phases.enter(AllocPhase::handshake);
+    beast::get_lowest_layer(stream).expires_after(timeouts.handshake);
+    co_await stream.async_handshake(ssl::stream_base::server, net::redirect_error(net::use_awaitable, ec));
+    if (ec) {
+        logger->log(LogLevel::ERROR, "Handshake failed: " + ec.message());
+        fail(ec, "handshake");
+        co_return;
+    }
+    phases.report({AllocPhase::accept, AllocPhase::handshake});
+
+    if (negotiated_http2(stream)) {
+        logger->log(LogLevel::DEBUG, "ALPN selected h2, switching to HTTP/2.");
+        std::make_shared<http2_session>(std::move(stream), doc_root, app)->run();
+        co_return;
+    }
+
+    auto buffers = acquire_session_buffers();
+    auto& request_arena = buffers->request_arena;
+    std::optional<session_request_parser> parser;
+
+    for (;;) {
+        phases.enter(AllocPhase::read);
+
+        // The previous request and response are gone, so the arena can be rewound.
+        parser.reset();
+        request_arena.reset();
+        parser.emplace(
+                std::piecewise_construct,
+                std::make_tuple(arena_allocator<char>(request_arena)),
+                std::make_tuple(arena_allocator<char>(request_arena)));
+
+        // Wait for the first bytes of the request under the idle timeout
+        if (buffers->read_buffer.size() == 0) {
+            beast::get_lowest_layer(stream).expires_after(timeouts.idle);
+            auto const n = co_await stream.async_read_some(
+                    buffers->read_buffer.prepare(512), net::redirect_error(net::use_awaitable, ec));
+            buffers->read_buffer.commit(n);
+            if (ec == beast::error::timeout) {
+                logger->log(LogLevel::DEBUG, "Idle connection timed out.");
+                co_return;
+            }
+            if (ec == net::error::eof || ec == ssl::error::stream_truncated) {
+                ec = http::error::end_of_stream;
+            }
+        }
+
+        if (!ec) {
+            beast::get_lowest_layer(stream).expires_after(timeouts.header);
+            co_await http::async_read_header(stream, buffers->read_buffer, *parser, net::redirect_error(net::use_awaitable, ec));
+        }
+        if (!ec && !parser->is_done()) {
+            constexpr std::uint64_t max_request_body = 1024 * 1024;
+            beast::get_lowest_layer(stream).expires_after(
+                    timeouts.with_transfer(timeouts.body, parser->content_length().value_or(max_request_body)));
+            co_await http::async_read(stream, buffers->read_buffer, *parser, net::redirect_error(net::use_awaitable, ec));
+        }
+        if (ec == http::error::end_of_stream) {
+            logger->log(LogLevel::DEBUG, "End of stream detected, closing session.");
+            break;
+        }
+        if (ec) {
+            logger->log(LogLevel::ERROR, "Error reading request: " + ec.message());
+            fail(ec, "read");
+            co_return;
+        }
+
+        phases.enter(AllocPhase::route);
+        auto msg = co_await route(parser->get(), client_id, doc_root, app);
+
+        phases.enter(AllocPhase::write);
+        bool const keep_alive = msg.keep_alive();
+        // The response size is not known up front, so only the base write timeout applies.
+        beast::get_lowest_layer(stream).expires_after(timeouts.write);
+        // async_write owns the response and destroys it before completing, ahead of the next reset.
+        co_await beast::async_write(stream, std::move(msg), net::redirect_error(net::use_awaitable, ec));
+        if (ec) {
+            logger->log(LogLevel::ERROR, "Error writing response: " + ec.message());
+            fail(ec, "write");
+            co_return;
+        }
+        phases.report({AllocPhase::read, AllocPhase::route, AllocPhase::write});
+
+        if (!keep_alive) {
+            logger->log(LogLevel::DEBUG, "Connection will be closed.");
+            break;
+        }
+    }
+
+    beast::get_lowest_layer(stream).expires_after(timeouts.shutdown);
+    co_await stream.async_shutdown(net::redirect_error(net::use_awaitable, ec));
+    if (ec) {
+        logger->log(LogLevel::ERROR, "Error during shutdown: " + ec.message());
+        fail(ec, "shutdown");
+        co_return;
+    }
+    logger->log(LogLevel::DEBUG, "Shutdown completed.");
+}
+
+} // namespace
+
+/**
+ * @brief Serves an accepted connection with the coroutine session loop.
+ *
+ * @param socket The accepted socket; its executor is the connection's strand.
+ * @param ctx The SSL context for managing SSL connections.
+ * @param doc_root The document root directory for serving files.
+ * @param app Shared pointer to the application instance.
+ */
+void run_coro_session(
+    tcp::socket&& socket,
+    ssl::context& ctx,
+    std::shared_ptr<std::string const> const& doc_root,
+    std::shared_ptr<Application> app)
+{
+    auto const executor = socket.get_executor();
+    net::co_spawn(
+            executor,
+            serve(beast::ssl_stream<beast::tcp_stream>(std::move(socket), ctx), doc_root, std::move(app)),
+            net::bind_allocator(
+                net::recycling_allocator<void>(),
+                [](std::exception_ptr e) {
+                    if (!e) {
+                        return;
+                    }
+                    try {
+                        std::rethrow_exception(e);
+                    } catch (const std::exception& ex) {
+                        auto logger = LoggerManager::getLogger("session_logger");
+                        logger->log(LogLevel::ERROR, "Session terminated by exception: " + std::string(ex.what()));
+                    } catch (...) {
+                        auto logger = LoggerManager::getLogger("session_logger");
+                        logger->log(LogLevel::ERROR, "Session terminated by unknown exception.");
+                    }
+                }));
+}
+
+#endif // MMLBEAST_COROUTINE_SESSION
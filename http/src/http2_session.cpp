@@ -0,0 +1,651 @@
+#include "../include/http2_session.hpp"
+#include "../include/http_tools.hpp"
+#include "../include/session_timeouts.hpp"
+#include "../include/rate_limiter.hpp"
+#include "../include/utils.hpp"
+#include "../../log/include/log.hpp"
+#include <openssl/ssl.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+/// Streams a client may open concurrently.
+constexpr std::uint32_t max_concurrent_streams = 100;
+
+/// Frames collected into one TLS write.
+constexpr std::size_t max_write_size = 64 * 1024;
+
+/// Largest request body accepted on a stream, as for HTTP/1.1.
+constexpr std::size_t max_request_body = 1024 * 1024;
+
+/// Protocols the server accepts, in ALPN wire format and order of preference.
+constexpr unsigned char alpn_protocols[] = {
+    2, 'h', '2',
+    8, 'h', 't', 't', 'p', '/', '1', '.', '1',
+};
+
+/**
+ * @brief Selects "h2" if the client offers it, otherwise "http/1.1".
+ */
+int select_alpn(SSL*, const unsigned char** out, unsigned char* outlen,
+                const unsigned char* in, unsigned int inlen, void*)
+{
+    unsigned char* selected = nullptr;
+    if (SSL_select_next_proto(&selected, outlen, alpn_protocols, sizeof(alpn_protocols), in, inlen)
+            != OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_NOACK;  // Carry on without ALPN; the session speaks HTTP/1.1
+    }
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+/**
+ * @brief Returns whether a header may be forwarded on an HTTP/2 stream (RFC 9113, 8.2.2).
+ */
+bool is_http2_header(http::field name)
+{
+    switch (name) {
+    case http::field::connection:
+    case http::field::keep_alive:
+    case http::field::proxy_connection:
+    case http::field::transfer_encoding:
+    case http::field::upgrade:
+        return false;
+    default:
+        return true;
+    }
+}
+
+/**
+ * @brief Makes an nghttp2 header entry that refers to `name` and `value` without copying.
+ */
+nghttp2_nv make_nv(beast::string_view name, beast::string_view value)
+{
+    return {
+        reinterpret_cast<std::uint8_t*>(const_cast<char*>(name.data())),
+        reinterpret_cast<std::uint8_t*>(const_cast<char*>(value.data())),
+        name.size(),
+        value.size(),
+        NGHTTP2_NV_FLAG_NONE};
+}
+
+} // namespace
+
+/**
+ * @brief Registers an ALPN selection callback that prefers "h2" over "http/1.1".
+ *
+ * @param ctx The server's SSL context.
+ */
+void enable_http2_alpn(ssl::context& ctx)
+{
+    SSL_CTX_set_alpn_select_cb(ctx.native_handle(), select_alpn, nullptr);
+}
+
+/**
+ * @brief Returns whether ALPN selected HTTP/2 for the given stream.
+ *
+ * @param stream A stream whose handshake has completed.
+ */
+bool negotiated_http2(beast::ssl_stream<beast::tcp_stream>& stream)
+{
+    const unsigned char* protocol = nullptr;
+    unsigned int length = 0;
+    SSL_get0_alpn_selected(stream.native_handle(), &protocol, &length);
+    return length == std::strlen(http2_alpn_id) && std::memcmp(protocol, http2_alpn_id, length) == 0;
+}
+
+/**
+ * @brief Constructs an HTTP/2 session on a stream whose handshake selected "h2".
+ *
+ * @param stream The SSL stream.
+ * @param doc_root The document root directory for serving files.
+ * @param app Shared pointer to the application instance.
+ */
+http2_session::http2_session(
+        beast::ssl_stream<beast::tcp_stream>&& stream,
+        std::shared_ptr<std::string const> const& doc_root,
+        std::shared_ptr<Application> app)
+    : stream_(std::move(stream))
+    , doc_root_(doc_root)
+    , client_id_(rate_limiter::client_id(beast::get_lowest_layer(stream_).socket()))
+    , app_(app)
+    , reap_hook_(&http2_session::reap, this)
+{
+    nghttp2_session_callbacks* callbacks = nullptr;
+    nghttp2_session_callbacks_new(&callbacks);
+    nghttp2_session_callbacks_set_on_begin_headers_callback(callbacks, &http2_session::on_begin_headers);
+    nghttp2_session_callbacks_set_on_header_callback(callbacks, &http2_session::on_header);
+    nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, &http2_session::on_data_chunk_recv);
+    nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, &http2_session::on_frame_recv);
+    nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, &http2_session::on_stream_close);
+    int const rv = nghttp2_session_server_new(&session_, callbacks, this);
+    nghttp2_session_callbacks_del(callbacks);
+    if (rv != 0) {
+        throw std::runtime_error(std::string("nghttp2_session_server_new: ") + nghttp2_strerror(rv));
+    }
+
+    write_buffer_.reserve(max_write_size);
+
+    auto logger = LoggerManager::getLogger("http2_session_logger", LogLevel::INFO);
+    logger->log(LogLevel::DEBUG, "HTTP/2 session created.");
+}
+
+http2_session::~http2_session()
+{
+    nghttp2_session_del(session_);
+}
+
+/**
+ * @brief Sends the server's SETTINGS frame and starts reading frames.
+ */
+void http2_session::run()
+{
+    nghttp2_settings_entry const settings[] = {
+        {NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, max_concurrent_streams},
+    };
+    nghttp2_submit_settings(session_, NGHTTP2_FLAG_NONE, settings, std::size(settings));
+    reap_hook_.set_idle(true);
+
+    do_write();
+    do_read();
+}
+
+/**
+ * @brief Reads the next chunk of frames from the client.
+ */
+void http2_session::do_read()
+{
+    // An HTTP/2 connection is long-lived; this only drops clients that go quiet.
+    beast::get_lowest_layer(stream_).expires_after(SessionTimeouts::get().idle);
+
+    stream_.async_read_some(
+            net::buffer(read_buffer_),
+            beast::bind_front_handler(
+                &http2_session::on_read,
+                shared_from_this()));
+}
+
+/**
+ * @brief Passes the bytes read to nghttp2 and writes whatever it has to send.
+ *
+ * @param ec The error code, if any, from the read operation.
+ * @param bytes_transferred The number of bytes read.
+ */
+void http2_session::on_read(beast::error_code ec, std::size_t bytes_transferred)
+{
+    auto logger = LoggerManager::getLogger("http2_session_logger");
+
+    if (ec) {
+        if (reaped_) {
+            return;  // on_reap's GOAWAY is out and the socket closed
+        }
+        if (ec != net::error::eof && ec != net::ssl::error::stream_truncated) {
+            logger->log(LogLevel::ERROR, "Error reading frames: " + ec.message());
+        }
+        return fail(ec, "http2 read");
+    }
+
+    auto const rv = nghttp2_session_mem_recv(
+            session_, reinterpret_cast<const std::uint8_t*>(read_buffer_.data()), bytes_transferred);
+    if (rv < 0) {
+        logger->log(LogLevel::ERROR, std::string("Invalid HTTP/2 input: ") + nghttp2_strerror(static_cast<int>(rv)));
+        // nghttp2 has queued a GOAWAY for protocol errors; send it before closing.
+    }
+
+    do_write();
+
+    if (rv >= 0 && nghttp2_session_want_read(session_)) {
+        do_read();
+    }
+}
+
+/**
+ * @brief Writes the frames nghttp2 has queued, unless a write is already in progress.
+ *
+ * Closes the connection once nghttp2 neither wants to read nor write.
+ */
+void http2_session::do_write()
+{
+    if (writing_ || closing_) {
+        return;
+    }
+
+    write_buffer_.clear();
+    while (write_buffer_.size() < max_write_size) {
+        const std::uint8_t* data = nullptr;
+        auto const n = nghttp2_session_mem_send(session_, &data);
+        if (n < 0) {
+            auto logger = LoggerManager::getLogger("http2_session_logger");
+            logger->log(LogLevel::ERROR, std::string("Error serializing frames: ") + nghttp2_strerror(static_cast<int>(n)));
+            return do_close();
+        }
+        if (n == 0) {
+            break;
+        }
+        write_buffer_.insert(write_buffer_.end(), data, data + n);
+    }
+
+    if (write_buffer_.empty()) {
+        if (!nghttp2_session_want_read(session_) && !nghttp2_session_want_write(session_)) {
+            do_close();
+        }
+        return;
+    }
+
+    // Only the write timer is set; the read for the next frames is always pending.
+    auto const& timeouts = SessionTimeouts::get();
+    beast::get_lowest_layer(stream_).expires_after(timeouts.with_transfer(timeouts.write, write_buffer_.size()));
+
+    writing_ = true;
+    net::async_write(
+            stream_,
+            net::buffer(write_buffer_),
+            beast::bind_front_handler(
+                &http2_session::on_write,
+                shared_from_this()));
+}
+
+/**
+ * @brief Handles the completion of a write and continues with the next frames.
+ *
+ * @param ec The error code, if any, from the write operation.
+ * @param bytes_transferred The number of bytes written.
+ */
+void http2_session::on_write(beast::error_code ec, std::size_t bytes_transferred)
+{
+    boost::ignore_unused(bytes_transferred);
+    writing_ = false;
+
+    if (ec) {
+        auto logger = LoggerManager::getLogger("http2_session_logger");
+        logger->log(LogLevel::ERROR, "Error writing frames: " + ec.message());
+        return fail(ec, "http2 write");
+    }
+
+    do_write();
+}
+
+/**
+ * @brief Shuts down TLS and closes the connection.
+ */
+void http2_session::do_close()
+{
+    if (closing_) {
+        return;
+    }
+    closing_ = true;
+
+    auto logger = LoggerManager::getLogger("http2_session_logger");
+    logger->log(LogLevel::DEBUG, "Closing HTTP/2 session.");
+
+    if (reaped_) {
+        // The point is to free the connection now, so no waiting for the client's close_notify.
+        beast::get_lowest_layer(stream_).close();
+        return;
+    }
+
+    beast::get_lowest_layer(stream_).expires_after(SessionTimeouts::get().shutdown);
+
+    stream_.async_shutdown(
+            [self = shared_from_this()](beast::error_code ec) {
+                if (ec) {
+                    return fail(ec, "http2 shutdown");
+                }
+            });
+}
+
+/**
+ * @brief Routes the completed request on a stream and submits its response.
+ *
+ * Requests for blocking handlers run on the application's blocking pool and
+ * their response is posted back to this connection's strand.
+ *
+ * @param stream_id The stream the request arrived on.
+ */
+void http2_session::dispatch(std::int32_t stream_id)
+{
+    auto* stream = find_stream(stream_id);
+    if (!stream) {
+        return;
+    }
+
+    bool const head = stream->req.method() == http::verb::head;
+    stream->req.version(11);
+    stream->req.keep_alive(true);
+    stream->req.prepare_payload();
+
+    if (auto limited = check_rate_limit(stream->req, client_id_)) {
+        return submit_response(stream_id, head, std::move(*limited));
+    }
+
+    if (is_blocking_request(stream->req)) {
+        net::post(
+                app_->blocking_executor(),
+                [self = shared_from_this(), stream_id, head, req = std::move(stream->req)]() mutable {
+                    auto msg = handle_request(*self->doc_root_, std::move(req), self->app_);
+                    net::post(
+                            self->stream_.get_executor(),
+                            [self, stream_id, head, msg = std::move(msg)]() mutable {
+                                self->submit_response(stream_id, head, std::move(msg));
+                                self->do_write();
+                            });
+                });
+        return;
+    }
+
+    submit_response(stream_id, head, handle_request(*doc_root_, std::move(stream->req), app_));
+}
+
+/**
+ * @brief Submits the response to a request as HEADERS and DATA frames.
+ *
+ * The response from handle_request is serialized as HTTP/1.1 and parsed back,
+ * header first, so its status and headers can be submitted as HTTP/2 fields.
+ * The body is not collected: read_response_body() serializes and parses it
+ * piece by piece straight into each DATA frame, so a file is read as the
+ * stream's window allows rather than held in memory. Does nothing if the
+ * client has reset the stream in the meantime.
+ *
+ * @param stream_id The stream the request arrived on.
+ * @param head Whether the request was a HEAD request.
+ * @param msg The response.
+ */
+void http2_session::submit_response(std::int32_t stream_id, bool head, http::message_generator&& msg)
+{
+    auto* stream = find_stream(stream_id);
+    if (!stream) {
+        return;
+    }
+
+    stream->response.emplace(std::move(msg));
+    auto& parser = stream->parser.emplace();
+    parser.body_limit(std::numeric_limits<std::uint64_t>::max());  // Responses are ours; boost::none misbehaves before Boost 1.75
+    parser.skip(head);
+
+    // The serializer hands out the whole header in its first buffers; they are
+    // joined, which copies only the header, until the parser has all of it.
+    beast::error_code ec;
+    std::string header;
+    auto const buffers = stream->response->prepare(ec);
+    if (!ec) {
+        ec = http::error::need_more;
+        for (auto const& buffer : beast::buffers_range_ref(buffers)) {
+            header.append(static_cast<const char*>(buffer.data()), buffer.size());
+            ec = {};
+            auto const used = parser.put(net::buffer(header), ec);
+            if (ec != http::error::need_more) {
+                if (!ec) {
+                    stream->response->consume(used);
+                }
+                break;
+            }
+        }
+    }
+    if (!ec && !parser.is_header_done()) {
+        ec = http::error::need_more;
+    }
+    if (ec) {
+        auto logger = LoggerManager::getLogger("http2_session_logger");
+        logger->log(LogLevel::ERROR, "Error converting response for stream " + std::to_string(stream_id) + ": " + ec.message());
+        nghttp2_submit_rst_stream(session_, NGHTTP2_FLAG_NONE, stream_id, NGHTTP2_INTERNAL_ERROR);
+        return;
+    }
+
+    // nghttp2 copies the header block during submit, so views into the parsed header are enough.
+    auto const& res = parser.get();
+    std::string const status = std::to_string(res.result_int());
+    std::vector<nghttp2_nv> headers;
+    headers.reserve(std::distance(res.begin(), res.end()) + 1);
+    headers.push_back(make_nv(":status", status));
+    std::vector<std::string> names;  // HTTP/2 field names must be lowercase
+    names.reserve(headers.capacity());
+    for (auto const& field : res) {
+        if (!is_http2_header(field.name())) {
+            continue;
+        }
+        std::string name(field.name_string());
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        names.push_back(std::move(name));
+        headers.push_back(make_nv(names.back(), field.value()));
+    }
+
+    nghttp2_data_provider body;
+    body.source.ptr = stream;
+    body.read_callback = &http2_session::read_response_body;
+
+    int const rv = nghttp2_submit_response(
+            session_, stream_id, headers.data(), headers.size(),
+            parser.is_done() ? nullptr : &body);
+    if (rv != 0) {
+        auto logger = LoggerManager::getLogger("http2_session_logger");
+        logger->log(LogLevel::ERROR, std::string("Error submitting response: ") + nghttp2_strerror(rv));
+        nghttp2_submit_rst_stream(session_, NGHTTP2_FLAG_NONE, stream_id, NGHTTP2_INTERNAL_ERROR);
+    }
+}
+
+/**
+ * @brief Refuses a request whose body is over the limit with 413 Payload Too Large.
+ *
+ * The response ends the stream before the request has; nghttp2 then resets
+ * the stream with NO_ERROR, telling the client to stop sending (RFC 9113, 8.1).
+ *
+ * @param stream_id The stream the request arrived on.
+ */
+void http2_session::reject_request_body(std::int32_t stream_id)
+{
+    auto* stream = find_stream(stream_id);
+    if (!stream || stream->rejected) {
+        return;
+    }
+    stream->rejected = true;
+    stream->req = {};  // Releases what was received so far
+
+    auto logger = LoggerManager::getLogger("http2_session_logger");
+    logger->log(LogLevel::DEBUG, "Request body over the limit on stream " + std::to_string(stream_id) + ".");
+
+    nghttp2_nv const headers[] = {make_nv(":status", "413")};
+    int const rv = nghttp2_submit_response(session_, stream_id, headers, std::size(headers), nullptr);
+    if (rv != 0) {
+        nghttp2_submit_rst_stream(session_, NGHTTP2_FLAG_NONE, stream_id, NGHTTP2_CANCEL);
+    }
+}
+
+/**
+ * @brief Finds the state of an open stream.
+ *
+ * @return The stream's state, or null if it is unknown.
+ */
+http2_session::stream_state* http2_session::find_stream(std::int32_t stream_id)
+{
+    auto it = streams_.find(stream_id);
+    return it == streams_.end() ? nullptr : it->second.get();
+}
+
+/**
+ * @brief Opens the state for a stream when its request headers begin.
+ */
+int http2_session::on_begin_headers(nghttp2_session*, const nghttp2_frame* frame, void* user_data)
+{
+    if (frame->hd.type != NGHTTP2_HEADERS || frame->headers.cat != NGHTTP2_HCAT_REQUEST) {
+        return 0;
+    }
+    auto* self = static_cast<http2_session*>(user_data);
+    self->streams_.emplace(frame->hd.stream_id, std::make_unique<stream_state>());
+    self->reap_hook_.set_idle(false);
+    return 0;
+}
+
+/**
+ * @brief Adds a request header, mapping pseudo-headers onto the request line and Host.
+ */
+int http2_session::on_header(nghttp2_session*, const nghttp2_frame* frame,
+                             const std::uint8_t* name, std::size_t namelen,
+                             const std::uint8_t* value, std::size_t valuelen,
+                             std::uint8_t, void* user_data)
+{
+    auto* self = static_cast<http2_session*>(user_data);
+    auto* stream = self->find_stream(frame->hd.stream_id);
+    if (!stream || frame->hd.type != NGHTTP2_HEADERS) {
+        return 0;
+    }
+
+    beast::string_view const n(reinterpret_cast<const char*>(name), namelen);
+    beast::string_view const v(reinterpret_cast<const char*>(value), valuelen);
+    if (n == ":method") {
+        stream->req.method_string(v);
+    } else if (n == ":path") {
+        stream->req.target(v);
+    } else if (n == ":authority") {
+        stream->req.set(http::field::host, v);
+    } else if (!n.empty() && n.front() != ':') {
+        stream->req.insert(n, v);
+    }
+    return 0;
+}
+
+/**
+ * @brief Appends a chunk of request body to its stream, refusing bodies over max_request_body.
+ */
+int http2_session::on_data_chunk_recv(nghttp2_session*, std::uint8_t, std::int32_t stream_id,
+                                      const std::uint8_t* data, std::size_t len, void* user_data)
+{
+    auto* self = static_cast<http2_session*>(user_data);
+    auto* stream = self->find_stream(stream_id);
+    if (!stream || stream->rejected) {
+        return 0;
+    }
+    if (len > max_request_body - stream->req.body().size()) {
+        self->reject_request_body(stream_id);
+        return 0;
+    }
+    stream->req.body().append(reinterpret_cast<const char*>(data), len);
+    return 0;
+}
+
+/**
+ * @brief Dispatches a stream once its request has ended.
+ */
+int http2_session::on_frame_recv(nghttp2_session*, const nghttp2_frame* frame, void* user_data)
+{
+    auto* self = static_cast<http2_session*>(user_data);
+    switch (frame->hd.type) {
+    case NGHTTP2_HEADERS:
+    case NGHTTP2_DATA:
+        if (frame->hd.flags & NGHTTP2_FLAG_END_STREAM) {
+            self->dispatch(frame->hd.stream_id);
+        }
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+/**
+ * @brief Releases the state of a closed stream.
+ */
+int http2_session::on_stream_close(nghttp2_session*, std::int32_t stream_id, std::uint32_t, void* user_data)
+{
+    auto* self = static_cast<http2_session*>(user_data);
+    self->streams_.erase(stream_id);
+    self->reap_hook_.set_idle(self->streams_.empty());
+    return 0;
+}
+
+/**
+ * @brief Serializes the next part of a response body into a DATA frame.
+ *
+ * nghttp2 calls this as the stream's flow-control window allows. The parser
+ * writes body bytes, with any chunked framing removed, directly into `buf`.
+ */
+ssize_t http2_session::read_response_body(nghttp2_session*, std::int32_t, std::uint8_t* buf, std::size_t length,
+                                          std::uint32_t* data_flags, nghttp2_data_source* source, void*)
+{
+    auto* stream = static_cast<stream_state*>(source->ptr);
+    auto& msg = *stream->response;
+    auto& parser = *stream->parser;
+    auto& body = parser.get().body();
+    body.data = buf;
+    body.size = length;
+
+    beast::error_code ec;
+    while (body.size > 0 && !parser.is_done()) {
+        if (msg.is_done()) {
+            parser.put_eof(ec);  // A body delimited by the end of the message
+            break;
+        }
+        auto const buffers = msg.prepare(ec);
+        if (ec) {
+            break;
+        }
+        auto const used = parser.put(buffers, ec);
+        if (ec == http::error::need_buffer) {
+            ec = {};
+        }
+        if (ec) {
+            break;
+        }
+        msg.consume(used);
+        if (used == 0 && body.size > 0) {
+            ec = http::error::need_more;  // No progress; avoid spinning
+            break;
+        }
+    }
+    if (ec) {
+        auto logger = LoggerManager::getLogger("http2_session_logger");
+        logger->log(LogLevel::ERROR, "Error serializing response body: " + ec.message());
+        return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+    }
+
+    auto const n = length - body.size;
+    body.data = nullptr;
+    body.size = 0;
+    if (parser.is_done()) {
+        *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+    }
+    return static_cast<ssize_t>(n);
+}
+
+/**
+ * @brief Asks an idle session to close; called by the idle reaper from any thread.
+ *
+ * @param owner The session.
+ */
+void http2_session::reap(void* owner)
+{
+    // As in session::reap: a weak reference, moved into the handler so that the
+    // last reference is never dropped under the reaper's lock.
+    if (auto self = static_cast<http2_session*>(owner)->weak_from_this().lock()) {
+        auto executor = self->stream_.get_executor();
+        net::post(
+                executor,
+                [self = std::move(self)] {
+                    self->on_reap();
+                });
+    }
+}
+
+/**
+ * @brief Sends GOAWAY and closes the connection if it still has no open streams.
+ *
+ * GOAWAY tells the client no request was lost, so it can reconnect when it
+ * next needs to; do_write() closes the socket once the frame is out.
+ */
+void http2_session::on_reap()
+{
+    if (!streams_.empty() || closing_) {
+        return;  // A request arrived in the meantime
+    }
+
+    auto logger = LoggerManager::getLogger("http2_session_logger");
+    logger->log(LogLevel::DEBUG, "Idle HTTP/2 connection reaped.");
+
+    reaped_ = true;
+    nghttp2_session_terminate_session(session_, NGHTTP2_NO_ERROR);
+    do_write();
+}
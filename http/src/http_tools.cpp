@@ -1,16 +1,117 @@
 #include "../include/http_tools.hpp"
 #include "../include/utils.hpp"
+#include "../include/arena.hpp"
+#include "../include/rate_limiter.hpp"
+#include "../include/response_prologue.hpp"
+#include "../include/json_writer.hpp"
+#include "../../ollama/include/json_scan.hpp"
 #include "../../log/include/log.hpp"
+#include "../../log/include/alloc_stats.hpp"
 #include <boost/asio/dispatch.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/ssl.hpp>
 #include <boost/beast/version.hpp>
+#include <charconv>
+#include <optional>
 #include <string>
 
 LogLevel http_log_level = LogLevel::DEBUG;
 
+/**
+ * @brief Returns the path of a request target, without its query string.
+ * 
+ * @param target The request target.
+ */
+static beast::string_view target_path(beast::string_view target)
+{
+    auto const query = target.find('?');
+    return query == beast::string_view::npos ? target : target.substr(0, query);
+}
+
+/**
+ * @brief Returns the percent-decoded value of a query string parameter, if present.
+ * 
+ * @param target The request target.
+ * @param name The parameter name.
+ */
+static std::optional<std::string> query_param(beast::string_view target, beast::string_view name)
+{
+    auto const query = target.find('?');
+    if (query == beast::string_view::npos) {
+        return std::nullopt;
+    }
+
+    auto hex = [](char c) {
+        return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    };
+    beast::string_view rest = target.substr(query + 1);
+    while (!rest.empty()) {
+        auto const amp = rest.find('&');
+        beast::string_view const pair = rest.substr(0, amp);
+        rest = amp == beast::string_view::npos ? beast::string_view() : rest.substr(amp + 1);
+
+        auto const eq = pair.find('=');
+        if (pair.substr(0, eq) != name) {
+            continue;
+        }
+        beast::string_view const raw = eq == beast::string_view::npos ? beast::string_view() : pair.substr(eq + 1);
+        std::string value;
+        value.reserve(raw.size());
+        for (std::size_t i = 0; i < raw.size(); ++i) {
+            if (raw[i] == '+') {
+                value.push_back(' ');
+            } else if (raw[i] == '%' && i + 2 < raw.size() && hex(raw[i + 1]) >= 0 && hex(raw[i + 2]) >= 0) {
+                value.push_back(static_cast<char>(hex(raw[i + 1]) * 16 + hex(raw[i + 2])));
+                i += 2;
+            } else {
+                value.push_back(raw[i]);
+            }
+        }
+        return value;
+    }
+    return std::nullopt;
+}
+
+/**
+ * @brief Parses a whole query string parameter as a non-negative integer.
+ * 
+ * @return The number, `fallback` if the parameter is absent, or nothing if it is malformed.
+ */
+static std::optional<std::int64_t> query_int(beast::string_view target, beast::string_view name, std::int64_t fallback)
+{
+    auto const value = query_param(target, name);
+    if (!value) {
+        return fallback;
+    }
+    std::int64_t n = 0;
+    auto const [end, ec] = std::from_chars(value->data(), value->data() + value->size(), n);
+    if (ec != std::errc() || end != value->data() + value->size() || n < 0) {
+        return std::nullopt;
+    }
+    return n;
+}
+
+/**
+ * @brief Names the route a request is dispatched to, for per-route metrics.
+ * 
+ * Mirrors the dispatch in handle_request.
+ * 
+ * @param req The HTTP request.
+ * @return The route name.
+ */
+template <class Body, class Allocator>
+const char* route_name(http::request<Body, http::basic_fields<Allocator>> const& req)
+{
+    if (req.method() == http::verb::post && req.target() == "/") return "POST /";
+    if (req.method() == http::verb::get && req.target() == "/json_data") return "GET /json_data";
+    if (req.method() == http::verb::get && target_path(req.target()) == "/performance_statistics") return "GET /performance_statistics";
+    if (req.method() == http::verb::get && req.target().starts_with("/query_status/")) return "GET /query_status";
+    if (req.method() == http::verb::get || req.method() == http::verb::head) return "GET file";
+    return "unknown method";
+}
+
 /**
  * @brief Send an HTTP response with the given status and body.
  * 
@@ -18,7 +119,6 @@ LogLevel http_log_level = LogLevel::DEBUG;
  * @param status The HTTP status code.
  * @param body The response body content.
  * @param content_type The content type of the response.
- * @param logger A shared pointer to the logger used for logging.
  * @return The HTTP response object.
  */
 template <class Body, class Allocator>
@@ -26,16 +126,22 @@ http::message_generator send_(
     http::request<Body, http::basic_fields<Allocator>> const& req,
     http::status status,
     const std::string& body,
-    const std::string& content_type = "application/json")
+    const std::string& content_type)
 {
     auto logger = LoggerManager::getLogger("http_tools_logger", http_log_level);
     logger->log(LogLevel::DEBUG, "Preparing response with status: " + std::to_string(static_cast<int>(status)));
 
-    http::response<http::string_body> res{status, req.version()};
-    res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
-    res.set(http::field::content_type, content_type);
+    // Build the body with the request's allocator (the session's arena); the headers
+    // are written from a preserialized prologue (see response_prologue.hpp)
+    http::response<http::basic_string_body<char, std::char_traits<char>, Allocator>, prologue_fields> res{
+        std::piecewise_construct,
+        std::make_tuple(req.get_allocator()),
+        std::make_tuple()};
+    res.result(status);
+    res.version(req.version());
+    res.content_type(content_type);
     res.keep_alive(req.keep_alive());
-    res.body() = body;
+    res.body().assign(body.data(), body.size());
     res.prepare_payload();
 
     logger->log(LogLevel::DEBUG, "Response prepared with body: " + body);
@@ -44,6 +150,34 @@ http::message_generator send_(
     return http::message_generator(std::move(res));
 }
 
+/**
+ * @brief Send a JSON response serialized straight into the response body.
+ * 
+ * `write` receives a json_writer on the body, which is allocated like send_'s,
+ * and returns the status to send; there is no intermediate document or string.
+ * 
+ * @param req The original HTTP request.
+ * @param write Called as `http::status write(json_writer<body string>&)`.
+ * @return The HTTP response object.
+ */
+template <class Body, class Allocator, class Write>
+http::message_generator send_json_(
+    http::request<Body, http::basic_fields<Allocator>> const& req,
+    Write&& write)
+{
+    http::response<http::basic_string_body<char, std::char_traits<char>, Allocator>, prologue_fields> res{
+        std::piecewise_construct,
+        std::make_tuple(req.get_allocator()),
+        std::make_tuple()};
+    json_writer writer(res.body());
+    res.result(write(writer));
+    res.version(req.version());
+    res.content_type("application/json");
+    res.keep_alive(req.keep_alive());
+    res.prepare_payload();
+    return http::message_generator(std::move(res));
+}
+
 
 
 /**
@@ -105,33 +239,48 @@ http::message_generator handle_post_request(
 {
     auto logger = LoggerManager::getLogger("http_tools_logger", http_log_level);
     try {
-        auto json_obj = nlohmann::json::parse(req.body());
+        // Only 'message' and 'context' are read, so the body is scanned instead of parsed into a document.
+        std::string_view const body(req.body().data(), req.body().size());
+        std::string_view fields[2];
+        std::string message;
+        if (!json_scan::find_fields(body, {"message", "context"}, fields)
+                || (!fields[0].empty() && !json_scan::decode_string(fields[0], message))) {
+            logger->log(LogLevel::ERROR, "JSON parsing error: malformed request body.");
+            return send_(req, http::status::bad_request, R"({"error": "Invalid JSON format."})");
+        }
 
-        // Check if the JSON contains both 'message' and 'context'
-        if (json_obj.contains("message")) {
-            std::string message = json_obj["message"].template get<std::string>();
+        // Check if the JSON contains 'message'
+        if (!fields[0].empty()) {
             logger->log(LogLevel::DEBUG, "Received LLM message: " + message);
 
-            // Handle context if provided
+            // Handle context if provided; it is kept as the raw text of the previous reply
+            // The scan only checks structure, and the context is parsed much later on the worker, so it is
+            // validated in full here to reject it while the client can still be told.
             ollama::response context;
-            if (json_obj.contains("context")) {
-                context = ollama::response(json_obj["context"].dump());
+            if (!fields[1].empty()) {
+                if (!nlohmann::json::accept(fields[1].begin(), fields[1].end())) {
+                    logger->log(LogLevel::ERROR, "JSON parsing error: malformed context.");
+                    return send_(req, http::status::bad_request, R"({"error": "Invalid JSON format."})");
+                }
+                context = ollama::response(std::string(fields[1]));
                 logger->log(LogLevel::DEBUG, "Received context for LLM.");
             }
 
             // Add the query with context to the queue and get the query ID
             std::string query_id = app->add_query(message, context);
 
-            nlohmann::json response_json;
-            response_json["query_id"] = query_id;
-            response_json["status"] = "Query added to the queue";
-
-            return send_(req, http::status::ok, response_json.dump(), "application/json");
+            return send_json_(req, [&](auto& json) {
+                json.begin_object()
+                    .key("query_id").value(query_id)
+                    .key("status").value("Query added to the queue")
+                    .end_object();
+                return http::status::ok;
+            });
         } else {
             logger->log(LogLevel::ERROR, R"({"error": "Missing 'message' field in JSON request."})");
             return send_(req, http::status::bad_request, R"({"error": "Missing 'message' field in JSON request."})");
         }
-    } catch (const nlohmann::json::exception& e) {
+    } catch (const ollama::invalid_json_exception& e) {
         logger->log(LogLevel::ERROR, "JSON parsing exception: " + std::string(e.what()));
         return send_(req, http::status::bad_request, R"({"error": "Invalid JSON format."})");
     } catch (const std::exception& e) {
@@ -169,16 +318,14 @@ http::message_generator handle_get_request(
             std::string query_id = target.substr(14);  // 14 is the length of "/query_status/"
             logger->log(LogLevel::DEBUG, "Query status request for query_id: " + query_id);
 
-            // Get the status from the Application
-            std::string status = app->get_query_status(query_id);
-
-            // Create a JSON response with the query status
-            nlohmann::json response_json;
-            response_json["query_id"] = query_id;
-            response_json["status"] = status;
-
-            // Send the JSON response back to the client
-            return send_(req, http::status::ok, response_json.dump(), "application/json");
+            // Serialize the status into the response body while the query is looked up
+            return send_json_(req, [&](auto& json) {
+                if (app->write_query_status(query_id, json)) {
+                    return http::status::ok;
+                }
+                json.begin_object().key("error").value("Query ID not found.").end_object();
+                return http::status::not_found;
+            });
         }
 
         // If not a query status request, proceed with serving a file
@@ -209,22 +356,24 @@ http::message_generator handle_get_request(
 
         if (req.method() == http::verb::head) {
             logger->log(LogLevel::DEBUG, "HEAD request, preparing response headers.");
-            http::response<http::empty_body> res{http::status::ok, req.version()};
-            res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
-            res.set(http::field::content_type, mime_type(path));
+            http::response<http::empty_body, prologue_fields> res;
+            res.result(http::status::ok);
+            res.version(req.version());
+            res.content_type(mime_type(path));
             res.content_length(size);
             res.keep_alive(req.keep_alive());
             return res;
         }
 
         logger->log(LogLevel::DEBUG, "GET request, preparing full response.");
-        http::response<http::file_body> res{
+        http::response<http::file_body, prologue_fields> res{
             std::piecewise_construct,
             std::make_tuple(std::move(body)),
-            std::make_tuple(http::status::ok, req.version())
+            std::make_tuple()
         };
-        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
-        res.set(http::field::content_type, mime_type(path));
+        res.result(http::status::ok);
+        res.version(req.version());
+        res.content_type(mime_type(path));
         res.content_length(size);
         res.keep_alive(req.keep_alive());
         return res;
@@ -234,6 +383,18 @@ http::message_generator handle_get_request(
     }
 }
 
+/**
+ * @brief Handle a GET request for performance statistics.
+ * 
+ * Without parameters, returns today's aggregates per metric. With
+ * ?metric=NAME, returns that metric as a series of buckets instead; from and to
+ * (milliseconds since the epoch) default to the last hour and step (milliseconds)
+ * to one minute.
+ * 
+ * @param req The GET request object.
+ * @param app A shared pointer to the Application.
+ * @return The HTTP response as a message generator.
+ */
 template <class Body, class Allocator>
 http::message_generator handle_performance_statistics_request(
     http::request<Body, http::basic_fields<Allocator>>&& req,
@@ -243,17 +404,119 @@ http::message_generator handle_performance_statistics_request(
     logger->log(LogLevel::DEBUG, "Received request for performance statistics.");
 
     try {
-        // Retrieve the performance statistics as JSON
-        nlohmann::json stats_json = app->get_performance_statistics_json();
+        if (auto const metric = query_param(req.target(), "metric")) {
+            std::int64_t const now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            auto const to = query_int(req.target(), "to", now);
+            auto const from = to ? query_int(req.target(), "from", *to - 60 * 60 * 1000) : std::nullopt;
+            auto const step = query_int(req.target(), "step", 60 * 1000);
+            if (metric->empty() || !to || !from || !step || *from >= *to) {
+                return send_(req, http::status::bad_request, R"({"error": "Expected metric, and from < to and step as non-negative milliseconds."})");
+            }
 
-        // Send the JSON data as the response
-        return send_(req, http::status::ok, stats_json.dump(), "application/json");
+            // No series is kept longer than a year; larger spans and steps only risk overflow further down.
+            constexpr std::int64_t max_span = 366LL * 24 * 60 * 60 * 1000;
+            std::int64_t const span_from = *to - *from > max_span ? *to - max_span : *from;
+            std::int64_t const span_step = std::min(*step, max_span);
+
+            return send_json_(req, [&](auto& json) {
+                app->write_performance_series(json, *metric, span_from, *to, span_step);
+                return http::status::ok;
+            });
+        }
+
+        return send_json_(req, [&](auto& json) {
+            app->write_performance_statistics(json);
+            return http::status::ok;
+        });
     } catch (const std::exception& e) {
         logger->log(LogLevel::ERROR, "Exception caught while serving performance statistics: " + std::string(e.what()));
         return send_(req, http::status::internal_server_error, R"({"error": ")" + std::string(e.what()) + "\"}");
     }
 }
 
+/**
+ * @brief Returns whether the request is routed to a handler that blocks on disk or database I/O.
+ * 
+ * handle_json_data_request parses a file and handle_performance_statistics_request
+ * aggregates the metrics table; everything else is answered from memory or sent
+ * with file_body, which only opens the file.
+ * 
+ * @param req The HTTP request.
+ */
+template <class Body, class Allocator>
+bool is_blocking_request(http::request<Body, http::basic_fields<Allocator>> const& req)
+{
+    return req.method() == http::verb::get
+        && (req.target() == "/json_data" || target_path(req.target()) == "/performance_statistics");
+}
+
+/**
+ * @brief Returns the rate limit budget a request is charged to.
+ * 
+ * @param req The HTTP request.
+ */
+template <class Body, class Allocator>
+rate_class request_rate_class(http::request<Body, http::basic_fields<Allocator>> const& req)
+{
+    if (req.method() == http::verb::post && req.target() == "/") return rate_class::submission;
+    if (req.target().starts_with("/query_status/") || target_path(req.target()) == "/performance_statistics") return rate_class::status;
+    return rate_class::static_content;
+}
+
+/**
+ * @brief Charges a request to its client's rate limit (see rate_limiter.hpp).
+ * 
+ * Always charged to the connection's peer address; a request whose X-API-Key
+ * is configured in RATE_LIMIT_API_KEYS is charged to the key as well, and
+ * waits for whichever bucket is emptier.
+ * 
+ * @param req The HTTP request.
+ * @param connection_client The client id of the connection's peer address.
+ * @return A 429 Too Many Requests response if the client is over budget, else nothing.
+ */
+template <class Body, class Allocator>
+std::optional<http::message_generator> check_rate_limit(
+    http::request<Body, http::basic_fields<Allocator>> const& req,
+    std::uint64_t connection_client)
+{
+    auto const& limits = RateLimits::get();
+    if (!limits.enabled) {
+        return std::nullopt;
+    }
+
+    auto& limiter = rate_limiter::instance();
+    auto const cls = request_rate_class(req);
+    auto wait = limiter.acquire(connection_client, cls);
+    auto const api_key = req["X-API-Key"];
+    std::string_view const key(api_key.data(), api_key.size());
+    if (!key.empty() && limits.known_api_key(key)) {
+        wait = std::max(wait, limiter.acquire(rate_limiter::client_id(key), cls));
+    }
+    if (wait == rate_limiter::clock::duration::zero()) {
+        return std::nullopt;
+    }
+
+    auto logger = LoggerManager::getLogger("http_tools_logger", http_log_level);
+    logger->log(LogLevel::DEBUG, "Rate limit exceeded for " + std::string(req.method_string()) + " " + std::string(req.target()));
+
+    // Retry-After is in whole seconds; round up so a client that honours it is let through.
+    auto const retry_after = std::chrono::ceil<std::chrono::seconds>(wait).count();
+    std::string const body = R"({"error": "Too many requests.", "retry_after": )" + std::to_string(retry_after) + "}";
+    http::response<http::basic_string_body<char, std::char_traits<char>, Allocator>, prologue_fields> res{
+        std::piecewise_construct,
+        std::make_tuple(req.get_allocator()),
+        std::make_tuple()};
+    res.result(http::status::too_many_requests);
+    res.version(req.version());
+    res.content_type("application/json");
+    res.retry_after(static_cast<std::uint64_t>(retry_after));
+    res.keep_alive(req.keep_alive());
+    res.body().assign(body.data(), body.size());
+    res.prepare_payload();
+    return http::message_generator(std::move(res));
+}
+
 /**
  * @brief Handle an HTTP request and generate an appropriate response.
  * 
@@ -272,6 +535,8 @@ http::message_generator handle_request(
     auto logger = LoggerManager::getLogger("http_tools_logger", http_log_level);
     logger->log(LogLevel::DEBUG, "Received request: " + std::string(req.method_string()) + " " + std::string(req.target()));
 
+    const char* route = alloc_stats::enabled ? route_name(req) : nullptr;
+    auto const allocs_before = alloc_stats::thread_counters();
     auto process_start_time = std::chrono::high_resolution_clock::now();
 
     http::message_generator response = [&] {
@@ -281,7 +546,7 @@ http::message_generator handle_request(
         } else if (req.method() == http::verb::get && req.target() == "/json_data") {
             logger->log(LogLevel::DEBUG, "Delegating to handle_json_data_request.");
             return handle_json_data_request(std::move(req), app);
-        } else if (req.method() == http::verb::get && req.target() == "/performance_statistics") {
+        } else if (req.method() == http::verb::get && target_path(req.target()) == "/performance_statistics") {
             logger->log(LogLevel::DEBUG, "Delegating to handle_performance_statistics_request.");
             return handle_performance_statistics_request(std::move(req), app);
         } else if (req.method() == http::verb::get || req.method() == http::verb::head) {
@@ -294,10 +559,14 @@ http::message_generator handle_request(
     }();
 
     auto process_end_time = std::chrono::high_resolution_clock::now();
+    auto const route_allocs = alloc_stats::thread_counters() - allocs_before;
     auto process_duration = std::chrono::duration_cast<std::chrono::microseconds>(process_end_time - process_start_time).count();
     logger->log(LogLevel::DEBUG, "Time to process request: " + std::to_string(process_duration) + " µs");
-    // Log the request processing time
-    app->log_performance_metric("Request Processing Duration (µs)", process_duration);
+    // Log the request processing time without waiting for the INSERT
+    app->post_performance_metric("Request Processing Duration (µs)", process_duration);
+    if (alloc_stats::enabled) {
+        app->log_allocation_metric(std::string("route ") + route, route_allocs);
+    }
 
     return response;
 }
@@ -372,10 +641,34 @@ std::string path_cat(beast::string_view base, beast::string_view path)
     return result;
 }
 
-// Explicit template instantiation for string body requests
+// Explicit template instantiations for string body requests
+template http::message_generator send_<http::string_body, std::allocator<char>>(
+    http::request<http::string_body, http::basic_fields<std::allocator<char>>> const& req,
+    http::status status,
+    const std::string& body,
+    const std::string& content_type);
+
 template http::message_generator handle_request<http::string_body, std::allocator<char>>(
     beast::string_view doc_root,
     http::request<http::string_body, http::basic_fields<std::allocator<char>>>&& req,
     std::shared_ptr<Application> app);
 
+template bool is_blocking_request<http::string_body, std::allocator<char>>(
+    http::request<http::string_body, http::basic_fields<std::allocator<char>>> const& req);
+
+template std::optional<http::message_generator> check_rate_limit<http::string_body, std::allocator<char>>(
+    http::request<http::string_body, http::basic_fields<std::allocator<char>>> const& req,
+    std::uint64_t connection_client);
+
+// Explicit template instantiations for requests read by a session (see session.hpp)
+template http::message_generator handle_request<http::basic_string_body<char, std::char_traits<char>, arena_allocator<char>>, arena_allocator<char>>(
+    beast::string_view doc_root,
+    http::request<http::basic_string_body<char, std::char_traits<char>, arena_allocator<char>>, http::basic_fields<arena_allocator<char>>>&& req,
+    std::shared_ptr<Application> app);
+
+template bool is_blocking_request<http::basic_string_body<char, std::char_traits<char>, arena_allocator<char>>, arena_allocator<char>>(
+    http::request<http::basic_string_body<char, std::char_traits<char>, arena_allocator<char>>, http::basic_fields<arena_allocator<char>>> const& req);
 
+template std::optional<http::message_generator> check_rate_limit<http::basic_string_body<char, std::char_traits<char>, arena_allocator<char>>, arena_allocator<char>>(
+    http::request<http::basic_string_body<char, std::char_traits<char>, arena_allocator<char>>, http::basic_fields<arena_allocator<char>>> const& req,
+    std::uint64_t connection_client);
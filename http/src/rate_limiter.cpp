@@ -0,0 +1,240 @@
+#include "../include/rate_limiter.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <string>
+
+namespace {
+
+/**
+ * @brief Reads a non-negative number from the environment, or returns `fallback`.
+ */
+double env_double(const char* name, double fallback)
+{
+    const char* value = std::getenv(name);
+    if (!value || !*value) {
+        return fallback;
+    }
+    double const parsed = std::atof(value);
+    return parsed >= 0 ? parsed : fallback;
+}
+
+/**
+ * @brief Scrambles a key so neighbouring addresses land in different slots; never returns 0.
+ */
+std::uint64_t mix(std::uint64_t x)
+{
+    // splitmix64 finalizer
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x ? x : 1;
+}
+
+std::int64_t to_ns(rate_limiter::clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+} // namespace
+
+/**
+ * @brief Reads the configuration from the environment.
+ */
+RateLimits RateLimits::from_env()
+{
+    RateLimits limits;
+    limits.enabled = env_double("RATE_LIMIT", 1) != 0;
+
+    const char* const names[] = {"SUBMIT", "STATUS", "STATIC"};
+    for (std::size_t i = 0; i < limits.budgets.size(); ++i) {
+        auto& budget = limits.budgets[i];
+        std::string const prefix = std::string("RATE_LIMIT_") + names[i];
+        budget.per_second = env_double((prefix + "_RPS").c_str(), budget.per_second);
+        budget.burst = std::max(1.0, env_double((prefix + "_BURST").c_str(), budget.burst));
+    }
+
+    auto const slots = static_cast<std::size_t>(env_double("RATE_LIMIT_SLOTS", static_cast<double>(limits.slots)));
+    limits.slots = std::max<std::size_t>(slots, 16);
+
+    if (const char* keys = std::getenv("RATE_LIMIT_API_KEYS")) {
+        std::string_view rest(keys);
+        while (!rest.empty()) {
+            auto const comma = rest.find(',');
+            auto const key = rest.substr(0, comma);
+            if (!key.empty()) {
+                limits.api_keys.emplace_back(key);
+            }
+            rest = comma == std::string_view::npos ? std::string_view() : rest.substr(comma + 1);
+        }
+        std::sort(limits.api_keys.begin(), limits.api_keys.end());
+    }
+    return limits;
+}
+
+/**
+ * @brief Returns whether an X-API-Key value is one of api_keys.
+ */
+bool RateLimits::known_api_key(std::string_view key) const
+{
+    auto const it = std::lower_bound(api_keys.begin(), api_keys.end(), key,
+        [](const std::string& known, std::string_view wanted) { return std::string_view(known) < wanted; });
+    return it != api_keys.end() && *it == key;
+}
+
+/**
+ * @brief Returns the configuration read from the environment at first use.
+ */
+const RateLimits& RateLimits::get()
+{
+    static const RateLimits limits = from_env();
+    return limits;
+}
+
+/**
+ * @brief Constructs a limiter with the given budgets.
+ *
+ * @param limits The budgets and table size.
+ */
+rate_limiter::rate_limiter(const RateLimits& limits)
+{
+    std::size_t size = 16;
+    while (size < limits.slots) {
+        size *= 2;
+    }
+    slots_ = std::make_unique<slot[]>(size);
+    mask_ = size - 1;
+
+    for (std::size_t i = 0; i < class_count; ++i) {
+        auto const& budget = limits.budgets[i];
+        if (budget.per_second <= 0) {
+            continue;  // Unlimited
+        }
+        interval_[i] = static_cast<std::int64_t>(std::llround(1e9 / budget.per_second));
+        burst_[i] = static_cast<std::int64_t>(std::llround(1e9 * budget.burst / budget.per_second));
+    }
+}
+
+/**
+ * @brief Returns the process-wide limiter, configured from RateLimits::get().
+ */
+rate_limiter& rate_limiter::instance()
+{
+    static rate_limiter limiter(RateLimits::get());
+    return limiter;
+}
+
+/**
+ * @brief Takes a token from a client's bucket for the given class.
+ *
+ * The bucket is full when its theoretical arrival time is not ahead of now;
+ * each request pushes it one interval further, and a request that would push
+ * it more than a full bucket ahead is refused.
+ *
+ * @param client The client, from client_id().
+ * @param cls The request class.
+ * @param now The current time.
+ * @return Zero if the request may proceed, otherwise how long until it would.
+ */
+rate_limiter::clock::duration rate_limiter::acquire(std::uint64_t client, rate_class cls, clock::time_point now)
+{
+    auto const i = static_cast<std::size_t>(cls);
+    if (interval_[i] == 0) {
+        return clock::duration::zero();
+    }
+
+    std::int64_t const now_ns = to_ns(now);
+    auto& tat = find(client, now_ns).tat[i];
+    std::int64_t current = tat.load(std::memory_order_relaxed);
+    for (;;) {
+        std::int64_t const next = std::max(current, now_ns) + interval_[i];
+        if (next - now_ns > burst_[i]) {
+            return std::chrono::duration_cast<clock::duration>(std::chrono::nanoseconds(next - now_ns - burst_[i]));
+        }
+        if (tat.compare_exchange_weak(current, next, std::memory_order_relaxed)) {
+            return clock::duration::zero();
+        }
+    }
+}
+
+/**
+ * @brief Finds or claims the slot of a client.
+ *
+ * @param client The client, from client_id().
+ * @param now The current time in ns, to tell refilled slots.
+ */
+rate_limiter::slot& rate_limiter::find(std::uint64_t client, std::int64_t now)
+{
+    slot* stale = nullptr;
+    for (std::size_t probe = 0; probe < max_probe; ++probe) {
+        auto& s = slots_[(client + probe) & mask_];
+        std::uint64_t owner = s.client.load(std::memory_order_relaxed);
+        if (owner == client) {
+            return s;
+        }
+        if (owner == 0) {
+            if (s.client.compare_exchange_strong(owner, client, std::memory_order_relaxed) || owner == client) {
+                return s;
+            }
+            continue;
+        }
+        if (!stale && std::all_of(s.tat.begin(), s.tat.end(),
+                [now](const std::atomic<std::int64_t>& t) { return t.load(std::memory_order_relaxed) <= now; })) {
+            stale = &s;
+        }
+    }
+
+    // A refilled slot starts the new client with full buckets, which is what it would get anyway.
+    if (stale) {
+        std::uint64_t owner = stale->client.load(std::memory_order_relaxed);
+        stale->client.compare_exchange_strong(owner, client, std::memory_order_relaxed);
+        return *stale;
+    }
+    return slots_[client & mask_];
+}
+
+/**
+ * @brief Identifies a client by its IP address.
+ *
+ * An IPv6 client is identified by its /64 prefix: a single host is normally
+ * given the whole /64, and keying by the full address would let it rotate
+ * source addresses into a fresh bucket per request while filling the slot
+ * table. IPv4-mapped addresses count as the IPv4 address they carry.
+ */
+std::uint64_t rate_limiter::client_id(const boost::asio::ip::address& address)
+{
+    if (address.is_v4()) {
+        return mix(address.to_v4().to_uint());
+    }
+    auto const v6 = address.to_v6();
+    if (v6.is_v4_mapped()) {
+        return mix(boost::asio::ip::make_address_v4(boost::asio::ip::v4_mapped, v6).to_uint());
+    }
+    auto const bytes = v6.to_bytes();
+    std::uint64_t prefix = 0;
+    for (std::size_t i = 0; i < 8; ++i) {
+        prefix = (prefix << 8) | bytes[i];
+    }
+    return mix(prefix);
+}
+
+/**
+ * @brief Identifies a client by its peer address; clients without one share an id.
+ */
+std::uint64_t rate_limiter::client_id(const boost::asio::ip::tcp::socket& socket)
+{
+    boost::system::error_code ec;
+    auto const endpoint = socket.remote_endpoint(ec);
+    return ec ? mix(0) : client_id(endpoint.address());
+}
+
+/**
+ * @brief Identifies a client by its API key.
+ */
+std::uint64_t rate_limiter::client_id(std::string_view api_key)
+{
+    // Offset so keys and addresses are scrambled from different inputs
+    return mix(std::hash<std::string_view>{}(api_key) + 0x5bd1e995ULL);
+}
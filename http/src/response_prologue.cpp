@@ -0,0 +1,134 @@
+#include "../include/response_prologue.hpp"
+#include <boost/beast/http/status.hpp>
+#include <boost/beast/version.hpp>
+#include <charconv>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Copies `s` to `out` and returns the position after it.
+ */
+char* put(char* out, beast::string_view s)
+{
+    std::memcpy(out, s.data(), s.size());
+    return out + s.size();
+}
+
+} // namespace
+
+/**
+ * @brief Returns the current time as an HTTP date, e.g. "Fri, 17 Oct 2026 09:00:00 GMT".
+ */
+beast::string_view http_date()
+{
+    thread_local std::time_t formatted = -1;
+    thread_local char date[32];
+    thread_local std::size_t size = 0;
+
+    std::time_t const now = std::time(nullptr);
+    if (now != formatted) {
+        std::tm tm{};
+        gmtime_r(&now, &tm);
+        size = std::strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        formatted = now;
+    }
+    return {date, size};
+}
+
+/**
+ * @brief Returns the preserialized status line and fixed headers of a response.
+ *
+ * Each thread remembers the blocks it has used, so the shared table is only
+ * locked the first time a thread sees a combination.
+ */
+const std::string& response_prologue(unsigned version, unsigned status, beast::string_view content_type, bool keep_alive)
+{
+    struct entry {
+        unsigned version;
+        unsigned status;
+        bool keep_alive;
+        std::string content_type;
+        const std::string* block;
+    };
+    thread_local std::vector<entry> seen;
+    for (auto const& e : seen) {
+        if (e.status == status && e.version == version && e.keep_alive == keep_alive
+                && beast::string_view(e.content_type) == content_type) {
+            return *e.block;
+        }
+    }
+
+    std::string block = "HTTP/" + std::to_string(version / 10) + "." + std::to_string(version % 10) + " "
+        + std::to_string(status) + " ";
+    auto const reason = http::obsolete_reason(static_cast<http::status>(status));
+    block.append(reason.data(), reason.size());
+    block += "\r\nServer: " BOOST_BEAST_VERSION_STRING "\r\nContent-Type: ";
+    block.append(content_type.data(), content_type.size());
+    block += "\r\n";
+    if (version >= 11 && !keep_alive) {
+        block += "Connection: close\r\n";
+    } else if (version < 11 && keep_alive) {
+        block += "Connection: keep-alive\r\n";
+    }
+
+    // Never freed: threads keep pointers to the blocks in their own caches.
+    static std::mutex mutex;
+    static auto* blocks = new std::deque<std::string>();
+    const std::string* shared = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto const& b : *blocks) {
+            if (b == block) {
+                shared = &b;
+                break;
+            }
+        }
+        if (!shared) {
+            blocks->push_back(std::move(block));
+            shared = &blocks->back();
+        }
+    }
+
+    seen.push_back({version, status, keep_alive, std::string(content_type), shared});
+    return *shared;
+}
+
+/**
+ * @brief Points the writer at the shared prologue and formats the per-response tail.
+ *
+ * @param fields The response's fields.
+ * @param version The HTTP version of the response.
+ * @param status The status code of the response.
+ */
+prologue_fields::writer::writer(prologue_fields const& fields, unsigned version, unsigned status)
+{
+    const std::string& prologue = response_prologue(
+        version, status, fields.content_type(), fields.get_keep_alive_impl(version));
+
+    char* out = tail_;
+    out = put(out, "Date: ");
+    out = put(out, http_date());
+    out = put(out, "\r\n");
+    if (fields.retry_after_) {
+        out = put(out, "Retry-After: ");
+        out = std::to_chars(out, tail_ + sizeof(tail_), *fields.retry_after_).ptr;
+        out = put(out, "\r\n");
+    }
+    if (fields.chunked_) {
+        out = put(out, "Transfer-Encoding: chunked\r\n");
+    } else if (fields.content_length_) {
+        out = put(out, "Content-Length: ");
+        out = std::to_chars(out, tail_ + sizeof(tail_), *fields.content_length_).ptr;
+        out = put(out, "\r\n");
+    }
+    out = put(out, "\r\n");
+
+    buffers_ = {
+        net::const_buffer(prologue.data(), prologue.size()),
+        net::const_buffer(tail_, static_cast<std::size_t>(out - tail_))};
+}
@@ -1,5 +1,11 @@
 #include "../include/server.hpp"
 #include "../include/session.hpp"
+#include "../include/session_pool.hpp"
+#include "../include/coro_session.hpp"
+#include "../include/socket_tuning.hpp"
+#include "../include/session_timeouts.hpp"
+#include "../include/alloc_phase_executor.hpp"
+#include <optional>
 
 /**
  * @brief Constructs a server object.
@@ -23,6 +29,7 @@ server::server(
     , acceptor_(ioc)
     , doc_root_(doc_root)
     , app_(app)
+    , reap_timer_(ioc)
 {
     logger_ = LoggerManager::getLogger("server_logger", LogLevel::INFO, LogOutput::CONSOLE);
     logger_->log(LogLevel::DEBUG, "Initializing server.");
@@ -49,6 +56,10 @@ server::server(
 
     logger_->log(LogLevel::DEBUG, "Socket option set for address reuse.");
 
+    // Apply the configured listener options (see socket_tuning.hpp).
+    auto const& tuning = SocketTuning::get();
+    apply_listener_options(acceptor_, tuning);
+
     // Bind the acceptor to the specified endpoint.
     acceptor_.bind(endpoint, ec);
     if (ec)
@@ -60,7 +71,7 @@ server::server(
     logger_->log(LogLevel::DEBUG, "Acceptor bound to endpoint.");
 
     // Start listening for incoming connections.
-    acceptor_.listen(boost::asio::socket_base::max_listen_connections, ec);
+    acceptor_.listen(tuning.backlog, ec);
     if (ec)
     {
         logger_->log(LogLevel::ERROR, "Error starting listener: " + ec.message());
@@ -79,6 +90,12 @@ void server::run()
 {
     logger_->log(LogLevel::DEBUG, "Running server.");
     do_accept();
+
+    auto const& timeouts = SessionTimeouts::get();
+    if (timeouts.reap_connections > 0 || timeouts.reap_rss_bytes > 0)
+    {
+        do_reap_check();
+    }
 }
 
 /**
@@ -91,17 +108,27 @@ void server::do_accept()
 {
     logger_->log(LogLevel::DEBUG, "Waiting for connections...");
 
+#ifdef MMLBEAST_ALLOC_STATS
+    // Give each connection its own tracker; see alloc_phase_executor.hpp.
+    acceptor_.async_accept(
+        session_alloc_executor(boost::asio::make_strand(ioc_), std::make_shared<AllocPhaseTracker>()),
+        boost::beast::bind_front_handler(
+            &server::on_accept,
+            shared_from_this()));
+#else
     acceptor_.async_accept(
         boost::asio::make_strand(ioc_),
         boost::beast::bind_front_handler(
             &server::on_accept,
             shared_from_this()));
+#endif
 }
 
 /**
  * @brief Handles the completion of an asynchronous accept operation.
  * 
  * If a connection is successfully accepted, this method creates a new session to handle the connection.
+ * The session's memory and buffers are taken from this thread's session pool.
  * If there is an error, it is logged.
  * 
  * @param ec The error code, if any, resulting from the accept operation.
@@ -114,10 +141,24 @@ void server::on_accept(boost::beast::error_code ec, boost::asio::ip::tcp::socket
     if (!ec)
     {
         logger_->log(LogLevel::DEBUG, "Connection accepted.");
+        apply_connection_options(socket, SocketTuning::get());
         
-        // Create a new session and start it
-        auto new_session = std::make_shared<session>(std::move(socket), ctx_, doc_root_, app_);
+        // Charge the session's construction to the connection's accept phase
+        auto tracker = alloc_phase_tracker(socket.get_executor());
+        std::optional<AllocPhaseTracker::Scope> accept_scope;
+        if (tracker) accept_scope.emplace(*tracker);
+
+#ifdef MMLBEAST_COROUTINE_SESSION
+        // Spawn the connection's coroutine session loop
+        run_coro_session(std::move(socket), ctx_, doc_root_, app_);
+        accept_scope.reset();  // The session's handlers may run on other threads from here on
+#else
+        // Create a new session in recycled memory and start it
+        auto new_session = std::allocate_shared<session>(
+            session_allocator<session>(), std::move(socket), ctx_, doc_root_, app_);
+        accept_scope.reset();  // The session's handlers may run on other threads from here on
         new_session->run();
+#endif
 
         auto accept_end_time = std::chrono::steady_clock::now();
         auto accept_duration = std::chrono::duration_cast<std::chrono::microseconds>(accept_end_time - accept_start_time).count();
@@ -132,3 +173,36 @@ void server::on_accept(boost::beast::error_code ec, boost::asio::ip::tcp::socket
     do_accept();
 }
 
+/**
+ * @brief Schedules the next check for connection or memory pressure.
+ */
+void server::do_reap_check()
+{
+    reap_timer_.expires_after(std::chrono::seconds(1));
+    reap_timer_.async_wait(
+        boost::beast::bind_front_handler(
+            &server::on_reap_check,
+            shared_from_this()));
+}
+
+/**
+ * @brief Reaps idle connections if the server is over its connection or memory limit.
+ * 
+ * @param ec The result of the timer wait.
+ */
+void server::on_reap_check(boost::beast::error_code ec)
+{
+    if (ec)
+    {
+        return;
+    }
+
+    auto& reaper = idle_reaper::instance();
+    if (auto const reaped = reaper.reap_if_pressured(SessionTimeouts::get()))
+    {
+        logger_->log(LogLevel::INFO, "Reaping " + std::to_string(reaped) + " idle connections of "
+            + std::to_string(reaper.connections()) + " open.");
+    }
+
+    do_reap_check();
+}
@@ -1,5 +1,6 @@
 #include "../include/server_certificate.hpp"
 #include "../include/dotenv.hpp"
+#include "../include/http2_session.hpp"
 #include "../../log/include/log.hpp"
 #include <fstream>
 #include <sstream>
@@ -96,6 +97,9 @@ void load_server_certificate(boost::asio::ssl::context& ctx)
     ctx.use_tmp_dh(
         boost::asio::buffer(dh.data(), dh.size()));
 
+    logger->log(LogLevel::DEBUG, "Enabling ALPN (h2, http/1.1).");
+    enable_http2_alpn(ctx);
+
     logger->log(LogLevel::DEBUG, "Server certificate loaded successfully.");
 }
 
@@ -1,8 +1,30 @@
 #include "../include/session.hpp"
 #include "../include/http_tools.hpp"
+#include "../include/http2_session.hpp"
+#include "../include/rate_limiter.hpp"
 #include "../include/utils.hpp"
+#include "../include/alloc_phase_executor.hpp"
 #include "../../log/include/log.hpp"
 
+/**
+ * @brief Copies a session request out of the arena, e.g. to hand it to another thread.
+ * 
+ * @param req The request read by a session.
+ * @return The same request using the default allocator.
+ */
+http::request<http::string_body> copy_session_request(session_request const& req)
+{
+    http::request<http::string_body> copy;
+    copy.method_string(req.method_string());
+    copy.target(req.target());
+    copy.version(req.version());
+    for(auto const& field : req) {
+        copy.insert(field.name_string(), field.value());
+    }
+    copy.body().assign(req.body().data(), req.body().size());
+    return copy;
+}
+
 /**
  * @brief Constructs a session object.
  * 
@@ -19,7 +41,11 @@ session::session(
         std::shared_ptr<Application> app)
     : stream_(std::move(socket), ctx)
     , doc_root_(doc_root)
+    , client_id_(rate_limiter::client_id(beast::get_lowest_layer(stream_).socket()))
+    , buffers_(acquire_session_buffers())
       , app_(app)
+    , alloc_tracker_(alloc_phase_tracker(stream_.get_executor()))
+    , reap_hook_(&session::reap, this)
 {
     auto logger = LoggerManager::getLogger("session_logger", LogLevel::INFO);
     logger->log(LogLevel::DEBUG, "Session created.");
@@ -49,9 +75,9 @@ void session::on_run()
 {
     auto logger = LoggerManager::getLogger("session_logger");
     logger->log(LogLevel::DEBUG, "Starting SSL handshake.");
+    enter_phase(AllocPhase::handshake);
 
-    beast::get_lowest_layer(stream_).expires_after(
-            std::chrono::seconds(30));
+    beast::get_lowest_layer(stream_).expires_after(SessionTimeouts::get().handshake);
 
     stream_.async_handshake(
             ssl::stream_base::server,
@@ -63,7 +89,8 @@ void session::on_run()
 /**
  * @brief Handles the SSL handshake completion.
  * 
- * This method is called when the SSL handshake is complete.
+ * This method is called when the SSL handshake is complete. If ALPN selected
+ * HTTP/2, the connection is handed to an http2_session.
  * 
  * @param ec The error code, if any, from the handshake operation.
  */
@@ -77,6 +104,14 @@ void session::on_handshake(boost::beast::error_code ec)
     }
 
     logger->log(LogLevel::DEBUG, "Handshake successful.");
+    report_phases({AllocPhase::accept, AllocPhase::handshake});
+
+    if(negotiated_http2(stream_)) {
+        // Hand the connection over; this session ends once its last reference goes.
+        logger->log(LogLevel::DEBUG, "ALPN selected h2, switching to HTTP/2.");
+        return std::make_shared<http2_session>(std::move(stream_), doc_root_, app_)->run();
+    }
+
     do_read();
 }
 
@@ -84,24 +119,149 @@ void session::on_handshake(boost::beast::error_code ec)
  * @brief Reads an HTTP request from the client.
  * 
  * Initiates an asynchronous read operation to receive the client's HTTP request.
+ * Requests already in the read buffer are parsed from it without reading the socket.
  */
 void session::do_read()
 {
     auto logger = LoggerManager::getLogger("session_logger");
+    enter_phase(AllocPhase::read);
     logger->log(LogLevel::DEBUG, "Reading request.");
 
     auto read_start_time = std::chrono::steady_clock::now();
 
-    req_ = {};
+    // Requests and responses of one pipelined batch share the arena, so it is only rewound
+    // once every queued response has been written and released in on_write_some.
+    parser_.reset();
+    auto& request_arena = buffers_->request_arena;
+    if (response_count_ == 0) {
+        request_arena.reset();
+    }
+    parser_.emplace(
+            std::piecewise_construct,
+            std::make_tuple(arena_allocator<char>(request_arena)),
+            std::make_tuple(arena_allocator<char>(request_arena)));
+
+    reading_ = true;
+    if(buffers_->read_buffer.size() == 0) {
+        return do_wait(read_start_time);
+    }
+    do_read_header(read_start_time);
+}
+
+/**
+ * @brief Waits, under the idle timeout, for the first bytes of the next request.
+ * 
+ * The connection can be reaped while it waits here.
+ * 
+ * @param read_start_time When reading the request began.
+ */
+void session::do_wait(std::chrono::steady_clock::time_point read_start_time)
+{
+    // Same size as the reads beast::http::async_read makes into an empty buffer
+    constexpr std::size_t initial_read_size = 512;
+
+    beast::get_lowest_layer(stream_).expires_after(SessionTimeouts::get().idle);
+
+    waiting_ = true;
+    reap_hook_.set_idle(true);
+    stream_.async_read_some(
+            buffers_->read_buffer.prepare(initial_read_size),
+            bind_arena(buffers_->request_arena,
+                [self = shared_from_this(), read_start_time](boost::beast::error_code ec, std::size_t bytes_transferred) {
+                    self->on_wait(ec, bytes_transferred, read_start_time);
+                }));
+}
+
+/**
+ * @brief Handles the first bytes of a request, or the end of an idle wait.
+ * 
+ * @param ec The error code, if any, from the read operation.
+ * @param bytes_transferred The number of bytes read.
+ * @param read_start_time When reading the request began.
+ */
+void session::on_wait(boost::beast::error_code ec, std::size_t bytes_transferred, std::chrono::steady_clock::time_point read_start_time)
+{
+    auto logger = LoggerManager::getLogger("session_logger");
+    waiting_ = false;
+    reap_hook_.set_idle(false);
+    buffers_->read_buffer.commit(bytes_transferred);
+
+    if(reaped_ || ec == beast::error::timeout) {
+        // The socket is already closed, so there is no TLS shutdown to perform.
+        logger->log(LogLevel::DEBUG, reaped_ ? "Idle connection reaped." : "Idle connection timed out.");
+        reading_ = false;
+        read_closed_ = true;
+        return;
+    }
 
-    beast::get_lowest_layer(stream_).expires_after(std::chrono::seconds(30));
+    if(ec == net::error::eof || ec == ssl::error::stream_truncated) {
+        ec = http::error::end_of_stream;  // As beast::http::async_read reports it
+    }
+    if(ec) {
+        return on_read(ec, bytes_transferred, read_start_time);
+    }
 
-    http::async_read(stream_, buffer_, req_,
-            [self = shared_from_this(), read_start_time](boost::beast::error_code ec, std::size_t bytes_transferred) {
-                self->on_read(ec, bytes_transferred, read_start_time);
-            });
+    do_read_header(read_start_time);
 }
 
+/**
+ * @brief Reads the request header under the header timeout.
+ * 
+ * The deadline runs from the first byte of the request, so a client trickling
+ * in its header cannot hold the connection open.
+ * 
+ * @param read_start_time When reading the request began.
+ */
+void session::do_read_header(std::chrono::steady_clock::time_point read_start_time)
+{
+    beast::get_lowest_layer(stream_).expires_after(SessionTimeouts::get().header);
+
+    http::async_read_header(stream_, buffers_->read_buffer, *parser_,
+            bind_arena(buffers_->request_arena,
+                [self = shared_from_this(), read_start_time](boost::beast::error_code ec, std::size_t bytes_transferred) {
+                    self->on_read_header(ec, bytes_transferred, read_start_time);
+                }));
+}
+
+/**
+ * @brief Reads the request body, if any, under the body timeout and minimum transfer rate.
+ * 
+ * @param ec The error code, if any, from reading the header.
+ * @param bytes_transferred The number of bytes read.
+ * @param read_start_time When reading the request began.
+ */
+void session::on_read_header(boost::beast::error_code ec, std::size_t bytes_transferred, std::chrono::steady_clock::time_point read_start_time)
+{
+    if(ec || parser_->is_done()) {
+        return on_read(ec, bytes_transferred, read_start_time);
+    }
+
+    // Chunked bodies get the allowance of the largest body the parser accepts.
+    constexpr std::uint64_t max_request_body = 1024 * 1024;
+    auto const& timeouts = SessionTimeouts::get();
+    beast::get_lowest_layer(stream_).expires_after(
+            timeouts.with_transfer(timeouts.body, parser_->content_length().value_or(max_request_body)));
+
+    http::async_read(stream_, buffers_->read_buffer, *parser_,
+            bind_arena(buffers_->request_arena,
+                [self = shared_from_this(), read_start_time](boost::beast::error_code ec, std::size_t bytes_transferred) {
+                    self->on_read(ec, bytes_transferred, read_start_time);
+                }));
+}
+
+/**
+ * @brief Returns whether another request may be read while earlier responses are queued.
+ */
+bool session::can_read_ahead() const
+{
+    // Beyond this the arena would keep growing for as long as the client keeps pipelining.
+    constexpr std::size_t max_pipelined_arena = 64 * 1024;
+
+    return !reading_ && !read_closed_ && !handler_pending_
+        && buffers_->read_buffer.size() > 0
+        && response_count_ < responses_.size()
+        && buffers_->request_arena.size() < max_pipelined_arena;
+}
 
 /**
  * @brief Handles the completion of the asynchronous read operation.
@@ -115,28 +275,91 @@ void session::on_read(boost::beast::error_code ec, std::size_t bytes_transferred
 {
     boost::ignore_unused(bytes_transferred);
     auto logger = LoggerManager::getLogger("session_logger");
+    reading_ = false;
 
     auto read_end_time = std::chrono::steady_clock::now();
     auto read_duration = std::chrono::duration_cast<std::chrono::microseconds>(read_end_time - read_start_time).count();
     logger->log(LogLevel::DEBUG, "Time to read request: " + std::to_string(read_duration) + " ms");
 
-    if(ec == http::error::end_of_stream) {
-        logger->log(LogLevel::DEBUG, "End of stream detected, closing session.");
-        return do_close();
-    }
-
     if(ec) {
+        // Responses to earlier requests are still delivered; on_write finishes the session.
+        read_closed_ = true;
+        read_error_ = ec;
+        if(response_count_ > 0 || handler_pending_) {
+            return;
+        }
+
+        if(ec == http::error::end_of_stream) {
+            logger->log(LogLevel::DEBUG, "End of stream detected, closing session.");
+            return do_close();
+        }
+
         logger->log(LogLevel::ERROR, "Error reading request: " + ec.message());
         return fail(ec, "read");
     }
 
     logger->log(LogLevel::DEBUG, "Request received successfully.");
-    send_response(
-            handle_request(*doc_root_, std::move(req_), app_));
+    enter_phase(AllocPhase::route);
+    // Requests over the client's budget are answered without being routed
+    auto limited = check_rate_limit(parser_->get(), client_id_);
+    if(!limited && is_blocking_request(parser_->get())) {
+        return route_blocking();
+    }
+
+    auto msg = limited ? std::move(*limited) : handle_request(*doc_root_, parser_->release(), app_);
+    enter_phase(AllocPhase::write);
+    send_response(std::move(msg));
+
+    // Parse ahead while earlier responses are being written
+    if(can_read_ahead()) {
+        do_read();
+    }
 }
 
 /**
- * @brief Sends an HTTP response to the client.
+ * @brief Handles the current request on the application's blocking pool.
+ * 
+ * The request is copied out of the arena, which keeps being used by this session's
+ * strand, and the response is posted back to the strand.
+ */
+void session::route_blocking()
+{
+    auto logger = LoggerManager::getLogger("session_logger");
+    logger->log(LogLevel::DEBUG, "Handing request to the blocking pool.");
+
+    auto req = copy_session_request(parser_->get());
+
+    handler_pending_ = true;
+    net::post(
+            app_->blocking_executor(),
+            [self = shared_from_this(), req = std::move(req)]() mutable {
+                auto msg = handle_request(*self->doc_root_, std::move(req), self->app_);
+                net::post(
+                        self->stream_.get_executor(),
+                        [self, msg = std::move(msg)]() mutable {
+                            self->on_blocking_response(std::move(msg));
+                        });
+            });
+}
+
+/**
+ * @brief Queues the response of a request handled on the blocking pool and resumes reading.
+ * 
+ * @param msg The HTTP response to send.
+ */
+void session::on_blocking_response(http::message_generator&& msg)
+{
+    handler_pending_ = false;
+    enter_phase(AllocPhase::write);
+    send_response(std::move(msg));
+
+    if(can_read_ahead()) {
+        do_read();
+    }
+}
+
+/**
+ * @brief Queues an HTTP response to be sent after the responses to earlier requests.
  * 
  * @param msg The HTTP response to send.
  */
@@ -145,19 +368,77 @@ void session::send_response(http::message_generator&& msg)
     auto logger = LoggerManager::getLogger("session_logger");
     logger->log(LogLevel::DEBUG, "Sending response.");
 
-    bool keep_alive = msg.keep_alive();
+    if(!msg.keep_alive()) {
+        read_closed_ = true;  // Nothing after this response will be answered
+    }
 
-    beast::async_write(
-            stream_,
-            std::move(msg),
-            beast::bind_front_handler(
-                &session::on_write, this->shared_from_this(), keep_alive));
+    // The session owns its responses rather than handing them to beast::async_write, so that
+    // they are destroyed before do_read() rewinds the arena they were allocated from.
+    responses_[(response_head_ + response_count_) % responses_.size()].emplace(std::move(msg));
+    if(++response_count_ == 1) {
+        bytes_written_ = 0;
+        write_start_ = std::chrono::steady_clock::now();
+        do_write();
+    }
+}
+
+/**
+ * @brief Writes the next part of the response at the front of the queue.
+ */
+void session::do_write()
+{
+    beast::error_code ec;
+    auto const buffers = responses_[response_head_]->prepare(ec);
+    if(ec) {
+        return on_write_some(ec, 0);
+    }
+
+    // The whole response must move at the minimum transfer rate, not just this part of it.
+    auto const& timeouts = SessionTimeouts::get();
+    beast::get_lowest_layer(stream_).expires_at(write_start_
+            + timeouts.with_transfer(timeouts.write, bytes_written_ + beast::buffer_bytes(buffers)));
+
+    stream_.async_write_some(
+            buffers,
+            bind_arena(buffers_->request_arena,
+                beast::bind_front_handler(
+                    &session::on_write_some, shared_from_this())));
+}
+
+/**
+ * @brief Handles the completion of a partial write of the current response.
+ * 
+ * Continues writing until the response is complete, then removes it from the queue and calls on_write().
+ * 
+ * @param ec The error code, if any, from the write operation.
+ * @param bytes_transferred The number of bytes transferred by this write.
+ */
+void session::on_write_some(boost::beast::error_code ec, std::size_t bytes_transferred)
+{
+    auto& res = responses_[response_head_];
+    bytes_written_ += bytes_transferred;
+    if(!ec) {
+        res->consume(bytes_transferred);
+        if(!res->is_done()) {
+            return do_write();
+        }
+    }
+
+    bool const keep_alive = res->keep_alive();
+    res.reset();
+    response_head_ = (response_head_ + 1) % responses_.size();
+    --response_count_;
+
+    auto const bytes_written = bytes_written_;
+    bytes_written_ = 0;
+    on_write(keep_alive, ec, bytes_written);
 }
 
 /**
  * @brief Handles the completion of the asynchronous write operation.
  * 
- * Determines whether to keep the connection alive or close it.
+ * Determines whether to keep the connection alive or close it, and continues with the
+ * next queued response or the next read.
  * 
  * @param keep_alive Whether to keep the connection alive.
  * @param ec The error code, if any, from the write operation.
@@ -174,6 +455,7 @@ void session::on_write(bool keep_alive, boost::beast::error_code ec, std::size_t
     }
 
     logger->log(LogLevel::DEBUG, "Response sent successfully.");
+    report_phases({AllocPhase::read, AllocPhase::route, AllocPhase::write});
 
     if(!keep_alive)
     {
@@ -181,6 +463,28 @@ void session::on_write(bool keep_alive, boost::beast::error_code ec, std::size_t
         return do_close();
     }
 
+    if(response_count_ > 0) {
+        write_start_ = std::chrono::steady_clock::now();
+        do_write();
+        // Resume a read-ahead that stopped because the queue was full
+        if(can_read_ahead()) {
+            do_read();
+        }
+        return;
+    }
+
+    if(reading_ || handler_pending_) {
+        return;  // The read or blocking handler in progress queues the next response
+    }
+
+    if(read_closed_) {
+        if(read_error_ && read_error_ != http::error::end_of_stream) {
+            logger->log(LogLevel::ERROR, "Error reading request: " + read_error_.message());
+            return fail(read_error_, "read");
+        }
+        return do_close();
+    }
+
     do_read();
 }
 
@@ -194,7 +498,7 @@ void session::do_close()
     auto logger = LoggerManager::getLogger("session_logger");
     logger->log(LogLevel::DEBUG, "Closing session.");
 
-    beast::get_lowest_layer(stream_).expires_after(std::chrono::seconds(30));
+    beast::get_lowest_layer(stream_).expires_after(SessionTimeouts::get().shutdown);
 
     stream_.async_shutdown(
             beast::bind_front_handler(
@@ -221,3 +525,68 @@ void session::on_shutdown(boost::beast::error_code ec)
     logger->log(LogLevel::DEBUG, "Shutdown completed.");
 }
 
+/**
+ * @brief Asks an idle session to close; called by the idle reaper from any thread.
+ * 
+ * @param owner The session.
+ */
+void session::reap(void* owner)
+{
+    // Only a weak reference: the session may already be on its way out.
+    if(auto self = static_cast<session*>(owner)->weak_from_this().lock()) {
+        // Moved, not copied: if the handler ran and the session ended on another
+        // thread before this returned, a copy left here would be the last reference,
+        // and ~session would unlink from the reaper while its lock is held.
+        auto executor = self->stream_.get_executor();
+        net::post(
+                executor,
+                [self = std::move(self)] {
+                    self->on_reap();
+                });
+    }
+}
+
+/**
+ * @brief Closes the connection if the session is still idle.
+ */
+void session::on_reap()
+{
+    if(!waiting_) {
+        return;  // A request arrived in the meantime
+    }
+
+    // Completes the pending read with an error; on_wait ends the session.
+    reaped_ = true;
+    beast::get_lowest_layer(stream_).close();
+}
+
+/**
+ * @brief Charges subsequent allocations to the given phase (ALLOC_STATS build only).
+ * 
+ * @param phase The phase the session is entering.
+ */
+void session::enter_phase(AllocPhase phase)
+{
+    if (alloc_tracker_) {
+        alloc_tracker_->enter(phase);
+    }
+}
+
+/**
+ * @brief Records the allocations of the given phases as performance metrics and resets them.
+ * 
+ * Reporting itself allocates, so it is charged to AllocPhase::other.
+ * 
+ * @param phases The phases to report.
+ */
+void session::report_phases(std::initializer_list<AllocPhase> phases)
+{
+    if (!alloc_tracker_) {
+        return;
+    }
+
+    alloc_tracker_->enter(AllocPhase::other);
+    for (auto phase : phases) {
+        app_->log_allocation_metric(alloc_phase_name(phase), alloc_tracker_->take(phase));
+    }
+}
@@ -0,0 +1,73 @@
+#include "../include/session_pool.hpp"
+
+namespace {
+
+/// Free sets of buffers kept per thread; more than this go back to the heap.
+constexpr std::size_t max_pooled_buffers = 64;
+
+/// A read buffer that grew past this for one large request is shrunk before it is pooled.
+constexpr std::size_t max_pooled_read_buffer = 64 * 1024;
+
+/**
+ * @brief The calling thread's free list of session buffers.
+ */
+struct buffer_pool {
+    std::vector<session_buffers*> free;
+
+    buffer_pool() { free.reserve(max_pooled_buffers); }
+
+    ~buffer_pool()
+    {
+        for (auto* buffers : free) {
+            delete buffers;
+        }
+    }
+
+    static buffer_pool& local()
+    {
+        thread_local buffer_pool pool;
+        return pool;
+    }
+};
+
+} // namespace
+
+/**
+ * @brief Returns the buffers to the pool instead of freeing them.
+ *
+ * Called when the owning session is destroyed, after its request and
+ * response (which live in the arena) are gone.
+ */
+void session_buffers::recycle::operator()(session_buffers* buffers) const noexcept
+{
+    auto& pool = buffer_pool::local();
+    if (pool.free.size() >= max_pooled_buffers) {
+        delete buffers;
+        return;
+    }
+
+    buffers->read_buffer.clear();
+    if (buffers->read_buffer.capacity() > max_pooled_read_buffer) {
+        buffers->read_buffer.shrink_to_fit();
+    }
+    buffers->request_arena.reset();
+    pool.free.push_back(buffers);  // Capacity is reserved up front; doesn't throw
+}
+
+/**
+ * @brief Takes a set of buffers from the calling thread's free list, or creates pre-sized ones.
+ */
+pooled_session_buffers acquire_session_buffers()
+{
+    auto& pool = buffer_pool::local();
+    if (!pool.free.empty()) {
+        pooled_session_buffers buffers(pool.free.back());
+        pool.free.pop_back();
+        return buffers;
+    }
+
+    pooled_session_buffers buffers(new session_buffers);
+    buffers->read_buffer.reserve(session_buffers::read_buffer_size);
+    buffers->request_arena.reserve(session_buffers::arena_size);
+    return buffers;
+}
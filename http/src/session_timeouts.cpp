@@ -0,0 +1,170 @@
+#include "../include/session_timeouts.hpp"
+#include <unistd.h>
+#include <cstdlib>
+#include <fstream>
+
+namespace {
+
+/**
+ * @brief Reads a non-negative integer from the environment, or returns `fallback`.
+ */
+long long env_number(const char* name, long long fallback)
+{
+    const char* value = std::getenv(name);
+    if (!value || !*value) {
+        return fallback;
+    }
+    long long const parsed = std::atoll(value);
+    return parsed >= 0 ? parsed : fallback;
+}
+
+/**
+ * @brief Reads a timeout in seconds from the environment, or returns `fallback`.
+ */
+SessionTimeouts::duration env_seconds(const char* name, SessionTimeouts::duration fallback)
+{
+    auto const fallback_seconds = std::chrono::duration_cast<std::chrono::seconds>(fallback).count();
+    return std::chrono::seconds(env_number(name, fallback_seconds));
+}
+
+} // namespace
+
+/**
+ * @brief Returns the time allowed to transfer a body of the given size.
+ *
+ * @param base The base timeout of the phase.
+ * @param bytes The size of the body.
+ */
+SessionTimeouts::duration SessionTimeouts::with_transfer(duration base, std::uint64_t bytes) const
+{
+    if (min_transfer_rate == 0) {
+        return base;
+    }
+    return base + std::chrono::duration_cast<duration>(
+            std::chrono::duration<double>(static_cast<double>(bytes) / static_cast<double>(min_transfer_rate)));
+}
+
+/**
+ * @brief Reads the timeouts from the environment.
+ */
+SessionTimeouts SessionTimeouts::from_env()
+{
+    SessionTimeouts timeouts;
+    timeouts.handshake = env_seconds("HANDSHAKE_TIMEOUT", timeouts.handshake);
+    timeouts.header = env_seconds("HEADER_TIMEOUT", timeouts.header);
+    timeouts.body = env_seconds("BODY_TIMEOUT", timeouts.body);
+    timeouts.idle = env_seconds("IDLE_TIMEOUT", timeouts.idle);
+    timeouts.write = env_seconds("WRITE_TIMEOUT", timeouts.write);
+    timeouts.shutdown = env_seconds("SHUTDOWN_TIMEOUT", timeouts.shutdown);
+    timeouts.min_transfer_rate = static_cast<std::uint64_t>(env_number("MIN_TRANSFER_RATE", timeouts.min_transfer_rate));
+    timeouts.reap_connections = static_cast<std::size_t>(env_number("REAP_CONNECTIONS", 0));
+    timeouts.reap_rss_bytes = static_cast<std::size_t>(env_number("REAP_RSS_MB", 0)) * 1024 * 1024;
+    return timeouts;
+}
+
+/**
+ * @brief Returns the timeouts read from the environment at first use.
+ */
+const SessionTimeouts& SessionTimeouts::get()
+{
+    static const SessionTimeouts timeouts = from_env();
+    return timeouts;
+}
+
+idle_reaper::hook::hook(reap_fn reap, void* owner)
+    : reap_(reap)
+    , owner_(owner)
+{
+    idle_reaper::instance().link(*this);
+}
+
+idle_reaper::hook::~hook()
+{
+    idle_reaper::instance().unlink(*this);
+}
+
+/**
+ * @brief Returns the process-wide reaper.
+ */
+idle_reaper& idle_reaper::instance()
+{
+    static idle_reaper reaper;
+    return reaper;
+}
+
+/**
+ * @brief Returns the number of open connections.
+ */
+std::size_t idle_reaper::connections() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return count_;
+}
+
+/**
+ * @brief Reaps idle connections if a limit in the given timeouts is exceeded.
+ *
+ * Over the connection limit, idle connections are reaped oldest first until the
+ * count would be back under it; over the memory limit, every idle connection is.
+ *
+ * @param timeouts Holds the connection and memory limits.
+ * @return The number of connections asked to close.
+ */
+std::size_t idle_reaper::reap_if_pressured(const SessionTimeouts& timeouts)
+{
+    bool const over_memory = timeouts.reap_rss_bytes > 0
+        && resident_memory_bytes() > timeouts.reap_rss_bytes;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool const over_connections = timeouts.reap_connections > 0
+        && count_ > timeouts.reap_connections;
+    if (!over_memory && !over_connections) {
+        return 0;
+    }
+
+    std::size_t reaped = 0;
+    for (auto* h = head_; h; h = h->next_) {
+        if (!over_memory && count_ - reaped <= timeouts.reap_connections) {
+            break;
+        }
+        // Clearing the flag keeps the next check from reaping it again before it has closed.
+        if (h->idle_.exchange(false, std::memory_order_relaxed)) {
+            h->reap_(h->owner_);
+            ++reaped;
+        }
+    }
+    return reaped;
+}
+
+void idle_reaper::link(hook& h)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    h.prev_ = tail_;
+    h.next_ = nullptr;
+    (tail_ ? tail_->next_ : head_) = &h;
+    tail_ = &h;
+    ++count_;
+}
+
+void idle_reaper::unlink(hook& h)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    (h.prev_ ? h.prev_->next_ : head_) = h.next_;
+    (h.next_ ? h.next_->prev_ : tail_) = h.prev_;
+    --count_;
+}
+
+/**
+ * @brief Returns the resident set size of the process in bytes, or 0 if unknown.
+ */
+std::size_t resident_memory_bytes()
+{
+    // The second field of /proc/self/statm is the resident set size in pages.
+    std::ifstream statm("/proc/self/statm");
+    std::size_t total_pages = 0;
+    std::size_t resident_pages = 0;
+    if (!(statm >> total_pages >> resident_pages)) {
+        return 0;
+    }
+    return resident_pages * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
@@ -0,0 +1,164 @@
+#include "../include/socket_tuning.hpp"
+#include "../../log/include/log.hpp"
+#include <boost/system/error_code.hpp>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+/**
+ * @brief Integer socket option for the levels and names Asio has no type for.
+ *
+ * Meets Asio's SettableSocketOption requirements.
+ */
+template <int Level, int Name>
+class int_option {
+public:
+    explicit int_option(int value) : value_(value) {}
+
+    template <class Protocol>
+    int level(const Protocol&) const { return Level; }
+
+    template <class Protocol>
+    int name(const Protocol&) const { return Name; }
+
+    template <class Protocol>
+    const int* data(const Protocol&) const { return &value_; }
+
+    template <class Protocol>
+    std::size_t size(const Protocol&) const { return sizeof(value_); }
+
+private:
+    int value_;
+};
+
+/**
+ * @brief Reads a non-negative integer from the environment, or returns `fallback`.
+ */
+int env_int(const char* name, int fallback)
+{
+    const char* value = std::getenv(name);
+    if (!value || !*value) {
+        return fallback;
+    }
+    int const parsed = std::atoi(value);
+    return parsed >= 0 ? parsed : fallback;
+}
+
+/**
+ * @brief Sets an option and logs a warning if the kernel rejects it.
+ */
+template <class Socket, class Option>
+void set_option(Socket& socket, const Option& option, const char* name)
+{
+    boost::system::error_code ec;
+    socket.set_option(option, ec);
+    if (ec) {
+        auto logger = LoggerManager::getLogger("socket_tuning_logger", LogLevel::INFO);
+        logger->log(LogLevel::WARN, std::string("Could not set ") + name + ": " + ec.message());
+    }
+}
+
+/**
+ * @brief Applies the buffer sizes; shared by the listener and outbound sockets.
+ */
+template <class Socket>
+void apply_buffer_sizes(Socket& socket, const SocketTuning& tuning)
+{
+    if (tuning.rcvbuf > 0) {
+        set_option(socket, boost::asio::socket_base::receive_buffer_size(tuning.rcvbuf), "SO_RCVBUF");
+    }
+    if (tuning.sndbuf > 0) {
+        set_option(socket, boost::asio::socket_base::send_buffer_size(tuning.sndbuf), "SO_SNDBUF");
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Reads the options from the environment.
+ */
+SocketTuning SocketTuning::from_env()
+{
+    SocketTuning tuning;
+    tuning.nodelay = env_int("TCP_NODELAY", 1) != 0;
+    tuning.defer_accept = env_int("TCP_DEFER_ACCEPT", 0);
+    tuning.fastopen = env_int("TCP_FASTOPEN", 0);
+    tuning.rcvbuf = env_int("SOCKET_RCVBUF", 0);
+    tuning.sndbuf = env_int("SOCKET_SNDBUF", 0);
+    tuning.busy_poll = env_int("SOCKET_BUSY_POLL", 0);
+    tuning.notsent_lowat = env_int("TCP_NOTSENT_LOWAT", 0);
+    tuning.backlog = env_int("LISTEN_BACKLOG", tuning.backlog);
+    if (tuning.backlog == 0) {
+        tuning.backlog = boost::asio::socket_base::max_listen_connections;
+    }
+    return tuning;
+}
+
+/**
+ * @brief Returns the options read from the environment at first use.
+ */
+const SocketTuning& SocketTuning::get()
+{
+    static const SocketTuning tuning = from_env();
+    return tuning;
+}
+
+/**
+ * @brief Applies the listener options to an open acceptor that is not yet listening.
+ *
+ * @param acceptor The acceptor.
+ * @param tuning The options to apply.
+ */
+void apply_listener_options(boost::asio::ip::tcp::acceptor& acceptor, const SocketTuning& tuning)
+{
+    apply_buffer_sizes(acceptor, tuning);
+#ifdef TCP_DEFER_ACCEPT
+    if (tuning.defer_accept > 0) {
+        set_option(acceptor, int_option<IPPROTO_TCP, TCP_DEFER_ACCEPT>(tuning.defer_accept), "TCP_DEFER_ACCEPT");
+    }
+#endif
+#ifdef TCP_FASTOPEN
+    if (tuning.fastopen > 0) {
+        set_option(acceptor, int_option<IPPROTO_TCP, TCP_FASTOPEN>(tuning.fastopen), "TCP_FASTOPEN");
+    }
+#endif
+}
+
+/**
+ * @brief Applies the per-connection options to an accepted socket.
+ *
+ * @param socket The accepted socket.
+ * @param tuning The options to apply.
+ */
+void apply_connection_options(boost::asio::ip::tcp::socket& socket, const SocketTuning& tuning)
+{
+    if (tuning.nodelay) {
+        set_option(socket, boost::asio::ip::tcp::no_delay(true), "TCP_NODELAY");
+    }
+#ifdef SO_BUSY_POLL
+    if (tuning.busy_poll > 0) {
+        set_option(socket, int_option<SOL_SOCKET, SO_BUSY_POLL>(tuning.busy_poll), "SO_BUSY_POLL");
+    }
+#endif
+#ifdef TCP_NOTSENT_LOWAT
+    if (tuning.notsent_lowat > 0) {
+        set_option(socket, int_option<IPPROTO_TCP, TCP_NOTSENT_LOWAT>(tuning.notsent_lowat), "TCP_NOTSENT_LOWAT");
+    }
+#endif
+}
+
+/**
+ * @brief Applies the per-connection options and buffer sizes to a connected outbound socket.
+ *
+ * @param socket The connected socket.
+ * @param tuning The options to apply.
+ */
+void apply_outbound_options(boost::asio::ip::tcp::socket& socket, const SocketTuning& tuning)
+{
+    apply_buffer_sizes(socket, tuning);
+    apply_connection_options(socket, tuning);
+}
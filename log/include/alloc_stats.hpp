@@ -0,0 +1,127 @@
+#ifndef ALLOC_STATS_HPP
+#define ALLOC_STATS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @file alloc_stats.hpp
+ * @brief Heap allocation counting for the ALLOC_STATS build.
+ *
+ * Building with `make ALLOC_STATS=1` defines MMLBEAST_ALLOC_STATS, which
+ * replaces the global operator new/delete with versions that count the
+ * allocations and bytes requested on each thread. Everything here compiles
+ * to no-ops otherwise, so call sites need no preprocessor guards.
+ *
+ * Only allocations made through operator new are seen; OpenSSL and SQLite
+ * call malloc directly and are not counted.
+ */
+
+/**
+ * @brief Number of allocations and bytes requested through operator new.
+ */
+struct AllocCounters {
+    std::uint64_t allocs = 0;  ///< Number of allocations.
+    std::uint64_t bytes = 0;   ///< Bytes requested.
+
+    AllocCounters& operator+=(const AllocCounters& other) noexcept
+    {
+        allocs += other.allocs;
+        bytes += other.bytes;
+        return *this;
+    }
+};
+
+inline AllocCounters operator-(const AllocCounters& a, const AllocCounters& b) noexcept
+{
+    return {a.allocs - b.allocs, a.bytes - b.bytes};
+}
+
+namespace alloc_stats {
+
+#ifdef MMLBEAST_ALLOC_STATS
+constexpr bool enabled = true;  ///< True when operator new is being counted.
+
+/**
+ * @brief Returns the running totals for the calling thread.
+ *
+ * Take the difference of two calls to measure a region of code.
+ */
+AllocCounters thread_counters() noexcept;
+#else
+constexpr bool enabled = false;  ///< True when operator new is being counted.
+
+inline AllocCounters thread_counters() noexcept { return {}; }
+#endif
+
+} // namespace alloc_stats
+
+/**
+ * @brief Phases of a connection that allocations are charged to.
+ */
+enum class AllocPhase : std::size_t {
+    accept,     ///< Accepting the socket and constructing the session.
+    handshake,  ///< TLS handshake.
+    read,       ///< Reading and parsing a request.
+    route,      ///< Running the request handler.
+    write,      ///< Serializing and writing the response.
+    other,      ///< Anything else, including reporting the counters themselves.
+    count
+};
+
+/**
+ * @brief Returns the name of a phase, as used in metric names.
+ */
+const char* alloc_phase_name(AllocPhase phase) noexcept;
+
+/**
+ * @brief Charges the allocations of one connection to its current phase.
+ *
+ * Work for a connection runs as a series of handlers on its strand; each
+ * handler is wrapped in a Scope (see alloc_phase_executor.hpp), so the
+ * allocations made by asynchronous operations while parsing or serializing
+ * are charged as well as those made by the session's own code. The session
+ * calls enter() at each phase transition and take() when reporting.
+ *
+ * Not thread-safe; it relies on the strand to serialize handlers.
+ */
+class AllocPhaseTracker {
+public:
+    /**
+     * @brief Marks the execution of one handler for this connection.
+     */
+    class Scope {
+    public:
+        explicit Scope(AllocPhaseTracker& tracker) noexcept;
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        AllocPhaseTracker& tracker_;
+    };
+
+    /**
+     * @brief Charges what was allocated so far to the current phase and switches to `phase`.
+     */
+    void enter(AllocPhase phase) noexcept;
+
+    /**
+     * @brief Returns and resets the counters of a phase.
+     */
+    AllocCounters take(AllocPhase phase) noexcept;
+
+private:
+    /**
+     * @brief Adds the allocations since the last mark to the current phase.
+     */
+    void charge() noexcept;
+
+    AllocPhase phase_ = AllocPhase::accept;
+    std::size_t depth_ = 0;
+    AllocCounters mark_;
+    std::array<AllocCounters, static_cast<std::size_t>(AllocPhase::count)> counters_{};
+};
+
+#endif // ALLOC_STATS_HPP
@@ -0,0 +1,150 @@
+#include "../include/alloc_stats.hpp"
+#include <cstdlib>
+#include <new>
+
+#ifdef MMLBEAST_ALLOC_STATS
+
+namespace {
+
+// Plain thread_local PODs: touching them from operator new must not allocate.
+thread_local AllocCounters tls_counters;
+
+void* counted_alloc(std::size_t size)
+{
+    ++tls_counters.allocs;
+    tls_counters.bytes += size;
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* counted_aligned_alloc(std::size_t size, std::align_val_t alignment)
+{
+    ++tls_counters.allocs;
+    tls_counters.bytes += size;
+    void* p = nullptr;
+    auto const align = static_cast<std::size_t>(alignment) < sizeof(void*) ? sizeof(void*) : static_cast<std::size_t>(alignment);
+    if (posix_memalign(&p, align, size == 0 ? 1 : size) != 0) {
+        return nullptr;
+    }
+    return p;
+}
+
+} // namespace
+
+/**
+ * @brief Returns the running totals for the calling thread.
+ */
+AllocCounters alloc_stats::thread_counters() noexcept
+{
+    return tls_counters;
+}
+
+void* operator new(std::size_t size)
+{
+    if (void* p = counted_alloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    if (void* p = counted_alloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (void* p = counted_aligned_alloc(size, alignment)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    if (void* p = counted_aligned_alloc(size, alignment)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return counted_aligned_alloc(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return counted_aligned_alloc(size, alignment); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+
+#endif // MMLBEAST_ALLOC_STATS
+
+/**
+ * @brief Returns the name of a phase, as used in metric names.
+ */
+const char* alloc_phase_name(AllocPhase phase) noexcept
+{
+    switch (phase) {
+        case AllocPhase::accept: return "accept";
+        case AllocPhase::handshake: return "handshake";
+        case AllocPhase::read: return "read";
+        case AllocPhase::route: return "route";
+        case AllocPhase::write: return "write";
+        default: return "other";
+    }
+}
+
+AllocPhaseTracker::Scope::Scope(AllocPhaseTracker& tracker) noexcept
+    : tracker_(tracker)
+{
+    // Nested handlers (e.g. a dispatch that runs inline) keep the outer mark.
+    if (tracker_.depth_++ == 0) {
+        tracker_.mark_ = alloc_stats::thread_counters();
+    }
+}
+
+AllocPhaseTracker::Scope::~Scope()
+{
+    if (--tracker_.depth_ == 0) {
+        tracker_.charge();
+    }
+}
+
+/**
+ * @brief Charges what was allocated so far to the current phase and switches to `phase`.
+ */
+void AllocPhaseTracker::enter(AllocPhase phase) noexcept
+{
+    charge();
+    phase_ = phase;
+}
+
+/**
+ * @brief Returns and resets the counters of a phase.
+ */
+AllocCounters AllocPhaseTracker::take(AllocPhase phase) noexcept
+{
+    charge();
+    auto& counters = counters_[static_cast<std::size_t>(phase)];
+    auto const taken = counters;
+    counters = {};
+    return taken;
+}
+
+/**
+ * @brief Adds the allocations since the last mark to the current phase.
+ */
+void AllocPhaseTracker::charge() noexcept
+{
+    // Outside a handler there is no mark for this thread.
+    if (depth_ == 0) {
+        return;
+    }
+    auto const now = alloc_stats::thread_counters();
+    counters_[static_cast<std::size_t>(phase_)] += now - mark_;
+    mark_ = now;
+}
@@ -30,7 +30,11 @@ int main(int argc, char* argv[])
     auto const threads = std::max<int>(1, std::atoi(argv[4]));
 
     // Initialize the io_context
+#if defined(BOOST_ASIO_HAS_IO_URING) && defined(BOOST_ASIO_DISABLE_EPOLL)
+    logger->log(LogLevel::DEBUG, "Initializing io_context (io_uring backend).");
+#else
     logger->log(LogLevel::DEBUG, "Initializing io_context.");
+#endif
     net::io_context ioc{threads};
 
     // Initialize SSL context
@@ -0,0 +1,353 @@
+#ifndef JSON_SCAN_HPP
+#define JSON_SCAN_HPP
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief On-demand access to the top-level members of a JSON object.
+ *
+ * find_fields() walks the object once and returns the raw text of the members
+ * asked for, skipping everything else without decoding it: strings are jumped
+ * over by searching for the next quote or backslash, and nested objects and
+ * arrays by searching for the next bracket or quote, 16 bytes at a time with
+ * SSE2 where available. The members that are needed are then decoded with
+ * decode_string(), decode_bool() or decode_int(); nothing builds a DOM.
+ *
+ * The walk checks the structure of the top-level object but, like other
+ * on-demand parsers, does not validate values it skips. Keys are compared as
+ * written, so a key spelled with escapes does not match.
+ */
+namespace json_scan {
+
+namespace detail {
+
+/**
+ * @brief Returns the first `"` or `\` in [p, end), or end.
+ */
+inline const char* find_quote_or_backslash(const char* p, const char* end)
+{
+#if defined(__SSE2__)
+    __m128i const quote = _mm_set1_epi8('"');
+    __m128i const backslash = _mm_set1_epi8('\\');
+    for (; end - p >= 16; p += 16) {
+        __m128i const chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int const mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+        if (mask != 0) {
+            return p + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+    }
+#endif
+    for (; p < end; ++p) {
+        if (*p == '"' || *p == '\\') {
+            return p;
+        }
+    }
+    return end;
+}
+
+/**
+ * @brief Returns the first quote or bracket in [p, end), or end.
+ */
+inline const char* find_structural(const char* p, const char* end)
+{
+#if defined(__SSE2__)
+    __m128i const quote = _mm_set1_epi8('"');
+    __m128i const open_brace = _mm_set1_epi8('{');
+    __m128i const close_brace = _mm_set1_epi8('}');
+    __m128i const open_bracket = _mm_set1_epi8('[');
+    __m128i const close_bracket = _mm_set1_epi8(']');
+    for (; end - p >= 16; p += 16) {
+        __m128i const chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i const hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, open_brace)),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, close_brace), _mm_cmpeq_epi8(chunk, open_bracket)),
+                         _mm_cmpeq_epi8(chunk, close_bracket)));
+        int const mask = _mm_movemask_epi8(hits);
+        if (mask != 0) {
+            return p + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+    }
+#endif
+    for (; p < end; ++p) {
+        if (*p == '"' || *p == '{' || *p == '}' || *p == '[' || *p == ']') {
+            return p;
+        }
+    }
+    return end;
+}
+
+inline const char* skip_whitespace(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        ++p;
+    }
+    return p;
+}
+
+/**
+ * @brief Returns the position after the string whose opening quote is at `p`, or nullptr.
+ */
+inline const char* skip_string(const char* p, const char* end)
+{
+    ++p;
+    for (;;) {
+        p = find_quote_or_backslash(p, end);
+        if (p == end) {
+            return nullptr;
+        }
+        if (*p == '"') {
+            return p + 1;
+        }
+        p += 2;  // The escaped character cannot end the string
+        if (p > end) {
+            return nullptr;
+        }
+    }
+}
+
+/**
+ * @brief Returns the position after the value starting at `p`, or nullptr if it is cut short.
+ */
+inline const char* skip_value(const char* p, const char* end)
+{
+    if (p == end) {
+        return nullptr;
+    }
+    if (*p == '"') {
+        return skip_string(p, end);
+    }
+    if (*p == '{' || *p == '[') {
+        std::size_t depth = 0;
+        for (;;) {
+            p = find_structural(p, end);
+            if (p == end) {
+                return nullptr;
+            }
+            if (*p == '"') {
+                p = skip_string(p, end);
+                if (!p) {
+                    return nullptr;
+                }
+                continue;
+            }
+            if (*p == '{' || *p == '[') {
+                ++depth;
+            } else if (--depth == 0) {
+                return p + 1;
+            }
+            ++p;
+        }
+    }
+
+    // Number or literal: runs to the next delimiter
+    const char* const start = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
+        ++p;
+    }
+    return p == start ? nullptr : p;
+}
+
+inline void append_utf8(std::string& out, std::uint32_t cp)
+{
+    if (cp < 0x80) {
+        out.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+}
+
+inline bool parse_hex4(const char* p, std::uint32_t& out)
+{
+    out = 0;
+    for (int i = 0; i < 4; ++i) {
+        char const c = p[i];
+        int const digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digit < 0) {
+            return false;
+        }
+        out = out << 4 | static_cast<std::uint32_t>(digit);
+    }
+    return true;
+}
+
+} // namespace detail
+
+/**
+ * @brief Finds top-level members of a JSON object.
+ *
+ * @param json The JSON text; must be an object.
+ * @param keys The member names to look for.
+ * @param values Receives, for each key in order, the raw text of its value, or
+ *               an empty view if the object has no such member. The last
+ *               occurrence wins, as with nlohmann::json.
+ * @return Whether the text is a well-formed object at the top level.
+ */
+inline bool find_fields(std::string_view json, std::initializer_list<std::string_view> keys, std::string_view* values)
+{
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        values[i] = {};
+    }
+
+    const char* p = json.data();
+    const char* const end = p + json.size();
+    p = detail::skip_whitespace(p, end);
+    if (p == end || *p != '{') {
+        return false;
+    }
+    p = detail::skip_whitespace(p + 1, end);
+    if (p < end && *p == '}') {
+        return detail::skip_whitespace(p + 1, end) == end;
+    }
+
+    for (;;) {
+        if (p == end || *p != '"') {
+            return false;
+        }
+        const char* const key_end = detail::skip_string(p, end);
+        if (!key_end) {
+            return false;
+        }
+        std::string_view const key(p + 1, static_cast<std::size_t>(key_end - p - 2));
+
+        p = detail::skip_whitespace(key_end, end);
+        if (p == end || *p != ':') {
+            return false;
+        }
+        p = detail::skip_whitespace(p + 1, end);
+        const char* const value_end = detail::skip_value(p, end);
+        if (!value_end) {
+            return false;
+        }
+
+        std::size_t i = 0;
+        for (auto const& wanted : keys) {
+            if (key == wanted) {
+                values[i] = std::string_view(p, static_cast<std::size_t>(value_end - p));
+            }
+            ++i;
+        }
+
+        p = detail::skip_whitespace(value_end, end);
+        if (p == end) {
+            return false;
+        }
+        if (*p == '}') {
+            return detail::skip_whitespace(p + 1, end) == end;
+        }
+        if (*p != ',') {
+            return false;
+        }
+        p = detail::skip_whitespace(p + 1, end);
+    }
+}
+
+/**
+ * @brief Decodes the raw text of a JSON string value.
+ *
+ * @param raw The value as returned by find_fields(), quotes included.
+ * @param out Receives the unescaped UTF-8 text.
+ * @return Whether `raw` is a valid string.
+ */
+inline bool decode_string(std::string_view raw, std::string& out)
+{
+    if (raw.size() < 2 || raw.front() != '"' || raw.back() != '"') {
+        return false;
+    }
+    const char* p = raw.data() + 1;
+    const char* const end = raw.data() + raw.size() - 1;
+
+    out.clear();
+    for (;;) {
+        const char* const special = detail::find_quote_or_backslash(p, end);
+        out.append(p, static_cast<std::size_t>(special - p));
+        if (special == end) {
+            return true;
+        }
+        if (*special == '"' || end - special < 2) {
+            return false;  // An unescaped quote inside, or a dangling backslash
+        }
+
+        p = special + 2;
+        switch (special[1]) {
+        case '"': out.push_back('"'); break;
+        case '\\': out.push_back('\\'); break;
+        case '/': out.push_back('/'); break;
+        case 'b': out.push_back('\b'); break;
+        case 'f': out.push_back('\f'); break;
+        case 'n': out.push_back('\n'); break;
+        case 'r': out.push_back('\r'); break;
+        case 't': out.push_back('\t'); break;
+        case 'u': {
+            std::uint32_t cp = 0;
+            if (end - p < 4 || !detail::parse_hex4(p, cp)) {
+                return false;
+            }
+            p += 4;
+            if (cp >= 0xD800 && cp < 0xDC00) {
+                // High surrogate: must be followed by an escaped low surrogate
+                std::uint32_t low = 0;
+                if (end - p < 6 || p[0] != '\\' || p[1] != 'u' || !detail::parse_hex4(p + 2, low)
+                        || low < 0xDC00 || low >= 0xE000) {
+                    return false;
+                }
+                p += 6;
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            } else if (cp >= 0xDC00 && cp < 0xE000) {
+                return false;
+            }
+            detail::append_utf8(out, cp);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+}
+
+/**
+ * @brief Decodes the raw text of a JSON boolean.
+ */
+inline bool decode_bool(std::string_view raw, bool& out)
+{
+    if (raw == "true") {
+        out = true;
+        return true;
+    }
+    if (raw == "false") {
+        out = false;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Decodes the raw text of a JSON integer.
+ */
+inline bool decode_int(std::string_view raw, std::int64_t& out)
+{
+    auto const [ptr, ec] = std::from_chars(raw.data(), raw.data() + raw.size(), out);
+    return ec == std::errc() && ptr == raw.data() + raw.size();
+}
+
+} // namespace json_scan
+
+#endif // JSON_SCAN_HPP
@@ -61,6 +61,11 @@
 */
 #include "base64.hpp"
 
+/* 
+    On-demand scanning of the members read from streamed replies.
+*/
+#include "json_scan.hpp"
+
 #include <string>
 #include <memory>
 #include <fstream>
@@ -69,6 +74,9 @@
 #include <functional>
 #include <exception>
 #include <initializer_list>
+#include <atomic>
+#include <string_view>
+#include <cstring>
 
 // Namespace types and classes
 namespace ollama
@@ -287,57 +295,86 @@ namespace ollama
         message_type type;
     };
 
+    // A reply from the server. The text and everything extracted from it live in one immutable block that copies
+    // share, so passing a response around or storing it costs a reference count rather than a copy of the text.
     class response {
 
         public:
 
-            response(const std::string& json_string, message_type type=message_type::generation): type(type)
+            response(std::string json_string, message_type type=message_type::generation): type(type)
             {
-                this->json_string = json_string;
-                try 
-                {
-                    json_data = json::parse(json_string); 
-                    
-                    if (type==message_type::generation && json_data.contains("response")) simple_string=json_data["response"].get<std::string>(); 
-                    else
-                    if (type==message_type::embedding && json_data.contains("embeddings")) simple_string=json_data["embeddings"].get<std::string>();
-                    else
-                    if (type==message_type::chat && json_data.contains("message")) simple_string=json_data["message"]["content"].get<std::string>();
-                                         
-                    if ( json_data.contains("error") ) error_string =json_data["error"].get<std::string>();
-                }
-                catch(...) { if (ollama::use_exceptions) throw ollama::invalid_json_exception("Unable to parse JSON string:"+this->json_string); valid = false; }
+                std::shared_ptr<contents> parsed = std::make_shared<contents>();
+                parsed->json_string = std::move(json_string);
+                // Streamed generation chunks are only read for a few members, so they are scanned in place; the
+                // document is parsed on the first call to as_json().
+                valid = type==message_type::generation ? parsed->scan_generation() : parsed->parse_document(type);
+                if (!valid && ollama::use_exceptions) throw ollama::invalid_json_exception("Unable to parse JSON string:"+parsed->json_string);
+                data = std::move(parsed);
             }
             
-            response() {json_string = ""; valid = false;}
-            ~response(){};
+            response(): data(empty_contents()), type(message_type::generation), valid(false) {}
 
             bool is_valid() const {return valid;};
 
             const std::string& as_json_string() const
             {
-                return json_string;
+                return data->json_string;
             }
 
             const json& as_json() const
             {
-                return json_data;                
+                std::shared_ptr<const json> document = std::atomic_load(&data->json_data);
+                if (!document)
+                {
+                    std::shared_ptr<const json> parsed = std::make_shared<const json>(valid ? json::parse(data->json_string, nullptr, false) : json());
+                    std::shared_ptr<const json> expected;
+                    if (std::atomic_compare_exchange_strong(&data->json_data, &expected, parsed)) document = parsed; else document = expected;
+                }
+                return *document;
             }
 
             const std::string& as_simple_string() const
             {
-                return simple_string;               
+                return data->simple_string;               
+            }
+
+            bool has_error() const
+            {
+                return data->error_present;
+            }
+
+            // Whether this is the last chunk of a generation ("done": true).
+            bool is_done() const
+            {
+                return data->done;
+            }
+
+            // Number of tokens generated, reported with the last chunk.
+            int64_t get_eval_count() const
+            {
+                return data->eval_count;
             }
 
-            const bool has_error() const
+            // The raw text of the "context" array of a generation reply, or empty if it has none.
+            std::string_view get_context() const
             {
-                if ( json_data.contains("error") ) return true;
-                return false;                
+                return data->context;
+            }
+
+            // A response holding only the context of this one, for continuing the conversation without keeping the
+            // rest of the reply alive.
+            response context_only() const
+            {
+                if (data->context.empty()) return response();
+                std::string text;
+                text.reserve(data->context.size() + 12);
+                text.append("{\"context\":").append(data->context).append("}");
+                return response(std::move(text));
             }
 
             const std::string& get_error() const
             {
-                return error_string;
+                return data->error_string;
             }
 
             friend std::ostream& operator<<(std::ostream& os, const ollama::response& response) { os << response.as_simple_string(); return os; }
@@ -354,15 +391,105 @@ namespace ollama
 
         private:
 
-        std::string json_string;
-        std::string simple_string;
-        std::string error_string;
+        struct contents
+        {
+            std::string json_string;
+            std::string simple_string;
+            std::string error_string;
+            std::string_view context;  // Into json_string
+            mutable std::shared_ptr<const json> json_data;  // Null until as_json() is first called on a scanned response
+            bool error_present = false;
+            bool done = false;
+            int64_t eval_count = 0;
+
+            bool scan_generation()
+            {
+                std::string_view fields[5];
+                if (!json_scan::find_fields(json_string, {"response", "done", "eval_count", "error", "context"}, fields)) return false;
+
+                if (!fields[0].empty() && !json_scan::decode_string(fields[0], simple_string)) return false;
+                if (!fields[1].empty() && !json_scan::decode_bool(fields[1], done)) return false;
+                if (!fields[2].empty() && !json_scan::decode_int(fields[2], eval_count)) return false;
+                if (!fields[3].empty())
+                {
+                    error_present = true;
+                    if (!json_scan::decode_string(fields[3], error_string)) return false;
+                }
+                context = fields[4];
+                return true;
+            }
+
+            bool parse_document(message_type type)
+            {
+                try 
+                {
+                    std::shared_ptr<json> document = std::make_shared<json>(json::parse(json_string));
+
+                    if (type==message_type::embedding && document->contains("embeddings")) simple_string=(*document)["embeddings"].get<std::string>();
+                    else
+                    if (type==message_type::chat && document->contains("message")) simple_string=(*document)["message"]["content"].get<std::string>();
+
+                    if ( document->contains("error") ) { error_present = true; error_string = (*document)["error"].get<std::string>(); }
+                    if ( document->contains("done") && (*document)["done"].is_boolean() ) done = (*document)["done"].get<bool>();
+                    json_data = std::move(document);
+                }
+                catch(...) { return false; }
+                return true;
+            }
+        };
+
+        static const std::shared_ptr<const contents>& empty_contents()
+        {
+            static const std::shared_ptr<const contents> empty = std::make_shared<const contents>();
+            return empty;
+        }
 
-        json json_data;        
+        std::shared_ptr<const contents> data;
         message_type type;
-        bool valid;        
+        bool valid;
     };
 
+    // Build the httplib content receiver used for streaming replies. Replies are newline-delimited JSON: each complete
+    // line is turned into a response and passed to on_receive_token, and a line split across chunks is carried over
+    // until its newline arrives. Lines that do not parse are skipped.
+    inline std::function<bool(const char*, size_t)> make_stream_callback(std::function<void(const ollama::response&)> on_receive_token, message_type type=message_type::generation, bool throw_on_error=false)
+    {
+        std::shared_ptr<std::string> carry = std::make_shared<std::string>();
+
+        return [on_receive_token, carry, type, throw_on_error](const char *data, size_t data_length)->bool{
+            
+            if (ollama::log_replies) std::cout << std::string(data, data_length) << std::endl;
+
+            auto deliver = [&](const char* line, size_t length)
+            {
+                while (length > 0 && (line[length-1] == '\r' || line[length-1] == ' ')) --length;
+                if (length == 0) return;
+                try 
+                {   
+                    ollama::response response(std::string(line, length), type);
+                    if ( throw_on_error && response.has_error() ) { if (ollama::use_exceptions) throw ollama::exception("Ollama response returned error: "+response.get_error() ); }
+                    on_receive_token(response); 
+                }
+                catch (const ollama::invalid_json_exception& e) { /* Malformed line; nothing to deliver. */ }
+            };
+
+            const char* end = data + data_length;
+            const char* line = data;
+            while (const char* newline = static_cast<const char*>(memchr(line, '\n', end - line)))
+            {
+                if (carry->empty()) deliver(line, newline - line);
+                else { carry->append(line, newline - line); deliver(carry->data(), carry->size()); carry->clear(); }
+                line = newline + 1;
+            }
+            carry->append(line, end - line);
+
+            // Ollama ends every line with a newline, but an error reply can arrive as a single unterminated object.
+            if (!carry->empty() && json_scan::find_fields(*carry, {}, nullptr)) { deliver(carry->data(), carry->size()); carry->clear(); }
+            
+            return true;
+        };
+    }
+
 }
 
 class Ollama
@@ -384,7 +511,7 @@ class Ollama
     ollama::response generate(const std::string& model,const std::string& prompt, const ollama::response& context, const json& options=nullptr, const std::vector<std::string>& images=std::vector<std::string>())
     {
         ollama::request request(model, prompt, options, false, images);
-        if ( context.as_json().contains("context") ) request["context"] = context.as_json()["context"];
+        if ( !context.get_context().empty() ) request["context"] = json::parse(context.get_context());
         return generate(request);
     }
 
@@ -421,7 +548,7 @@ class Ollama
     bool generate(const std::string& model,const std::string& prompt, ollama::response& context, std::function<void(const ollama::response&)> on_receive_token, const json& options=nullptr, const std::vector<std::string>& images=std::vector<std::string>())
     {
         ollama::request request(model, prompt, options, true, images);
-        if ( context.as_json().contains("context") ) request["context"] = context.as_json()["context"];
+        if ( !context.get_context().empty() ) request["context"] = json::parse(context.get_context());
         return generate(request, on_receive_token);
     }
 
@@ -439,24 +566,7 @@ class Ollama
         std::string request_string = request.dump();
         if (ollama::log_requests) std::cout << request_string << std::endl;
 
-        std::shared_ptr<std::vector<std::string>> partial_responses = std::make_shared<std::vector<std::string>>();
-
-        auto stream_callback = [on_receive_token, partial_responses](const char *data, size_t data_length)->bool{
-            
-            std::string message(data, data_length);
-            if (ollama::log_replies) std::cout << message << std::endl;
-            try 
-            {   
-                partial_responses->push_back(message);
-                std::string total_response = std::accumulate(partial_responses->begin(), partial_responses->end(), std::string(""));                
-                ollama::response response(total_response);
-                partial_responses->clear();  
-                on_receive_token(response); 
-            }
-            catch (const ollama::invalid_json_exception& e) { /* Partial response was received. Will do nothing and attempt to concatenate with the next response. */ }
-            
-            return true;
-        };
+        auto stream_callback = ollama::make_stream_callback(on_receive_token);
 
         if (auto res = this->cli->Post("/api/generate", request_string, "application/json", stream_callback)) { return true; }
         else { if (ollama::use_exceptions) throw ollama::exception( "No response from server returned at URL"+this->server_url+" Error: "+httplib::to_string( res.error() ) ); } 
@@ -509,26 +619,7 @@ class Ollama
         std::string request_string = request.dump();
         if (ollama::log_requests) std::cout << request_string << std::endl;      
 
-        std::shared_ptr<std::vector<std::string>> partial_responses = std::make_shared<std::vector<std::string>>();
-
-        auto stream_callback = [on_receive_token, partial_responses](const char *data, size_t data_length)->bool{
-            
-            std::string message(data, data_length);
-            if (ollama::log_replies) std::cout << message << std::endl;
-            try 
-            {   
-                partial_responses->push_back(message);
-                std::string total_response = std::accumulate(partial_responses->begin(), partial_responses->end(), std::string(""));                
-                ollama::response response(total_response, ollama::message_type::chat);
-                partial_responses->clear();  
-
-                if ( response.has_error() ) { if (ollama::use_exceptions) throw ollama::exception("Ollama response returned error: "+response.get_error() ); }
-                on_receive_token(response);
-            }
-            catch (const ollama::invalid_json_exception& e) { /* Partial response was received. Will do nothing and attempt to concatenate with the next response. */ }
-
-            return true;
-        };
+        auto stream_callback = ollama::make_stream_callback(on_receive_token, ollama::message_type::chat, true);
 
         if (auto res = this->cli->Post("/api/chat", request_string, "application/json", stream_callback)) { return true; }
         else { if (ollama::use_exceptions) throw ollama::exception( "No response from server returned at URL"+this->server_url+" Error: "+httplib::to_string( res.error() ) ); }
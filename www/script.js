@@ -65,8 +65,7 @@ function fetchQueryUpdates(queryId) {
                 return;
             }
 
-            // Parse the status JSON string
-            const status = JSON.parse(data.status);
+            const status = data.status;
 
             // Extract relevant fields
             const completed = status.completed;
@@ -106,65 +105,82 @@ function fetchQueryUpdates(queryId) {
     }, 1000);
 }
 
+let chartMetric; // Metric shown in the chart, picked from the aggregate statistics
+
 function fetchPerformanceStatistics() {
-    fetch('/performance_statistics')
+    if (!chartMetric) {
+        // Pick a metric once; the chart then follows its series
+        fetch('/performance_statistics')
+            .then(response => response.json())
+            .then(data => {
+                if (data.length > 0) {
+                    chartMetric = data[0].metric_name;
+                    fetchPerformanceStatistics();
+                }
+            })
+            .catch(error => {
+                console.error('Error fetching performance statistics:', error);
+            });
+        return;
+    }
+
+    // The server buckets the last 10 minutes; the chart is redrawn from the result
+    const to = Date.now();
+    const from = to - 10 * 60 * 1000;
+    const params = new URLSearchParams({ metric: chartMetric, from: from, to: to, step: 10000 });
+    fetch('/performance_statistics?' + params)
         .then(response => response.json())
-        .then(data => {
-            const currentTime = new Date().toLocaleTimeString(); // Get the current time
+        .then(series => {
+            const labels = series.points.map(point => new Date(point.t).toLocaleTimeString());
+            const values = [
+                series.points.map(point => point.avg),
+                series.points.map(point => point.p99),
+                series.points.map(point => point.count),
+                series.points.map(point => point.max),
+                series.points.map(point => point.min)
+            ];
 
             if (chart) {
-                // Update the existing chart with new data
-                chart.data.labels.push(currentTime);
-
-                chart.data.datasets[0].data.push(data[0].average_value);
-                chart.data.datasets[1].data.push(data[0].count);
-                chart.data.datasets[2].data.push(data[0].max_value);
-                chart.data.datasets[3].data.push(data[0].min_value);
-                chart.data.datasets[4].data.push(data[0].total_value);
-
-                // Keep the last 10 entries in the chart
-                if (chart.data.labels.length > 10) {
-                    chart.data.labels.shift();
-                    chart.data.datasets.forEach(dataset => dataset.data.shift());
-                }
-
+                // Replace the chart data with the new series
+                chart.data.labels = labels;
+                chart.data.datasets.forEach((dataset, i) => dataset.data = values[i]);
                 chart.update();
             } else {
                 // Create the chart if it doesn't exist
                 chart = new Chart(ctx, {
                     type: 'line',
                     data: {
-                        labels: [currentTime],
+                        labels: labels,
                         datasets: [
                             {
                                 label: 'Average',
-                                data: [data[0].average_value],
+                                data: values[0],
                                 borderColor: 'rgba(75, 192, 192, 1)',
                                 fill: false
                             },
+                            {
+                                label: 'p99',
+                                data: values[1],
+                                borderColor: 'rgba(153, 102, 255, 1)',
+                                fill: false
+                            },
                             {
                                 label: 'Count',
-                                data: [data[0].count],
+                                data: values[2],
                                 borderColor: 'rgba(54, 162, 235, 1)',
                                 fill: false
                             },
                             {
                                 label: 'Max',
-                                data: [data[0].max_value],
+                                data: values[3],
                                 borderColor: 'rgba(255, 99, 132, 1)',
                                 fill: false
                             },
                             {
                                 label: 'Min',
-                                data: [data[0].min_value],
+                                data: values[4],
                                 borderColor: 'rgba(255, 206, 86, 1)',
                                 fill: false
-                            },
-                            {
-                                label: 'Total',
-                                data: [data[0].total_value],
-                                borderColor: 'rgba(153, 102, 255, 1)',
-                                fill: false
                             }
                         ]
                     },
@@ -179,7 +195,7 @@ function fetchPerformanceStatistics() {
                             y: {
                                 title: {
                                     display: true,
-                                    text: 'Value'
+                                    text: chartMetric
                                 }
                             }
                         },
@@ -199,7 +215,7 @@ function fetchPerformanceStatistics() {
 }
 
 // Fetch statistics on an interval
-setInterval(fetchPerformanceStatistics, 1000); // Fetch every 5 seconds
+setInterval(fetchPerformanceStatistics, 5000); // Fetch every 5 seconds
 
 function addMessage(message, alignment) {
     const responseContainer = document.getElementById('queryResponses');